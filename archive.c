@@ -0,0 +1,671 @@
+/* archive.c - index of the workouts in a directory */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The index holds one fixed size record per .srd file in a
+ * directory, so queries read the index instead of parsing every
+ * file. It is memory mapped for reading. Layout (all numbers big
+ * endian):
+ *
+ *   "S725ARCI"  magic
+ *   u32         version
+ *   u32         record length
+ *
+ * followed by one record per file:
+ *
+ *    0  u64     start of the workout, unix time
+ *    8  u64     modification time of the file
+ *   16  u32     size of the file
+ *   20  u32     duration in seconds
+ *   24  u32     distance in meters
+ *   28  u32     energy
+ *   32  u16     ascent in meters
+ *   34  u8      type, 0 if the file could not be parsed
+ *   35  u8      recording mode
+ *   36  u8      average heart rate
+ *   37  u8      maximum heart rate
+ *   38  u8      laps
+ *   39  u8      reserved
+ *   40  char    file name, NUL padded to NAME_MAX + 1 bytes
+ *
+ * New files are appended. If a file has changed or disappeared, the
+ * index is written again to a temporary file that replaces it.
+ * Updates hold an exclusive flock() on the index, so two of them do
+ * not race when run at the same time.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "buf.h"
+#include "log.h"
+#include "scan.h"
+#include "workout.h"
+#include "workout_int.h"
+#include "xmalloc.h"
+
+#define ARCHIVE_MAGIC		"S725ARCI"
+#define ARCHIVE_MAGIC_LEN	8
+#define ARCHIVE_VERSION		2
+#define ARCHIVE_HEADER_LEN	16
+#define ARCHIVE_REC_LEN		(40 + ARCHIVE_NAME_MAX)
+
+struct archive {
+	char		*dir;
+	char		*path;
+	int			 fd;
+	u_char		*map;
+	size_t		 maplen;
+	size_t		 count;
+};
+
+/* a file in the directory that is not indexed, or has changed */
+struct archive_file {
+	char		 name[ARCHIVE_NAME_MAX];
+	struct stat	 st;
+};
+
+static int archive_map(ARCHIVE *a);
+static void archive_unmap(ARCHIVE *a);
+static int archive_reset(ARCHIVE *a);
+static int archive_lock(ARCHIVE *a);
+
+static int
+archive_seconds(const S725_Time *t)
+{
+	return t->hours * 3600 + t->minutes * 60 + t->seconds;
+}
+
+static void
+archive_put16(u_char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+}
+
+static void
+archive_put32(u_char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static void
+archive_put64(u_char *p, uint64_t v)
+{
+	archive_put32(p, v >> 32);
+	archive_put32(p + 4, v & 0xffffffff);
+}
+
+static uint16_t
+archive_get16(const u_char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t
+archive_get32(const u_char *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t
+archive_get64(const u_char *p)
+{
+	return ((uint64_t)archive_get32(p) << 32) | archive_get32(p + 4);
+}
+
+static void
+archive_encode(u_char *p, const struct archive_rec *r)
+{
+	memset(p, 0, ARCHIVE_REC_LEN);
+	archive_put64(&p[0], r->time);
+	archive_put64(&p[8], r->mtime);
+	archive_put32(&p[16], r->size);
+	archive_put32(&p[20], r->duration);
+	archive_put32(&p[24], r->distance);
+	archive_put32(&p[28], r->energy);
+	archive_put16(&p[32], r->ascent);
+	p[34] = r->type;
+	p[35] = r->mode;
+	p[36] = r->avg_hr;
+	p[37] = r->max_hr;
+	p[38] = r->laps;
+	strncpy((char *)&p[40], r->name, ARCHIVE_NAME_MAX);
+}
+
+static void
+archive_decode(const u_char *p, struct archive_rec *r)
+{
+	r->time     = (int64_t)archive_get64(&p[0]);
+	r->mtime    = (int64_t)archive_get64(&p[8]);
+	r->size     = archive_get32(&p[16]);
+	r->duration = archive_get32(&p[20]);
+	r->distance = archive_get32(&p[24]);
+	r->energy   = archive_get32(&p[28]);
+	r->ascent   = archive_get16(&p[32]);
+	r->type     = p[34];
+	r->mode     = p[35];
+	r->avg_hr   = p[36];
+	r->max_hr   = p[37];
+	r->laps     = p[38];
+	memcpy(r->name, &p[40], ARCHIVE_NAME_MAX);
+	r->name[ARCHIVE_NAME_MAX - 1] = '\0';
+}
+
+ARCHIVE *
+archive_open(const char *dir)
+{
+	u_char hdr[ARCHIVE_HEADER_LEN];
+	char path[PATH_MAX];
+	ARCHIVE *a;
+	ssize_t n;
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, ARCHIVE_NAME) >= sizeof(path)) {
+		log_error("%s: path too long", dir);
+		return NULL;
+	}
+
+	a = xcalloc(1, sizeof(*a));
+	a->dir = xstrdup(dir);
+	a->path = xstrdup(path);
+	if ((a->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+		log_error("%s: %s", path, strerror(errno));
+		archive_close(a);
+		return NULL;
+	}
+
+	/* the index can always be built again, so start over if it is not ours */
+	if (flock(a->fd, LOCK_EX) == -1) {
+		log_error("%s: %s", path, strerror(errno));
+		archive_close(a);
+		return NULL;
+	}
+	n = pread(a->fd, hdr, sizeof(hdr), 0);
+	if (n != sizeof(hdr) ||
+		memcmp(hdr, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LEN) != 0 ||
+		archive_get32(&hdr[8]) != ARCHIVE_VERSION ||
+		archive_get32(&hdr[12]) != ARCHIVE_REC_LEN) {
+		if (n != 0)
+			log_info("%s: unknown format, building a new index", path);
+		if (!archive_reset(a)) {
+			archive_close(a);
+			return NULL;
+		}
+	}
+	flock(a->fd, LOCK_UN);
+
+	if (!archive_map(a)) {
+		archive_close(a);
+		return NULL;
+	}
+
+	return a;
+}
+
+size_t
+archive_count(ARCHIVE *a)
+{
+	return a->count;
+}
+
+void
+archive_get(ARCHIVE *a, size_t i, struct archive_rec *r)
+{
+	archive_decode(a->map + ARCHIVE_HEADER_LEN + i * ARCHIVE_REC_LEN, r);
+}
+
+void
+archive_close(ARCHIVE *a)
+{
+	archive_unmap(a);
+	if (a->fd != -1)
+		close(a->fd);
+	xfree(a->path);
+	xfree(a->dir);
+	xfree(a);
+}
+
+static void
+archive_write_header(u_char *hdr)
+{
+	memcpy(hdr, ARCHIVE_MAGIC, ARCHIVE_MAGIC_LEN);
+	archive_put32(&hdr[8], ARCHIVE_VERSION);
+	archive_put32(&hdr[12], ARCHIVE_REC_LEN);
+}
+
+/* Truncate the index to an empty one. */
+static int
+archive_reset(ARCHIVE *a)
+{
+	u_char hdr[ARCHIVE_HEADER_LEN];
+
+	archive_write_header(hdr);
+	if (ftruncate(a->fd, 0) == -1 ||
+		pwrite(a->fd, hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		log_error("%s: %s", a->path, strerror(errno));
+		return 0;
+	}
+	return 1;
+}
+
+static int
+archive_map(ARCHIVE *a)
+{
+	struct stat st;
+
+	if (fstat(a->fd, &st) == -1) {
+		log_error("%s: %s", a->path, strerror(errno));
+		return 0;
+	}
+
+	/* ignore a partly written record at the end */
+	a->count = (st.st_size - ARCHIVE_HEADER_LEN) / ARCHIVE_REC_LEN;
+	a->maplen = ARCHIVE_HEADER_LEN + a->count * ARCHIVE_REC_LEN;
+	a->map = mmap(NULL, a->maplen, PROT_READ, MAP_SHARED, a->fd, 0);
+	if (a->map == MAP_FAILED) {
+		log_error("%s: mmap: %s", a->path, strerror(errno));
+		a->map = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static void
+archive_unmap(ARCHIVE *a)
+{
+	if (a->map != NULL)
+		munmap(a->map, a->maplen);
+	a->map = NULL;
+	a->count = 0;
+}
+
+/*
+ * Take the exclusive lock for an update and map the index again, as
+ * another update may have changed it. An update that rebuilds the
+ * index replaces the file, so after waiting the lock may be held on
+ * a file that is gone; then the new one is opened and locked.
+ */
+static int
+archive_lock(ARCHIVE *a)
+{
+	struct stat cur, st;
+	int fd;
+
+	for (;;) {
+		if (flock(a->fd, LOCK_EX) == -1 || fstat(a->fd, &cur) == -1) {
+			log_error("%s: %s", a->path, strerror(errno));
+			return 0;
+		}
+		if (stat(a->path, &st) == 0 && st.st_dev == cur.st_dev &&
+			st.st_ino == cur.st_ino)
+			break;
+		if ((fd = open(a->path, O_RDWR | O_CREAT, 0644)) == -1) {
+			log_error("%s: %s", a->path, strerror(errno));
+			return 0;
+		}
+		archive_unmap(a);
+		close(a->fd);
+		a->fd = fd;
+	}
+	archive_unmap(a);
+	/* removed while waiting, the open above created an empty file */
+	if (cur.st_size < ARCHIVE_HEADER_LEN && !archive_reset(a))
+		return 0;
+	return archive_map(a);
+}
+
+/* Set the fields of <r> that come from the workout <w>. */
+void
+archive_rec_set(struct archive_rec *r, workout_t *w)
+{
+	r->time = w->unixtime;
+	r->type = w->type;
+	r->mode = w->mode;
+	r->laps = w->laps;
+	r->duration = archive_seconds(&w->duration);
+	r->energy = w->energy;
+	r->avg_hr = w->avg_hr;
+	r->max_hr = w->max_hr;
+	r->distance = 0;
+	r->ascent = 0;
+	if (w->type != S725_HRM_S610) {
+		if (w->units.system == S725_UNITS_ENGLISH) {
+			r->distance = w->exercise_distance * 160.9344;
+			r->ascent = w->ascent * 0.3048;
+		} else {
+			r->distance = w->exercise_distance * 100;
+			r->ascent = w->ascent;
+		}
+	}
+}
+
+/* called by scan_run for each new or changed file */
+static void
+archive_index_file(int worker, size_t i, const char *path, workout_t *w,
+				   void *arg)
+{
+	struct archive_rec *recs = arg;
+
+	if (w != NULL)
+		archive_rec_set(&recs[i], w);
+}
+
+static int
+archive_is_srd(const char *name)
+{
+	size_t len = strlen(name);
+
+	return len > 4 && strcmp(name + len - 4, ".srd") == 0;
+}
+
+static uint64_t
+archive_name_hash(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*s)
+		h = (h ^ (u_char)*s++) * 0x100000001b3ULL;
+	return h;
+}
+
+/*
+ * Bring the index up to date with the directory, parsing new files
+ * on <threads> threads (see scan_run). Returns the number of files
+ * that were indexed, or -1 on error.
+ */
+int
+archive_update(ARCHIVE *a, int threads)
+{
+	char tmp[PATH_MAX];
+	u_char hdr[ARCHIVE_HEADER_LEN];
+	u_char rec[ARCHIVE_REC_LEN];
+	struct archive_file *files = NULL;
+	struct archive_rec *recs = NULL;
+	struct archive_rec r;
+	char **paths = NULL;
+	struct dirent *de;
+	struct stat st;
+	size_t nfiles = 0, maxfiles = 0;
+	size_t nslots, nseen = 0;
+	size_t *slots;
+	u_char *seen;
+	int rebuild = 0;
+	int ret = -1;
+	size_t i, j;
+	off_t end;
+	DIR *d;
+	int fd;
+
+	if (!archive_lock(a))
+		return -1;
+	if ((d = opendir(a->dir)) == NULL) {
+		log_error("%s: %s", a->dir, strerror(errno));
+		flock(a->fd, LOCK_UN);
+		return -1;
+	}
+
+	/* names in the index, open addressing, nslots is a power of 2 */
+	for (nslots = 64; nslots < 2 * a->count; nslots *= 2)
+		;
+	slots = xcalloc(nslots, sizeof(*slots));
+	seen = xcalloc(a->count + 1, 1);
+	for (i = 0; i < a->count; i++) {
+		archive_get(a, i, &r);
+		j = archive_name_hash(r.name) & (nslots - 1);
+		while (slots[j] != 0)
+			j = (j + 1) & (nslots - 1);
+		slots[j] = i + 1;
+	}
+
+	/* collect the files that are new or have changed */
+	while ((de = readdir(d)) != NULL) {
+		if (!archive_is_srd(de->d_name))
+			continue;
+		snprintf(tmp, sizeof(tmp), "%s/%s", a->dir, de->d_name);
+		if (stat(tmp, &st) == -1 || !S_ISREG(st.st_mode))
+			continue;
+
+		j = archive_name_hash(de->d_name) & (nslots - 1);
+		for (; slots[j] != 0; j = (j + 1) & (nslots - 1)) {
+			archive_get(a, slots[j] - 1, &r);
+			if (strcmp(r.name, de->d_name) == 0)
+				break;
+		}
+		if (slots[j] != 0) {
+			if (!seen[slots[j] - 1]) {
+				seen[slots[j] - 1] = 1;
+				nseen++;
+			}
+			if (r.mtime == st.st_mtime && r.size == st.st_size)
+				continue;
+			/* changed, drop the old record */
+			seen[slots[j] - 1] = 0;
+			nseen--;
+			rebuild = 1;
+		}
+
+		if (nfiles == maxfiles) {
+			maxfiles = maxfiles ? 2 * maxfiles : 64;
+			files = xrealloc(files, maxfiles, sizeof(*files));
+		}
+		strncpy(files[nfiles].name, de->d_name, ARCHIVE_NAME_MAX);
+		files[nfiles].st = st;
+		nfiles++;
+	}
+	closedir(d);
+
+	if (nseen != a->count)
+		rebuild = 1;
+
+	/* parse the new files first, the old index is still needed below */
+	recs = xcalloc(nfiles + 1, sizeof(*recs));
+	paths = xcalloc(nfiles + 1, sizeof(*paths));
+	for (i = 0; i < nfiles; i++) {
+		memcpy(recs[i].name, files[i].name, sizeof(recs[i].name));
+		recs[i].mtime = files[i].st.st_mtime;
+		recs[i].size = files[i].st.st_size;
+		snprintf(tmp, sizeof(tmp), "%s/%s", a->dir, files[i].name);
+		paths[i] = xstrdup(tmp);
+	}
+	scan_run(paths, nfiles, S725_WORKOUT_HEADER, threads,
+			 archive_index_file, recs);
+
+	if (rebuild) {
+		/* keep the records that are still valid, then add the rest */
+		snprintf(tmp, sizeof(tmp), "%s.XXXXXX", a->path);
+		if ((fd = mkstemp(tmp)) == -1) {
+			log_error("%s: %s", tmp, strerror(errno));
+			goto out;
+		}
+		if (fchmod(fd, 0644) == -1)
+			goto fail;
+		archive_write_header(hdr);
+		end = 0;
+		if (pwrite(fd, hdr, sizeof(hdr), end) != sizeof(hdr))
+			goto fail;
+		end += sizeof(hdr);
+		for (i = 0; i < a->count; i++) {
+			if (!seen[i])
+				continue;
+			if (pwrite(fd, a->map + ARCHIVE_HEADER_LEN + i * ARCHIVE_REC_LEN,
+					   ARCHIVE_REC_LEN, end) != ARCHIVE_REC_LEN)
+				goto fail;
+			end += ARCHIVE_REC_LEN;
+		}
+	} else {
+		fd = a->fd;
+		end = ARCHIVE_HEADER_LEN + a->count * ARCHIVE_REC_LEN;
+	}
+
+	for (i = 0; i < nfiles; i++) {
+		archive_encode(rec, &recs[i]);
+		if (pwrite(fd, rec, sizeof(rec), end) != sizeof(rec))
+			goto fail;
+		end += sizeof(rec);
+	}
+
+	archive_unmap(a);
+	if (rebuild) {
+		if (fsync(fd) == -1 || rename(tmp, a->path) == -1)
+			goto fail;
+		close(a->fd);
+		a->fd = fd;
+	} else if (ftruncate(fd, end) == -1) {
+		goto fail;
+	}
+	if (archive_map(a))
+		ret = nfiles;
+
+ out:
+	flock(a->fd, LOCK_UN);
+	scan_paths_free(paths, nfiles);
+	xfree(recs);
+	if (files != NULL)
+		xfree(files);
+	xfree(seen);
+	xfree(slots);
+	return ret;
+
+ fail:
+	log_error("%s: %s", rebuild ? tmp : a->path, strerror(errno));
+	if (rebuild) {
+		close(fd);
+		unlink(tmp);
+	}
+	if (a->map == NULL)
+		archive_map(a);
+	goto out;
+}
+
+/* Start of the week (Monday, 00:00 local time) that <t> falls in. */
+static time_t
+archive_week_start(time_t t)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	tm.tm_mday -= (tm.tm_wday + 6) % 7;
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+/* Add <src> to the week with the same start, keeping the weeks sorted. */
+static void
+archive_week_add(struct archive_totals *t, const struct archive_week *src)
+{
+	struct archive_week *wk;
+	size_t lo = 0, hi = t->nweeks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (t->weeks[mid].start < src->start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == t->nweeks || t->weeks[lo].start != src->start) {
+		if (t->nweeks == t->maxweeks) {
+			t->maxweeks = t->maxweeks ? 2 * t->maxweeks : 64;
+			t->weeks = xrealloc(t->weeks, t->maxweeks, sizeof(*t->weeks));
+		}
+		memmove(&t->weeks[lo + 1], &t->weeks[lo],
+				(t->nweeks - lo) * sizeof(*t->weeks));
+		memset(&t->weeks[lo], 0, sizeof(*t->weeks));
+		t->weeks[lo].start = src->start;
+		t->nweeks++;
+	}
+
+	wk = &t->weeks[lo];
+	wk->workouts += src->workouts;
+	wk->duration += src->duration;
+	wk->distance += src->distance;
+	wk->ascent += src->ascent;
+}
+
+/* Add the workout <w>, summarized in <r>, to the totals. */
+void
+archive_totals_add(struct archive_totals *t, const struct archive_rec *r,
+				   workout_t *w)
+{
+	struct archive_week wk;
+	int i, j;
+
+	t->workouts++;
+	t->duration += r->duration;
+	t->distance += r->distance;
+	t->ascent += r->ascent;
+	t->energy += r->energy;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			t->zone[i][j] += archive_seconds(&w->hr_zone[i][j]);
+
+	wk.start = archive_week_start(r->time);
+	wk.workouts = 1;
+	wk.duration = r->duration;
+	wk.distance = r->distance;
+	wk.ascent = r->ascent;
+	archive_week_add(t, &wk);
+}
+
+/* Add the totals <src> to <dst>. */
+void
+archive_totals_merge(struct archive_totals *dst, const struct archive_totals *src)
+{
+	size_t i;
+	int j, k;
+
+	dst->workouts += src->workouts;
+	dst->duration += src->duration;
+	dst->distance += src->distance;
+	dst->ascent += src->ascent;
+	dst->energy += src->energy;
+	for (j = 0; j < 3; j++)
+		for (k = 0; k < 3; k++)
+			dst->zone[j][k] += src->zone[j][k];
+	for (i = 0; i < src->nweeks; i++)
+		archive_week_add(dst, &src->weeks[i]);
+}
+
+void
+archive_totals_free(struct archive_totals *t)
+{
+	if (t->weeks != NULL)
+		xfree(t->weeks);
+	memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,89 @@
+/* archive.h - index of the workouts in a directory */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <sys/types.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "workout.h"
+
+#define ARCHIVE_NAME		".s725arc.index"
+#define ARCHIVE_NAME_MAX	(NAME_MAX + 1)	/* file name length including the NUL */
+
+typedef struct archive ARCHIVE;
+
+/* one workout, type is 0 if the file could not be parsed */
+struct archive_rec {
+	time_t		 time;			/* start of the workout */
+	time_t		 mtime;			/* of the file when it was indexed */
+	uint32_t	 size;			/* of the file when it was indexed */
+	int			 type;			/* S725_HRM_* */
+	int			 mode;			/* S725_MODE_* */
+	int			 laps;
+	int			 duration;		/* seconds */
+	int			 distance;		/* meters */
+	int			 ascent;		/* meters */
+	int			 energy;
+	int			 avg_hr;
+	int			 max_hr;
+	char		 name[ARCHIVE_NAME_MAX];
+};
+
+/* sums for the workouts that started in one week */
+struct archive_week {
+	time_t		 start;			/* Monday 00:00 local time */
+	int			 workouts;
+	long		 duration;
+	long		 distance;
+	long		 ascent;
+};
+
+/* sums over many workouts, see archive_totals_add */
+struct archive_totals {
+	int			 workouts;
+	long		 duration;		/* seconds */
+	long		 distance;		/* meters */
+	long		 ascent;		/* meters */
+	long		 energy;
+	long		 zone[3][3];	/* seconds below, within and above each HR limit */
+	struct archive_week *weeks;	/* sorted by start */
+	size_t		 nweeks;
+	size_t		 maxweeks;
+};
+
+ARCHIVE	*archive_open(const char *dir);
+int		 archive_update(ARCHIVE *a, int threads);
+size_t	 archive_count(ARCHIVE *a);
+void	 archive_get(ARCHIVE *a, size_t i, struct archive_rec *r);
+void	 archive_close(ARCHIVE *a);
+void	 archive_rec_set(struct archive_rec *r, workout_t *w);
+
+void	 archive_totals_add(struct archive_totals *t,
+							const struct archive_rec *r, workout_t *w);
+void	 archive_totals_merge(struct archive_totals *dst,
+							  const struct archive_totals *src);
+void	 archive_totals_free(struct archive_totals *t);
+
+#endif	/* ARCHIVE_H */
@@ -39,6 +39,7 @@
 #include <unistd.h>
 
 #include "buf.h"
+#include "stats.h"
 #include "xmalloc.h"
 
 #define BUF_INCR	128
@@ -51,11 +52,15 @@ struct buf {
 	/* record out of bounds access when reading */
 	int		 cb_readerr;
 	size_t	 cb_readerr_offset;
+	int		 cb_flags;
 };
 
+#define BUF_WRAPPED	0x01	/* cb_buf belongs to the caller */
+
 #define SIZE_LEFT(b)	(b->cb_size - b->cb_len)
 
 static void	buf_grow(BUF *, size_t);
+static void	buf_unwrap(BUF *);
 
 /*
  * Create a new buffer structure and return a pointer to it.  This structure
@@ -67,17 +72,59 @@ buf_alloc(size_t len)
 {
 	BUF *b;
 
-	b = xmalloc(sizeof(*b));
+	if ((b = buf_create(len)) == NULL)
+		errx(1, "buf_alloc: out of memory (allocating %zu bytes)", len);
+	return (b);
+}
+
+/*
+ * Like buf_alloc(), but returns NULL if the memory cannot be allocated
+ * instead of ending the process, as the library must.
+ */
+BUF *
+buf_create(size_t len)
+{
+	BUF *b;
+
+	if ((b = hmalloc(sizeof(*b))) == NULL)
+		return (NULL);
 	/* Postpone creation of zero-sized buffers */
-	if (len > 0)
-		b->cb_buf = xcalloc(1, len);
-	else
+	if (len > 0) {
+		if ((b->cb_buf = hcalloc(1, len)) == NULL) {
+			hfree(b);
+			return (NULL);
+		}
+		stats_add(STATS_ALLOCS, 1);
+	} else
 		b->cb_buf = NULL;
+	stats_add(STATS_ALLOCS, 1);
 
 	b->cb_size = len;
 	b->cb_len = 0;
 	b->cb_readerr = 0;
 	b->cb_readerr_offset = 0;
+	b->cb_flags = 0;
+
+	return (b);
+}
+
+/*
+ * Create a buffer for the <len> bytes at <data> without copying them.
+ * The data must stay valid until the buffer is freed. It is never
+ * written to, the buffer makes a copy of its own before any change.
+ * Returns NULL if there is not enough memory.
+ */
+BUF *
+buf_wrap(const void *data, size_t len)
+{
+	BUF *b;
+
+	if ((b = buf_create(0)) == NULL)
+		return (NULL);
+	b->cb_buf = (u_char *)data;
+	b->cb_size = len;
+	b->cb_len = len;
+	b->cb_flags = BUF_WRAPPED;
 
 	return (b);
 }
@@ -144,7 +191,7 @@ out:
 void
 buf_free(BUF *b)
 {
-	if (b->cb_buf != NULL)
+	if (b->cb_buf != NULL && !(b->cb_flags & BUF_WRAPPED))
 		xfree(b->cb_buf);
 	xfree(b);
 }
@@ -159,6 +206,7 @@ buf_release(BUF *b)
 {
 	void *tmp;
 
+	buf_unwrap(b);
 	tmp = b->cb_buf;
 	xfree(b);
 	return (tmp);
@@ -176,6 +224,11 @@ buf_get(BUF *b)
 void
 buf_empty(BUF *b)
 {
+	if (b->cb_flags & BUF_WRAPPED) {
+		b->cb_buf = NULL;
+		b->cb_size = 0;
+		b->cb_flags &= ~BUF_WRAPPED;
+	}
 	if (b->cb_buf)
 		memset(b->cb_buf, 0, b->cb_size);
 	b->cb_len = 0;
@@ -325,6 +378,22 @@ buf_get_readerr_offset(BUF * b)
 	return b->cb_readerr_offset;
 }
 
+/*
+ * Return the 64 bit FNV-1a hash of the buffer contents.
+ */
+uint64_t
+buf_hash(BUF *b)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < b->cb_len; i++) {
+		h ^= b->cb_buf[i];
+		h *= 0x100000001b3ULL;
+	}
+	return (h);
+}
+
 /*
  * Grow the buffer <b> by <len> bytes.  The contents are unchanged by this
  * operation regardless of the result.
@@ -332,6 +401,25 @@ buf_get_readerr_offset(BUF * b)
 static void
 buf_grow(BUF *b, size_t len)
 {
+	buf_unwrap(b);
 	b->cb_buf = xrealloc(b->cb_buf, 1, b->cb_size + len);
 	b->cb_size += len;
 }
+
+/*
+ * Replace wrapped data in <b> with a copy that belongs to the buffer.
+ */
+static void
+buf_unwrap(BUF *b)
+{
+	u_char *p = NULL;
+
+	if (!(b->cb_flags & BUF_WRAPPED))
+		return;
+	if (b->cb_size > 0) {
+		p = xmalloc(b->cb_size);
+		memcpy(p, b->cb_buf, b->cb_size);
+	}
+	b->cb_buf = p;
+	b->cb_flags &= ~BUF_WRAPPED;
+}
@@ -42,10 +42,14 @@
 
 #include <sys/types.h>
 
+#include <stdint.h>
+
 typedef struct buf BUF;
 
 BUF			*buf_alloc(size_t);
+BUF			*buf_create(size_t);
 BUF			*buf_load(const char *);
+BUF			*buf_wrap(const void *, size_t);
 void		 buf_free(BUF *);
 void		*buf_release(BUF *);
 u_char		 buf_getc(BUF *, size_t);
@@ -61,4 +65,5 @@ size_t		 buf_capacity(BUF *);
 u_char		*buf_get(BUF *b);
 int			 buf_get_readerr(BUF *);
 size_t		 buf_get_readerr_offset(BUF *);
+uint64_t	 buf_hash(BUF *);
 #endif	/* BUF_H */
@@ -0,0 +1,475 @@
+/* cache.c - on-disk cache of parsed workouts */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The cache holds fully parsed workouts, so that converting the same
+ * .srd file again does not run the parser. The file is memory mapped
+ * for reading and only ever appended to. Numbers are in host byte
+ * order: the cache is only meant for the machine that wrote it, and
+ * is started over when the layout of workout_t or the parser changes.
+ *
+ *   "S725WCAC"  magic
+ *   u32         version
+ *   u32         byte order mark, 0x01020304
+ *   u32         size of workout_t
+ *   u32         size of lap_data_t
+ *   u32         WORKOUT_PARSER_VERSION
+ *   u32         reserved
+ *
+ * followed by one entry per workout:
+ *
+ *    0  u64     hash of the input
+ *    8  u64     checksum of the image
+ *   16  u32     length of the input
+ *   20  u32     length of the image
+ *   24  u32     type the input was parsed as
+ *   28  u32     reserved
+ *   32          input, padded to 8 bytes
+ *               image from workout_image()
+ *
+ * The input is kept to compare it with the data being looked up, so
+ * a hash collision never returns the wrong workout. Entries added
+ * while the cache is open are found after it has been opened again.
+ * Writers take an exclusive flock() on the file. A torn entry left
+ * at the end by a crash is cut off by the next writer.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "log.h"
+#include "workout_int.h"
+#include "xmalloc.h"
+
+#define CACHE_MAGIC		"S725WCAC"
+#define CACHE_MAGIC_LEN	8
+#define CACHE_VERSION	1
+#define CACHE_BOM		0x01020304
+#define CACHE_MAX_IMAGE	(64 * 1024 * 1024)
+#define CACHE_MIN_SLOTS	64
+#define CACHE_ALIGN(x)	(((x) + 7) & ~(size_t)7)
+
+struct cache_header {
+	char		 magic[CACHE_MAGIC_LEN];
+	uint32_t	 version;
+	uint32_t	 bom;
+	uint32_t	 workout_size;
+	uint32_t	 lap_size;
+	uint32_t	 parser;
+	uint32_t	 reserved;
+};
+
+struct cache_entry {
+	uint64_t	 hash;
+	uint64_t	 sum;
+	uint32_t	 len;
+	uint32_t	 size;
+	uint32_t	 type;
+	uint32_t	 reserved;
+};
+
+struct cache_slot {
+	uint64_t	 hash;
+	size_t		 off;		/* of the entry, 0 if the slot is unused */
+};
+
+struct cache {
+	char		*path;
+	int			 fd;
+	int			 writable;
+	u_char		*map;
+	size_t		 maplen;
+	size_t		 end;		/* of the last complete entry seen */
+	struct cache_slot *slots;
+	size_t		 nslots;
+	size_t		 nused;
+	pthread_mutex_t lock;	/* serializes cache_put between threads */
+};
+
+static int cache_check(CACHE *c);
+static int cache_reset(CACHE *c);
+static int cache_map(CACHE *c);
+static off_t cache_tail(CACHE *c);
+static void cache_insert(CACHE *c, uint64_t hash, size_t off);
+
+/*
+ * Hash 8 bytes at a time. This is several times faster than the
+ * bytewise FNV-1a of buf_hash(), which would otherwise take a good
+ * part of the time saved on a lookup.
+ */
+static uint64_t
+cache_hash(const u_char *p, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ len;
+	uint64_t v;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, 8);
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	v = 0;
+	memcpy(&v, p, len);
+	h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+/*
+ * Returns the length of the entry <e> at <off>, or 0 if it is not a
+ * complete entry in a file of <filelen> bytes.
+ */
+static size_t
+cache_entry_len(const struct cache_entry *e, size_t off, size_t filelen)
+{
+	size_t len;
+
+	if (e->len < 2 || e->len > 65535 || e->size % 8 != 0 ||
+		e->size < CACHE_ALIGN(sizeof(workout_t)) || e->size > CACHE_MAX_IMAGE)
+		return 0;
+	len = sizeof(*e) + CACHE_ALIGN(e->len) + e->size;
+	if (off > filelen || len > filelen - off)
+		return 0;
+	return len;
+}
+
+CACHE *
+cache_open(const char *path)
+{
+	CACHE *c;
+
+	c = xcalloc(1, sizeof(*c));
+	xasprintf(&c->path, "%s", path);
+	pthread_mutex_init(&c->lock, NULL);
+
+	c->writable = 1;
+	if ((c->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+		c->writable = 0;
+		c->fd = open(path, O_RDONLY);
+	}
+	if (c->fd == -1 || flock(c->fd, LOCK_SH) == -1) {
+		log_error("%s: %s", path, strerror(errno));
+		cache_close(c);
+		return NULL;
+	}
+
+	/* the cache can always be filled again, so start over if it is not ours */
+	if (!cache_check(c)) {
+		if (!c->writable) {
+			log_info("%s: unknown format, not using the cache", path);
+		} else if (flock(c->fd, LOCK_EX) == -1 || !cache_reset(c)) {
+			log_error("%s: %s", path, strerror(errno));
+			cache_close(c);
+			return NULL;
+		}
+	}
+
+	if (!cache_map(c)) {
+		cache_close(c);
+		return NULL;
+	}
+	flock(c->fd, LOCK_UN);
+
+	log_info("cache_open: %s: %zu workouts", path, c->nused);
+	return c;
+}
+
+/*
+ * Returns a copy of the workout parsed from the same data as <buf>
+ * with <type>, or NULL if there is none. Like a parse, the copy
+ * is taken from <arena> if given.
+ */
+workout_t *
+cache_get(CACHE *c, BUF *buf, S725_HRM_Type type, workout_arena_t *arena)
+{
+	struct cache_entry e;
+	struct cache_slot *s;
+	const u_char *p;
+	workout_t *w;
+	uint64_t hash;
+	size_t i;
+
+	if (c->nused == 0)
+		return NULL;
+
+	hash = cache_hash(buf_get(buf), buf_len(buf));
+
+	/* open addressing with linear probing, nslots is a power of 2 */
+	for (i = hash & (c->nslots - 1); c->slots[i].off != 0;
+		 i = (i + 1) & (c->nslots - 1)) {
+		s = &c->slots[i];
+		if (s->hash != hash)
+			continue;
+		p = c->map + s->off;
+		memcpy(&e, p, sizeof(e));
+		p += sizeof(e);
+		if (e.len != buf_len(buf) || e.type != type ||
+			memcmp(p, buf_get(buf), e.len) != 0)
+			continue;
+		p += CACHE_ALIGN(e.len);
+		if (cache_hash(p, e.size) != e.sum) {
+			log_info("cache_get: %s: bad checksum at %zu", c->path, s->off);
+			continue;
+		}
+		if ((w = workout_from_image(p, e.size, buf, arena)) != NULL)
+			return w;
+	}
+
+	return NULL;
+}
+
+/*
+ * Append the fully parsed workout <w> that was read from <buf> with
+ * <type>. Errors are logged, the workout is just not cached then.
+ */
+void
+cache_put(CACHE *c, BUF *buf, S725_HRM_Type type, workout_t *w)
+{
+	struct cache_entry e;
+	u_char *entry;
+	u_char *image;
+	size_t len;
+	ssize_t n;
+	off_t off;
+
+	if (!c->writable)
+		return;
+
+	memset(&e, 0, sizeof(e));
+	e.hash = cache_hash(buf_get(buf), buf_len(buf));
+	e.len = buf_len(buf);
+	e.size = workout_image(w, NULL);
+	e.type = type;
+	len = sizeof(e) + CACHE_ALIGN(e.len) + e.size;
+
+	/* build the entry first, so that it goes to the file in one write */
+	entry = xcalloc(1, len);
+	image = entry + sizeof(e) + CACHE_ALIGN(e.len);
+	memcpy(entry + sizeof(e), buf_get(buf), e.len);
+	workout_image(w, image);
+	e.sum = cache_hash(image, e.size);
+	memcpy(entry, &e, sizeof(e));
+
+	pthread_mutex_lock(&c->lock);
+	if (flock(c->fd, LOCK_EX) == -1) {
+		log_error("%s: %s", c->path, strerror(errno));
+	} else {
+		if ((off = cache_tail(c)) != -1) {
+			if ((n = pwrite(c->fd, entry, len, off)) == len) {
+				c->end = off + len;
+			} else {
+				log_error("%s: %s", c->path,
+						  n == -1 ? strerror(errno) : "short write");
+				if (ftruncate(c->fd, off) == -1)
+					log_error("%s: %s", c->path, strerror(errno));
+			}
+		}
+		flock(c->fd, LOCK_UN);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	xfree(entry);
+}
+
+void
+cache_close(CACHE *c)
+{
+	if (c->map != NULL)
+		munmap(c->map, c->maplen);
+	if (c->fd != -1)
+		close(c->fd);
+	pthread_mutex_destroy(&c->lock);
+	if (c->slots != NULL)
+		xfree(c->slots);
+	free(c->path);
+	xfree(c);
+}
+
+/* Returns 1 if the file starts with a header for this build. */
+static int
+cache_check(CACHE *c)
+{
+	struct cache_header h;
+
+	if (pread(c->fd, &h, sizeof(h), 0) != sizeof(h))
+		return 0;
+	return memcmp(h.magic, CACHE_MAGIC, CACHE_MAGIC_LEN) == 0 &&
+		h.version == CACHE_VERSION && h.bom == CACHE_BOM &&
+		h.workout_size == sizeof(workout_t) &&
+		h.lap_size == sizeof(lap_data_t) &&
+		h.parser == WORKOUT_PARSER_VERSION;
+}
+
+/* Empty the cache. Called with the exclusive lock held. */
+static int
+cache_reset(CACHE *c)
+{
+	struct cache_header h;
+
+	/* another process may have done it while we waited for the lock */
+	if (cache_check(c))
+		return 1;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+	h.version = CACHE_VERSION;
+	h.bom = CACHE_BOM;
+	h.workout_size = sizeof(workout_t);
+	h.lap_size = sizeof(lap_data_t);
+	h.parser = WORKOUT_PARSER_VERSION;
+
+	if (ftruncate(c->fd, 0) == -1 ||
+		pwrite(c->fd, &h, sizeof(h), 0) != sizeof(h))
+		return 0;
+	return 1;
+}
+
+/* Map the file and index the complete entries in it. */
+static int
+cache_map(CACHE *c)
+{
+	struct cache_entry e;
+	struct stat st;
+	size_t off;
+	size_t len;
+
+	c->nslots = CACHE_MIN_SLOTS;
+	c->slots = xcalloc(c->nslots, sizeof(*c->slots));
+
+	if (!cache_check(c)) {
+		/* a read only cache in an unknown format */
+		c->writable = 0;
+		return 1;
+	}
+
+	if (fstat(c->fd, &st) == -1) {
+		log_error("%s: %s", c->path, strerror(errno));
+		return 0;
+	}
+	off = sizeof(struct cache_header);
+	c->end = off;
+	if (st.st_size <= off)
+		return 1;
+
+	c->maplen = st.st_size;
+	c->map = mmap(NULL, c->maplen, PROT_READ, MAP_SHARED, c->fd, 0);
+	if (c->map == MAP_FAILED) {
+		log_error("%s: mmap: %s", c->path, strerror(errno));
+		c->map = NULL;
+		return 0;
+	}
+
+	while (off + sizeof(e) <= c->maplen) {
+		memcpy(&e, c->map + off, sizeof(e));
+		if ((len = cache_entry_len(&e, off, c->maplen)) == 0)
+			break;
+		cache_insert(c, e.hash, off);
+		off += len;
+	}
+	c->end = off;
+	if (off < c->maplen)
+		log_info("%s: %zu bytes after the last complete entry",
+				 c->path, c->maplen - off);
+
+	return 1;
+}
+
+/*
+ * Returns where the next entry goes. Entries appended by other
+ * processes since the cache was opened are skipped, anything after
+ * them that is not a complete entry is cut off. Called with the
+ * exclusive lock held.
+ */
+static off_t
+cache_tail(CACHE *c)
+{
+	struct cache_entry e;
+	struct stat st;
+	size_t off;
+	size_t len;
+
+	if (fstat(c->fd, &st) == -1) {
+		log_error("%s: %s", c->path, strerror(errno));
+		return -1;
+	}
+	if (st.st_size < c->end) {
+		log_info("%s: cache was emptied by another process", c->path);
+		return -1;
+	}
+
+	for (off = c->end; off < st.st_size; off += len) {
+		if (off + sizeof(e) > st.st_size ||
+			pread(c->fd, &e, sizeof(e), off) != sizeof(e) ||
+			(len = cache_entry_len(&e, off, st.st_size)) == 0) {
+			log_info("%s: cutting off incomplete entry at %zu", c->path, off);
+			if (ftruncate(c->fd, off) == -1) {
+				log_error("%s: %s", c->path, strerror(errno));
+				return -1;
+			}
+			break;
+		}
+	}
+
+	return off;
+}
+
+static void
+cache_insert(CACHE *c, uint64_t hash, size_t off)
+{
+	struct cache_slot *old;
+	size_t n;
+	size_t i;
+	size_t j;
+
+	/* keep the table at most half full */
+	if (2 * (c->nused + 1) > c->nslots) {
+		old = c->slots;
+		n = c->nslots;
+		c->nslots *= 2;
+		c->slots = xcalloc(c->nslots, sizeof(*c->slots));
+		for (i = 0; i < n; i++) {
+			if (old[i].off == 0)
+				continue;
+			for (j = old[i].hash & (c->nslots - 1); c->slots[j].off != 0;
+				 j = (j + 1) & (c->nslots - 1))
+				;
+			c->slots[j] = old[i];
+		}
+		xfree(old);
+	}
+
+	for (i = hash & (c->nslots - 1); c->slots[i].off != 0;
+		 i = (i + 1) & (c->nslots - 1))
+		;
+	c->slots[i].hash = hash;
+	c->slots[i].off = off;
+	c->nused++;
+}
@@ -0,0 +1,35 @@
+/* cache.h - on-disk cache of parsed workouts */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "buf.h"
+#include "workout.h"
+
+typedef struct cache CACHE;
+
+CACHE		*cache_open(const char *path);
+workout_t	*cache_get(CACHE *c, BUF *buf, S725_HRM_Type type,
+					   workout_arena_t *arena);
+void		 cache_put(CACHE *c, BUF *buf, S725_HRM_Type type, workout_t *w);
+void		 cache_close(CACHE *c);
+
+#endif	/* CACHE_H */
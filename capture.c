@@ -0,0 +1,244 @@
+/* capture.c - binary capture of the data sent to and received from the watch */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A capture holds everything written to the device and everything
+ * read from it, without any formatting on the receive path. Bytes
+ * received one at a time are collected into runs that end with the
+ * next write or a read timeout. Layout (all numbers big endian):
+ *
+ *   "S725CAPT"  magic
+ *   u64         wall clock time at the start of the capture
+ *
+ * followed by one record per write or received run:
+ *
+ *   u8          direction (CAPTURE_TX or CAPTURE_RX)
+ *   u64         monotonic time since the start in nanoseconds
+ *   u32         data length
+ *   ...         data
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "buf.h"
+#include "capture.h"
+#include "log.h"
+#include "xmalloc.h"
+
+#define CAPTURE_MAGIC		"S725CAPT"
+#define CAPTURE_MAGIC_LEN	8
+#define CAPTURE_HEADER_LEN	(CAPTURE_MAGIC_LEN + 8)
+#define CAPTURE_RECORD_LEN	13
+
+struct capture {
+	FILE		*fp;			/* writing */
+	char		*path;
+	struct timespec start;
+	BUF			*rx;			/* pending received run */
+	uint64_t	 rx_time;
+	BUF			*in;			/* reading */
+	size_t		 off;
+};
+
+static uint64_t
+capture_now(CAPTURE *c)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)(ts.tv_sec - c->start.tv_sec) * 1000000000 +
+		ts.tv_nsec - c->start.tv_nsec;
+}
+
+static void
+capture_put64(u_char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static uint64_t
+capture_get64(const u_char *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void
+capture_record(CAPTURE *c, int dir, uint64_t time, const void *data, size_t len)
+{
+	u_char hdr[CAPTURE_RECORD_LEN];
+
+	hdr[0] = dir;
+	capture_put64(&hdr[1], time);
+	hdr[9]  = (len >> 24) & 0xff;
+	hdr[10] = (len >> 16) & 0xff;
+	hdr[11] = (len >> 8) & 0xff;
+	hdr[12] = len & 0xff;
+
+	if (fwrite(hdr, sizeof(hdr), 1, c->fp) != 1 ||
+		(len > 0 && fwrite(data, len, 1, c->fp) != 1))
+		log_error("%s: %s", c->path, strerror(errno));
+}
+
+CAPTURE *
+capture_create(const char *path)
+{
+	u_char hdr[CAPTURE_HEADER_LEN];
+	CAPTURE *c;
+	FILE *fp;
+
+	if ((fp = fopen(path, "w")) == NULL) {
+		log_error("%s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	c = xmalloc(sizeof(*c));
+	memset(c, 0, sizeof(*c));
+	c->fp = fp;
+	c->path = xstrdup(path);
+	c->rx = buf_alloc(0);
+	clock_gettime(CLOCK_MONOTONIC, &c->start);
+
+	memcpy(hdr, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+	capture_put64(&hdr[CAPTURE_MAGIC_LEN], time(NULL));
+	if (fwrite(hdr, sizeof(hdr), 1, fp) != 1)
+		log_error("%s: %s", path, strerror(errno));
+
+	return c;
+}
+
+/* Record data written to the device. */
+void
+capture_tx(CAPTURE *c, const void *data, size_t len)
+{
+	capture_flush(c);
+	capture_record(c, CAPTURE_TX, capture_now(c), data, len);
+}
+
+/* Add received data to the current run. */
+void
+capture_rx(CAPTURE *c, const void *data, size_t len)
+{
+	if (buf_len(c->rx) == 0)
+		c->rx_time = capture_now(c);
+	buf_append(c->rx, data, len);
+}
+
+/* End the current run of received data. */
+void
+capture_flush(CAPTURE *c)
+{
+	if (c->rx == NULL || buf_len(c->rx) == 0)
+		return;
+
+	capture_record(c, CAPTURE_RX, c->rx_time, buf_get(c->rx), buf_len(c->rx));
+	buf_empty(c->rx);
+}
+
+CAPTURE *
+capture_open(const char *path)
+{
+	CAPTURE *c;
+	BUF *in;
+
+	if ((in = buf_load(path)) == NULL) {
+		log_error("%s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (buf_len(in) < CAPTURE_HEADER_LEN ||
+		memcmp(buf_get(in), CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+		log_error("%s: not a capture file", path);
+		buf_free(in);
+		return NULL;
+	}
+
+	c = xmalloc(sizeof(*c));
+	memset(c, 0, sizeof(*c));
+	c->path = xstrdup(path);
+	c->in = in;
+	c->off = CAPTURE_HEADER_LEN;
+
+	return c;
+}
+
+/*
+ * Get the next record. The data stays valid until the capture is
+ * closed. Returns 0 at the end of the capture.
+ */
+int
+capture_next(CAPTURE *c, struct capture_rec *r)
+{
+	const u_char *p;
+	size_t len;
+
+	if (c->off + CAPTURE_RECORD_LEN > buf_len(c->in))
+		return 0;
+
+	p = buf_get(c->in) + c->off;
+	len = ((size_t)p[9] << 24) | (p[10] << 16) | (p[11] << 8) | p[12];
+	if (len > buf_len(c->in) - c->off - CAPTURE_RECORD_LEN) {
+		log_error("%s: truncated record at offset %zu", c->path, c->off);
+		return 0;
+	}
+
+	r->dir = p[0];
+	r->time = capture_get64(&p[1]);
+	r->data = p + CAPTURE_RECORD_LEN;
+	r->len = len;
+	c->off += CAPTURE_RECORD_LEN + len;
+
+	return 1;
+}
+
+time_t
+capture_start_time(CAPTURE *c)
+{
+	return capture_get64(buf_get(c->in) + CAPTURE_MAGIC_LEN);
+}
+
+void
+capture_close(CAPTURE *c)
+{
+	if (c->fp) {
+		capture_flush(c);
+		if (fclose(c->fp) != 0)
+			log_error("%s: %s", c->path, strerror(errno));
+	}
+	if (c->rx)
+		buf_free(c->rx);
+	if (c->in)
+		buf_free(c->in);
+	xfree(c->path);
+	xfree(c);
+}
@@ -0,0 +1,54 @@
+/* capture.h - binary capture of the data sent to and received from the watch */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "buf.h"
+
+#define CAPTURE_TX		0		/* written to the device */
+#define CAPTURE_RX		1		/* received from the device */
+
+typedef struct capture CAPTURE;
+
+struct capture_rec {
+	int			 dir;
+	uint64_t	 time;			/* nanoseconds since start of capture */
+	const u_char *data;
+	size_t		 len;
+};
+
+/* writing */
+CAPTURE		*capture_create(const char *path);
+void		 capture_tx(CAPTURE *c, const void *data, size_t len);
+void		 capture_rx(CAPTURE *c, const void *data, size_t len);
+void		 capture_flush(CAPTURE *c);
+
+/* reading */
+CAPTURE		*capture_open(const char *path);
+int			 capture_next(CAPTURE *c, struct capture_rec *r);
+time_t		 capture_start_time(CAPTURE *c);
+
+void		 capture_close(CAPTURE *c);
+
+#endif	/* CAPTURE_H */
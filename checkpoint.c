@@ -0,0 +1,199 @@
+/* checkpoint.c - on-disk copy of a partial transfer */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The checkpoint file is only ever appended to while packets arrive,
+ * so whatever made it to disk before a crash or a lost link can be
+ * read back. Layout (all numbers big endian, like on the wire):
+ *
+ *   "S725CKPT"  magic
+ *   u16         total size announced in the first packet
+ *
+ * followed by one record per received packet:
+ *
+ *   u16         packet number
+ *   u16         data length
+ *   ...         data
+ *
+ * A trailing incomplete record is dropped when loading. The data is
+ * only used again if the watch announces the same total size and its
+ * first packet matches the first record.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "checkpoint.h"
+#include "log.h"
+#include "xmalloc.h"
+
+#define CHECKPOINT_MAGIC		"S725CKPT"
+#define CHECKPOINT_MAGIC_LEN	8
+#define CHECKPOINT_HEADER_LEN	(CHECKPOINT_MAGIC_LEN + 2)
+#define CHECKPOINT_RECORD_LEN	4
+
+struct checkpoint {
+	int		 fd;
+	char	*path;
+};
+
+CHECKPOINT *
+checkpoint_open(const char *path)
+{
+	CHECKPOINT *c;
+	int fd;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) == -1) {
+		log_error("%s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	c = xmalloc(sizeof(*c));
+	c->fd = fd;
+	c->path = xstrdup(path);
+
+	return c;
+}
+
+/*
+ * Read the data of an earlier, incomplete transfer into <files>.
+ * Returns 1 if anything was recovered, 0 otherwise.
+ */
+int
+checkpoint_load(CHECKPOINT *c, BUF *files, unsigned short *p_bytes, int *p_count)
+{
+	BUF *b;
+	u_char *bp;
+	size_t off;
+	size_t len;
+	int count = 0;
+
+	buf_empty(files);
+	*p_bytes = 0;
+	*p_count = 0;
+
+	if ((b = buf_load(c->path)) == NULL)
+		return 0;
+
+	bp = buf_get(b);
+	if (buf_len(b) < CHECKPOINT_HEADER_LEN ||
+		memcmp(bp, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN) != 0) {
+		buf_free(b);
+		return 0;
+	}
+
+	off = CHECKPOINT_HEADER_LEN;
+	while (off + CHECKPOINT_RECORD_LEN <= buf_len(b)) {
+		len = (bp[off + 2] << 8) + bp[off + 3];
+		if (off + CHECKPOINT_RECORD_LEN + len > buf_len(b))
+			break;
+		buf_append(files, &bp[off + CHECKPOINT_RECORD_LEN], len);
+		off += CHECKPOINT_RECORD_LEN + len;
+		count++;
+	}
+
+	/* cut off a partially written record before appending again */
+	if (off < buf_len(b) && ftruncate(c->fd, off) == -1)
+		log_error("%s: %s", c->path, strerror(errno));
+
+	*p_bytes = (bp[CHECKPOINT_MAGIC_LEN] << 8) + bp[CHECKPOINT_MAGIC_LEN + 1];
+	*p_count = count;
+	buf_free(b);
+
+	log_info("checkpoint_load: %d packets, %zu of %hu bytes",
+			 count, buf_len(files), *p_bytes);
+
+	return buf_len(files) > 0;
+}
+
+/*
+ * Discard previous contents and start a new transfer of <p_bytes>.
+ */
+int
+checkpoint_start(CHECKPOINT *c, unsigned short p_bytes)
+{
+	u_char hdr[CHECKPOINT_HEADER_LEN];
+
+	if (ftruncate(c->fd, 0) == -1) {
+		log_error("%s: %s", c->path, strerror(errno));
+		return 0;
+	}
+
+	memcpy(hdr, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN);
+	hdr[CHECKPOINT_MAGIC_LEN]     = p_bytes >> 8;
+	hdr[CHECKPOINT_MAGIC_LEN + 1] = p_bytes & 0xff;
+
+	if (write(c->fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+		log_error("%s: %s", c->path, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Append the data of one packet with a single write.
+ */
+int
+checkpoint_append(CHECKPOINT *c, int p_count, const void *data, size_t len)
+{
+	BUF *b;
+	ssize_t ret;
+
+	if (len == 0)
+		return 1;
+
+	b = buf_alloc(CHECKPOINT_RECORD_LEN + len);
+	buf_putc(b, (p_count >> 8) & 0xff);
+	buf_putc(b, p_count & 0xff);
+	buf_putc(b, (len >> 8) & 0xff);
+	buf_putc(b, len & 0xff);
+	buf_append(b, data, len);
+
+	ret = write(c->fd, buf_get(b), buf_len(b));
+	buf_free(b);
+
+	if (ret != (ssize_t)(CHECKPOINT_RECORD_LEN + len)) {
+		log_error("%s: %s", c->path, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Close the checkpoint. With <completed> set, the file is deleted
+ * because the transfer completed and all data has been saved.
+ */
+void
+checkpoint_close(CHECKPOINT *c, int completed)
+{
+	close(c->fd);
+	if (completed)
+		unlink(c->path);
+	xfree(c->path);
+	xfree(c);
+}
@@ -0,0 +1,38 @@
+/* checkpoint.h - on-disk copy of a partial transfer */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "buf.h"
+
+#define CHECKPOINT_NAME ".s725get.ckpt"
+
+typedef struct checkpoint CHECKPOINT;
+
+CHECKPOINT	*checkpoint_open(const char *path);
+int			 checkpoint_load(CHECKPOINT *c, BUF *files,
+							 unsigned short *p_bytes, int *p_count);
+int			 checkpoint_start(CHECKPOINT *c, unsigned short p_bytes);
+int			 checkpoint_append(CHECKPOINT *c, int p_count,
+							   const void *data, size_t len);
+void		 checkpoint_close(CHECKPOINT *c, int completed);
+
+#endif	/* CHECKPOINT_H */
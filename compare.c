@@ -0,0 +1,337 @@
+/* compare.c - align workouts of the same route and compare them */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Every workout is resampled onto a common grid, either by distance
+ * from the start or by time since the start, with linear
+ * interpolation between the samples. On a distance grid the time at
+ * each point is kept as well, so the delta shows who was ahead by how
+ * many seconds; on a time grid the distance is kept.
+ *
+ * compare_add() only touches the track it is given, so workouts can
+ * be added from several threads, e.g. from a scan_run() callback.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compare.h"
+#include "log.h"
+#include "workout_int.h"
+#include "xmalloc.h"
+
+struct compare {
+	int			 axis;
+	double		 step;
+	size_t		 ntracks;
+	size_t		 ref;				/* reference track + 1, 0 if none */
+	struct compare_track *tracks;
+};
+
+static float
+compare_lerp(float a, float b, float f)
+{
+	return a + (b - a) * f;
+}
+
+COMPARE *
+compare_new(int axis, double step, size_t ntracks)
+{
+	COMPARE *c;
+
+	c = xcalloc(1, sizeof(*c));
+	c->axis = axis;
+	c->step = step;
+	c->ntracks = ntracks;
+	c->tracks = xcalloc(ntracks, sizeof(*c->tracks));
+	return c;
+}
+
+/*
+ * Resample <w> into track <i>. Returns 0 if the workout cannot be
+ * placed on the grid, e.g. it has no speed data for a distance grid.
+ * <w> is NULL for a file that could not be read, the track then only
+ * gets its name.
+ */
+int
+compare_add(COMPARE *c, size_t i, const char *name, workout_t *w)
+{
+	struct compare_track *t = &c->tracks[i];
+	int has_speed, has_alt, ri;
+	size_t ns;
+	size_t j, k, n;
+	double last, pos, x;
+	float *p;
+	float f;
+	int h0, h1;
+
+	xasprintf(&t->name, "%s", name);
+	if (w == NULL)
+		return 0;
+	t->start = w->unixtime;
+
+	has_speed = S725_HAS_SPEED(w->mode);
+	has_alt = S725_HAS_ALTITUDE(w->mode);
+	ri = w->recording_interval;
+	ns = w->samples;
+	if (ns == 0 || ri <= 0)
+		return 0;
+	if (c->axis == COMPARE_DISTANCE) {
+		if (!has_speed) {
+			log_info("compare_add: %s: no speed data", name);
+			return 0;
+		}
+		last = w->dist_data[ns - 1];
+	} else {
+		last = (double)(ns - 1) * ri;
+	}
+	n = (size_t)(last / c->step + 1e-9) + 1;
+
+	p = xcalloc(n * COMPARE_NFIELDS, sizeof(float));
+	for (k = 0; k < COMPARE_NFIELDS; k++)
+		t->v[k] = p + k * n;
+
+	j = 0;
+	for (k = 0; k < n; k++) {
+		pos = k * c->step;
+
+		/* find the samples j and j + 1 around pos, f is the fraction */
+		if (c->axis == COMPARE_DISTANCE) {
+			while (j + 1 < ns && w->dist_data[j + 1] <= pos)
+				j++;
+			if (j + 1 < ns && pos > w->dist_data[j])
+				f = (pos - w->dist_data[j]) /
+					(w->dist_data[j + 1] - w->dist_data[j]);
+			else
+				f = 0;
+			t->v[COMPARE_OTHER][k] = (j + f) * ri;
+		} else {
+			x = pos / ri;
+			j = x;
+			f = x - j;
+			if (j + 1 >= ns) {
+				j = ns - 1;
+				f = 0;
+			}
+		}
+		if (j + 1 >= ns)
+			f = 0;
+
+#define LERP(a)		compare_lerp((a)[j], (a)[j + (f > 0)], f)
+
+		/* the watch records 0 while it has no heart rate signal */
+		h0 = w->hr_data[j];
+		h1 = w->hr_data[j + (f > 0)];
+		t->v[COMPARE_HR][k] = (h0 == 0 || h1 == 0) ? NAN : LERP(w->hr_data);
+		t->v[COMPARE_SPEED][k] = has_speed ? LERP(w->speed_data) / 16 : NAN;
+		t->v[COMPARE_ALT][k] = has_alt ? LERP(w->alt_data) : NAN;
+		if (c->axis == COMPARE_TIME)
+			t->v[COMPARE_OTHER][k] = has_speed ? LERP(w->dist_data) : NAN;
+
+#undef LERP
+	}
+	t->n = n;
+
+	return 1;
+}
+
+/* Subtract the values of track <ref> from all other tracks. */
+void
+compare_deltas(COMPARE *c, size_t ref)
+{
+	struct compare_track *r = &c->tracks[ref];
+	struct compare_track *t;
+	size_t i, k, f;
+	float *p;
+
+	c->ref = ref + 1;
+	for (i = 0; i < c->ntracks; i++) {
+		t = &c->tracks[i];
+		if (i == ref || t->n == 0)
+			continue;
+		if (t->d[0] == NULL) {
+			p = xcalloc(t->n * COMPARE_NFIELDS, sizeof(float));
+			for (f = 0; f < COMPARE_NFIELDS; f++)
+				t->d[f] = p + f * t->n;
+		}
+		for (f = 0; f < COMPARE_NFIELDS; f++) {
+			for (k = 0; k < t->n; k++)
+				t->d[f][k] = k < r->n ? t->v[f][k] - r->v[f][k] : NAN;
+		}
+	}
+}
+
+/* Returns the number of grid points covered by any track. */
+size_t
+compare_points(COMPARE *c)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < c->ntracks; i++)
+		if (c->tracks[i].n > n)
+			n = c->tracks[i].n;
+	return n;
+}
+
+const struct compare_track *
+compare_track(COMPARE *c, size_t i)
+{
+	return &c->tracks[i];
+}
+
+/*
+ * Write "\t<v>" with <prec> decimals. Tables for hundreds of workouts
+ * have millions of values, this is much faster than sink_printf().
+ */
+static void
+compare_put(SINK *out, float v, int prec)
+{
+	static const long scale[] = { 1, 10, 100, 1000 };
+	char buf[32];
+	char *p = buf + sizeof(buf);
+	unsigned long x;
+	double y;
+	int neg;
+	int i;
+
+	if (isnan(v) || v > 1e9 || v < -1e9) {
+		if (isnan(v))
+			sink_write(out, "\tnan", 4);
+		else
+			sink_printf(out, "\t%.*f", prec, v);
+		return;
+	}
+
+	/* round half to even, like printf */
+	y = (v < 0 ? -v : v) * (double)scale[prec];
+	x = y;
+	if (y - x > 0.5 || (y - x == 0.5 && (x & 1)))
+		x++;
+	neg = signbit(v);
+	for (i = 0; i < prec; i++) {
+		*--p = '0' + x % 10;
+		x /= 10;
+	}
+	if (prec > 0)
+		*--p = '.';
+	do {
+		*--p = '0' + x % 10;
+		x /= 10;
+	} while (x > 0);
+	if (neg)
+		*--p = '-';
+	*--p = '\t';
+	sink_write(out, p, buf + sizeof(buf) - p);
+}
+
+/*
+ * Write the grid as a table with one row per point, like the samples
+ * of the txt format. Each workout has the columns HR, Spd, Alt and
+ * Time or Dist, followed by the deltas if compare_deltas() was
+ * called. Values a workout does not have are nan.
+ */
+void
+compare_print(COMPARE *c, SINK *out)
+{
+	static const char *names[2][COMPARE_NFIELDS] = {
+		{ "HR", "Spd", "Alt", "Time" },
+		{ "HR", "Spd", "Alt", "Dist" },
+	};
+	static const int precision[2][COMPARE_NFIELDS] = {
+		{ 0, 1, 0, 0 },
+		{ 0, 1, 0, 2 },
+	};
+	const char **name = names[c->axis];
+	const int *prec = precision[c->axis];
+	struct compare_track *t;
+	struct tm tm;
+	char date[32];
+	size_t i, k, n;
+	int f;
+
+	sink_puts(out, "# Compared workouts:\n");
+	for (i = 0; i < c->ntracks; i++) {
+		t = &c->tracks[i];
+		sink_printf(out, "#   %zu: %s", i + 1, t->name);
+		if (t->start != 0) {
+			strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S",
+					 localtime_r(&t->start, &tm));
+			sink_printf(out, "  %s", date);
+		}
+		if (t->n == 0)
+			sink_puts(out, "  not usable\n");
+		else if (c->ref == i + 1)
+			sink_puts(out, "  reference\n");
+		else
+			sink_puts(out, "\n");
+	}
+	sink_puts(out, "#\n");
+
+	sink_puts(out, c->axis == COMPARE_DISTANCE ? "#   Dist" : "#   Time");
+	for (i = 0; i < c->ntracks; i++) {
+		t = &c->tracks[i];
+		if (t->n == 0)
+			continue;
+		for (f = 0; f < COMPARE_NFIELDS; f++)
+			sink_printf(out, "\t%s%zu", name[f], i + 1);
+		if (t->d[0] != NULL && c->ref != 0) {
+			for (f = 0; f < COMPARE_NFIELDS; f++)
+				sink_printf(out, "\td%s%zu", name[f], i + 1);
+		}
+	}
+	sink_puts(out, "\n");
+
+	n = compare_points(c);
+	for (k = 0; k < n; k++) {
+		if (c->axis == COMPARE_DISTANCE)
+			sink_printf(out, "%.2f", k * c->step);
+		else
+			sink_printf(out, "%.0f", k * c->step);
+		for (i = 0; i < c->ntracks; i++) {
+			t = &c->tracks[i];
+			if (t->n == 0)
+				continue;
+			for (f = 0; f < COMPARE_NFIELDS; f++)
+				compare_put(out, k < t->n ? t->v[f][k] : NAN, prec[f]);
+			if (t->d[0] != NULL && c->ref != 0) {
+				for (f = 0; f < COMPARE_NFIELDS; f++)
+					compare_put(out, k < t->n ? t->d[f][k] : NAN, prec[f]);
+			}
+		}
+		sink_puts(out, "\n");
+	}
+}
+
+void
+compare_free(COMPARE *c)
+{
+	size_t i;
+
+	for (i = 0; i < c->ntracks; i++) {
+		free(c->tracks[i].name);
+		if (c->tracks[i].v[0] != NULL)
+			xfree(c->tracks[i].v[0]);
+		if (c->tracks[i].d[0] != NULL)
+			xfree(c->tracks[i].d[0]);
+	}
+	xfree(c->tracks);
+	xfree(c);
+}
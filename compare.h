@@ -0,0 +1,65 @@
+/* compare.h - align workouts of the same route and compare them */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "sink.h"
+#include "workout.h"
+
+#define COMPARE_DISTANCE	0		/* grid in km, or miles */
+#define COMPARE_TIME		1		/* grid in seconds */
+
+/* the values of a track, see struct compare_track */
+enum {
+	COMPARE_HR,
+	COMPARE_SPEED,
+	COMPARE_ALT,
+	COMPARE_OTHER,					/* time on a distance grid and vice versa */
+	COMPARE_NFIELDS
+};
+
+/*
+ * One workout resampled onto the grid. Values are NAN where the
+ * workout has no data. The deltas to the reference are only set by
+ * compare_deltas().
+ */
+struct compare_track {
+	char		*name;
+	time_t		 start;
+	size_t		 n;					/* grid points covered, 0 if unusable */
+	float		*v[COMPARE_NFIELDS];
+	float		*d[COMPARE_NFIELDS];	/* value minus reference value */
+};
+
+typedef struct compare COMPARE;
+
+COMPARE	*compare_new(int axis, double step, size_t ntracks);
+int		 compare_add(COMPARE *c, size_t i, const char *name, workout_t *w);
+void	 compare_deltas(COMPARE *c, size_t ref);
+size_t	 compare_points(COMPARE *c);
+const struct compare_track *compare_track(COMPARE *c, size_t i);
+void	 compare_print(COMPARE *c, SINK *out);
+void	 compare_free(COMPARE *c);
+
+#endif	/* COMPARE_H */
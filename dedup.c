@@ -0,0 +1,162 @@
+/* dedup.c - index of workouts that have already been saved */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The index is a text file with one line per saved workout:
+ *
+ *   <unixtime> <fnv1a hash of the workout data> <format>
+ *
+ * It is read into a hash table on open and new entries are appended
+ * as workouts are saved.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedup.h"
+#include "format.h"
+#include "log.h"
+#include "xmalloc.h"
+
+#define DEDUP_MIN_SLOTS	64
+
+struct dedup_entry {
+	time_t		 t;
+	uint64_t	 hash;
+	int			 format;
+	int			 used;
+};
+
+struct dedup {
+	FILE				*fp;
+	struct dedup_entry	*slots;
+	size_t				 nslots;
+	size_t				 nused;
+};
+
+static void dedup_insert(DEDUP *d, time_t t, uint64_t hash, int format);
+static struct dedup_entry *dedup_find(DEDUP *d, time_t t, uint64_t hash, int format);
+
+DEDUP *
+dedup_open(const char *path)
+{
+	DEDUP *d;
+	long long t;
+	uint64_t hash;
+	char format[16];
+
+	d = xcalloc(1, sizeof(*d));
+	d->nslots = DEDUP_MIN_SLOTS;
+	d->slots = xcalloc(d->nslots, sizeof(*d->slots));
+
+	if ((d->fp = fopen(path, "a+")) == NULL) {
+		log_error("%s: %s", path, strerror(errno));
+		xfree(d->slots);
+		xfree(d);
+		return NULL;
+	}
+
+	rewind(d->fp);
+	while (fscanf(d->fp, "%lld %" SCNx64 " %15s", &t, &hash, format) == 3)
+		dedup_insert(d, (time_t)t, hash, format_from_str(format));
+
+	log_info("dedup_open: %zu entries", d->nused);
+
+	return d;
+}
+
+/*
+ * Returns 1 if this workout has been saved in <format> before.
+ */
+int
+dedup_lookup(DEDUP *d, time_t t, uint64_t hash, int format)
+{
+	return dedup_find(d, t, hash, format)->used;
+}
+
+void
+dedup_add(DEDUP *d, time_t t, uint64_t hash, int format)
+{
+	if (dedup_lookup(d, t, hash, format))
+		return;
+
+	dedup_insert(d, t, hash, format);
+	fprintf(d->fp, "%lld %016" PRIx64 " %s\n",
+			(long long)t, hash, format_to_str(format));
+	fflush(d->fp);
+}
+
+void
+dedup_close(DEDUP *d)
+{
+	fclose(d->fp);
+	xfree(d->slots);
+	xfree(d);
+}
+
+static struct dedup_entry *
+dedup_find(DEDUP *d, time_t t, uint64_t hash, int format)
+{
+	struct dedup_entry *e;
+	size_t i;
+
+	/* open addressing with linear probing, nslots is a power of 2 */
+	i = (hash ^ (uint64_t)t ^ (uint64_t)format) & (d->nslots - 1);
+	for (;;) {
+		e = &d->slots[i];
+		if (!e->used ||
+			(e->t == t && e->hash == hash && e->format == format))
+			return e;
+		i = (i + 1) & (d->nslots - 1);
+	}
+}
+
+static void
+dedup_insert(DEDUP *d, time_t t, uint64_t hash, int format)
+{
+	struct dedup_entry *old;
+	struct dedup_entry *e;
+	size_t n;
+	size_t i;
+
+	/* keep the table at most half full */
+	if (2 * (d->nused + 1) > d->nslots) {
+		old = d->slots;
+		n = d->nslots;
+		d->nslots *= 2;
+		d->slots = xcalloc(d->nslots, sizeof(*d->slots));
+		for (i = 0; i < n; i++)
+			if (old[i].used)
+				*dedup_find(d, old[i].t, old[i].hash, old[i].format) = old[i];
+		xfree(old);
+	}
+
+	e = dedup_find(d, t, hash, format);
+	if (!e->used) {
+		e->t = t;
+		e->hash = hash;
+		e->format = format;
+		e->used = 1;
+		d->nused++;
+	}
+}
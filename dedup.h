@@ -0,0 +1,36 @@
+/* dedup.h - index of workouts that have already been saved */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define DEDUP_NAME ".s725get.index"
+
+typedef struct dedup DEDUP;
+
+DEDUP	*dedup_open(const char *path);
+int		 dedup_lookup(DEDUP *d, time_t t, uint64_t hash, int format);
+void	 dedup_add(DEDUP *d, time_t t, uint64_t hash, int format);
+void	 dedup_close(DEDUP *d);
+
+#endif	/* DEDUP_H */
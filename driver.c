@@ -26,22 +26,24 @@
 
 #include "driver.h"
 #include "driver_int.h"
+#include "stats.h"
 
 extern struct s725_driver_ops serial_driver_ops;
+extern struct s725_driver_ops replay_driver_ops;
 
-static struct s725_driver *driver;
-
-int
+/*
+ * Allocate a driver instance for <device>. Each instance is
+ * independent, so several devices can be used at the same time.
+ */
+struct s725_driver *
 driver_init(const int driver_type, const char *device)
 {
-	if (driver)
-		return 0;
+	struct s725_driver *driver;
 
-	driver = malloc(sizeof(struct s725_driver));
+	driver = calloc(1, sizeof(struct s725_driver));
 	if (!driver)
-		return 0;
-
-	bzero(driver, sizeof(struct s725_driver));
+		return NULL;
+	stats_add(STATS_ALLOCS, 1);
 
 	switch (driver_type) {
 	case DRIVER_SERIAL:
@@ -49,78 +51,175 @@ driver_init(const int driver_type, const char *device)
 			driver->dops = &serial_driver_ops;
 			strncpy(driver->path, device, sizeof(driver->path)-1);
 			driver->uses_frames = 1;
-			return 1;
+			return driver;
+		}
+		break;
+	case DRIVER_REPLAY:
+		if (device != NULL) {
+			driver->dops = &replay_driver_ops;
+			strncpy(driver->path, device, sizeof(driver->path)-1);
+			driver->uses_frames = 1;
+			return driver;
 		}
 		break;
 	}
 
 	free(driver);
-	driver = NULL;
-	return 0;
+	return NULL;
 }
 
 int
-driver_write(BUF *buf)
+driver_write(struct s725_driver *driver, BUF *buf)
 {
+	uint64_t t = stats_begin();
+	int ret = -1;
+
+	if (driver->capture)
+		capture_tx(driver->capture, buf_get(buf), buf_len(buf));
+
 	if (driver->dops->write)
-		return driver->dops->write(driver, buf);
-	else
-		return -1;
+		ret = driver->dops->write(driver, buf);
+
+	stats_add(STATS_BYTES_SENT, buf_len(buf));
+	stats_end(STATS_DRIVER_WRITE, t);
+	return ret;
 }
 
 int
-driver_read(BUF *buf)
+driver_read(struct s725_driver *driver, BUF *buf)
 {
+	uint64_t t = stats_begin();
+	size_t len = buf_len(buf);
+	int ret = 0;
+
 	if (driver->dops->read)
-		return driver->dops->read(driver, buf);
-	else
-		return 0;
+		ret = driver->dops->read(driver, buf);
+
+	if (ret > 0)
+		stats_add(STATS_BYTES_RECEIVED, buf_len(buf) - len);
+	stats_end(STATS_DRIVER_READ, t);
+
+	if (driver->capture) {
+		if (ret > 0)
+			capture_rx(driver->capture, buf_get(buf) + len, buf_len(buf) - len);
+		capture_flush(driver->capture);
+	}
+
+	return ret;
 }
 
 int
-driver_read_byte(unsigned char *b)
+driver_read_byte(struct s725_driver *driver, unsigned char *b)
 {
+	uint64_t t = stats_begin();
+	int ret = 0;
+
 	if (driver->dops->read_byte)
-		return driver->dops->read_byte(driver, b);
-	else
-		return 0;
+		ret = driver->dops->read_byte(driver, b);
+
+	if (ret > 0)
+		stats_add(STATS_BYTES_RECEIVED, 1);
+	stats_end(STATS_DRIVER_READ, t);
+
+	/* a timeout ends the current run of received bytes */
+	if (driver->capture) {
+		if (ret > 0)
+			capture_rx(driver->capture, b, 1);
+		else
+			capture_flush(driver->capture);
+	}
+
+	return ret;
 }
 
 int
-driver_open(void)
+driver_open(struct s725_driver *driver)
 {
+	uint64_t t = stats_begin();
 	int ret = -1;
 
 	if (driver->dops->init)
 		ret = driver->dops->init(driver);
 
+	stats_end(STATS_DRIVER_OPEN, t);
 	return ret;
 }
 
+/*
+ * Close and reinitialize the device without releasing the driver,
+ * used to start over after a transmission error.
+ */
 int
-driver_close(void)
+driver_reopen(struct s725_driver *driver)
 {
-	int ret = 0;
+	if (driver->dops->reopen)
+		return driver->dops->reopen(driver);
 
 	if (driver->dops->close)
+		driver->dops->close(driver);
+
+	return driver_open(driver);
+}
+
+/*
+ * Close the device and release the driver instance.
+ */
+int
+driver_close(struct s725_driver *driver)
+{
+	uint64_t t = stats_begin();
+	int ret = 0;
+
+	if (driver->dops->close && driver->data)
 		ret = driver->dops->close(driver);
 
 	free(driver);
-	driver = NULL;
+	stats_end(STATS_DRIVER_CLOSE, t);
 	return ret;
 }
 
 int
-driver_uses_frames(void)
+driver_uses_frames(struct s725_driver *driver)
 {
 	return driver->uses_frames;
 }
 
+const char *
+driver_path(struct s725_driver *driver)
+{
+	return driver->path;
+}
+
+/*
+ * Record all data written and received in <c>. The capture is not
+ * owned by the driver and must be closed after driver_close().
+ */
+void
+driver_set_capture(struct s725_driver *driver, CAPTURE *c)
+{
+	driver->capture = c;
+}
+
+/* Report requests without a response only at log level info. */
+void
+driver_set_quiet(struct s725_driver *driver, int quiet)
+{
+	driver->quiet = quiet;
+}
+
+int
+driver_quiet(struct s725_driver *driver)
+{
+	return driver->quiet;
+}
+
 int
 driver_name_to_type(const char *driver_name)
 {
 	if (!strcmp(driver_name, "serial")) {
 		return DRIVER_SERIAL;
+	} else if (!strcmp(driver_name, "replay")) {
+		return DRIVER_REPLAY;
 	} else {
 		return DRIVER_UNKNOWN;
 	}
@@ -133,6 +232,9 @@ driver_type_to_name(int driver_type)
 	case DRIVER_SERIAL:
 		return "serial";
 		break;
+	case DRIVER_REPLAY:
+		return "replay";
+		break;
 	default:
 		return "unknown";
 	}
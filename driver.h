@@ -22,19 +22,28 @@
 #define DRIVER_H
 
 #include "buf.h"
+#include "capture.h"
 
 enum {
 	DRIVER_UNKNOWN = 0,
 	DRIVER_SERIAL,
+	DRIVER_REPLAY,
 };
 
-int driver_init(int driver_type, const char *device);
-int driver_open(void);
-int driver_write(BUF *buf);
-int driver_read(BUF *buf);
-int driver_read_byte(unsigned char *b);
-int driver_close(void);
-int driver_uses_frames(void);
+struct s725_driver;
+
+struct s725_driver *driver_init(int driver_type, const char *device);
+int driver_open(struct s725_driver *d);
+int driver_reopen(struct s725_driver *d);
+int driver_write(struct s725_driver *d, BUF *buf);
+int driver_read(struct s725_driver *d, BUF *buf);
+int driver_read_byte(struct s725_driver *d, unsigned char *b);
+int driver_close(struct s725_driver *d);
+int driver_uses_frames(struct s725_driver *d);
+const char *driver_path(struct s725_driver *d);
+void driver_set_capture(struct s725_driver *d, CAPTURE *c);
+void driver_set_quiet(struct s725_driver *d, int quiet);
+int driver_quiet(struct s725_driver *d);
 int driver_name_to_type(const char *driver_name);
 const char* driver_type_to_name(int driver_type);
 
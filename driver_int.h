@@ -24,6 +24,7 @@
 #include <limits.h>
 
 #include "buf.h"
+#include "capture.h"
 
 struct s725_driver_ops;
 
@@ -32,6 +33,8 @@ struct s725_driver {
 	void *data;
 	int uses_frames;
 	char path[PATH_MAX];
+	CAPTURE *capture;
+	int quiet;
 };
 
 struct s725_driver_ops {
@@ -40,6 +43,7 @@ struct s725_driver_ops {
 	int (*read_byte) (struct s725_driver* d, unsigned char *byte);
 	int (*write)     (struct s725_driver* d, BUF *buf);
 	int (*close)     (struct s725_driver* d);
+	int (*reopen)    (struct s725_driver* d);	/* optional */
 };
 
 #endif	/* DRIVER_H */
@@ -32,21 +32,34 @@
 #include <unistd.h>
 
 #include "buf.h"
+#include "driver.h"
 #include "files.h"
 #include "log.h"
 #include "packet.h"
+#include "stats.h"
 
-static int files_transfer(BUF *files, int packet_type);
+static int files_transfer(struct files_xfer *x, int packet_type);
+static int files_same_start(BUF *files, packet_t *p);
 
 /*
  * Send read request and receive training data. Each packet contains
  * the number of remaining packets.  To proceed with transfer, a
  * continue request has to be sent.
+ *
+ * A failed packet (CRC error or timeout) can not be requested again.
+ * Up to x->retries times the device is reopened and the transfer is
+ * restarted from the beginning, skipping the data that has already
+ * been received.
  */
 int
-files_get(BUF *files)
+files_get(struct files_xfer *x)
 {
-	return files_transfer(files, S725_GET_FILES);
+	uint64_t t = stats_begin();
+	int ret;
+
+	ret = files_transfer(x, S725_GET_FILES);
+	stats_end(STATS_FILES_TRANSFER, t);
+	return ret;
 }
 
 /*
@@ -54,9 +67,14 @@ files_get(BUF *files)
  * initiated from the watch
  */
 int
-files_listen(BUF *files)
+files_listen(struct files_xfer *x)
 {
-	return files_transfer(files, S725_LISTEN);
+	uint64_t t = stats_begin();
+	int ret;
+
+	ret = files_transfer(x, S725_LISTEN);
+	stats_end(STATS_FILES_TRANSFER, t);
+	return ret;
 }
 
 int
@@ -67,6 +85,9 @@ files_split(BUF *files, int *offset, BUF *out)
 
 	if (*offset < buf_len(files) - 2) {
 		size = (buf_getc(files, *offset + 1) << 8) + buf_getc(files, *offset);
+		/* stop at a truncated workout, e.g. from an aborted transfer */
+		if (size < 2 || *offset + size > buf_len(files))
+			return 0;
 		buf_empty(out);
 		bp = buf_get(files);
 		buf_append(out, &bp[*offset], size);
@@ -101,25 +122,55 @@ files_timestamp (BUF *f, size_t offset)
 	return ft;
 }
 
+/*
+ * Receive packets into x->files. Data that is already in x->files,
+ * from an earlier attempt or loaded from a checkpoint, is not
+ * appended again. If set, x->received is called after each packet.
+ */
 static int
-files_transfer(BUF *files, int packet_type)
+files_transfer(struct files_xfer *x, int packet_type)
 {
 	packet_t *p;
+	BUF *files = x->files;
 	int p_remaining = 1;
 	int p_first = 0;
-	unsigned short p_bytes = 0;
+	int p_seen = 0;
+	int retries = x->retries;
+	unsigned short bytes;
 	unsigned int start;
+	size_t received = 0;
+	size_t len;
+	size_t skip;
 
-	buf_empty(files);
+	if (buf_len(files) == 0) {
+		x->p_bytes = 0;
+		x->p_count = 0;
+	}
 
-	log_write("Reading ");
-	log_prep_hash_marks();
-	log_print_hash_marks(0, 0);
+	if (!x->quiet) {
+		log_write("Reading ");
+		log_prep_hash_marks();
+		log_print_hash_marks(0, 0);
+	}
 
 	while (p_remaining) {
-		p = packet_get_response(packet_type);
+		p = packet_get_response(x->driver, packet_type);
 		if (p == NULL) {
-			log_write("[error]\n");
+			if (packet_type != S725_LISTEN && retries-- > 0 &&
+				driver_reopen(x->driver) >= 0) {
+				/*
+				 * Start over and skip what has already been
+				 * received and validated.
+				 */
+				stats_add(STATS_RETRIES, 1);
+				log_info("files_transfer: restarting transfer at %zu bytes",
+						 buf_len(files));
+				packet_type = S725_GET_FILES;
+				received = 0;
+				continue;
+			}
+			if (!x->quiet)
+				log_write("[error]\n");
 			return 0;
 		}
 		/* Bit 8: first packet, Bit 7-1: packets remaining */
@@ -127,7 +178,27 @@ files_transfer(BUF *files, int packet_type)
 		p_remaining = packet_data(p)[0] & 0x7f;
 		if (p_first) {
 			/* Byte 1 and 2 of first packet: total size in bytes */
-			p_bytes = (packet_data(p)[1] << 8) + packet_data(p)[2];
+			bytes = (packet_data(p)[1] << 8) + packet_data(p)[2];
+			if (buf_len(files) > 0 &&
+				(bytes != x->p_bytes || !files_same_start(files, p))) {
+				if (p_seen) {
+					log_info("files_transfer: data changed on restart (%hu, was %hu bytes)",
+							 bytes, x->p_bytes);
+					if (!x->quiet)
+						log_write("[error]\n");
+					free(p);
+					return 0;
+				}
+				/* data from a checkpoint is stale, start from scratch */
+				log_info("files_transfer: discarding %zu bytes of old data",
+						 buf_len(files));
+				buf_empty(files);
+				x->p_count = 0;
+			}
+			if (buf_len(files) == 0 && x->checkpoint)
+				checkpoint_start(x->checkpoint, bytes);
+			x->p_bytes = bytes;
+			p_seen = 1;
 			/* Byte 3 and 4 of first packet: magic bytes */
 			start = 5;
 		} else {
@@ -135,11 +206,24 @@ files_transfer(BUF *files, int packet_type)
 		}
 
 		unsigned char *pd = packet_data(p);
-		int len = packet_len(p);
-		buf_append(files, &pd[start], len - start);
+		len = packet_len(p) > start ? packet_len(p) - start : 0;
+
+		/* only append data beyond what an earlier attempt delivered */
+		if (received + len > buf_len(files)) {
+			skip = buf_len(files) > received ? buf_len(files) - received : 0;
+			buf_append(files, &pd[start + skip], len - skip);
+			if (x->checkpoint)
+				checkpoint_append(x->checkpoint, x->p_count,
+								  &pd[start + skip], len - skip);
+			x->p_count++;
+		}
+		received += len;
+
+		if (x->received)
+			x->received(files, x->arg);
 
-		if (p_bytes > 0)
-			log_print_hash_marks(buf_len(files) * 100 / p_bytes, p_bytes);
+		if (x->p_bytes > 0 && !x->quiet)
+			log_print_hash_marks(buf_len(files) * 100 / x->p_bytes, x->p_bytes);
 
 		if (packet_type == S725_GET_FILES)
 			packet_type = S725_CONTINUE_TRANSFER;
@@ -149,10 +233,27 @@ files_transfer(BUF *files, int packet_type)
 	}
 
 	if (p_remaining != 0) {
-		log_write("[error]\n");
+		if (!x->quiet)
+			log_write("[error]\n");
 		return 0;
 	}
 
-	log_write("\n");
+	if (!x->quiet)
+		log_write("\n");
 	return 1;
 }
+
+/*
+ * Returns 1 if the data of the first packet <p> is the start of
+ * <files>. The same size alone does not show that the watch sends the
+ * same files again.
+ */
+static int
+files_same_start(BUF *files, packet_t *p)
+{
+	size_t len = packet_len(p) > 5 ? packet_len(p) - 5 : 0;
+
+	if (len > buf_len(files))
+		len = buf_len(files);
+	return memcmp(packet_data(p) + 5, buf_get(files), len) == 0;
+}
@@ -23,9 +23,27 @@
 #define FILES_H
 
 #include "buf.h"
+#include "checkpoint.h"
 
-int files_get(BUF *files);
-int files_listen(BUF *files);
+/* number of restarts after a transmission error with -r */
+#define FILES_RETRIES 3
+
+struct s725_driver;
+
+struct files_xfer {
+	struct s725_driver *driver;		/* device to receive from */
+	BUF				*files;			/* received data */
+	unsigned short	 p_bytes;		/* total size announced by the watch */
+	int				 p_count;		/* number of packets received */
+	int				 retries;		/* restarts after transmission errors */
+	int				 quiet;			/* no progress output */
+	CHECKPOINT		*checkpoint;	/* optional on-disk copy of files */
+	void			(*received)(BUF *files, void *arg);
+	void			*arg;			/* argument for received */
+};
+
+int files_get(struct files_xfer *x);
+int files_listen(struct files_xfer *x);
 int files_split(BUF *files, int *offset, BUF *out);
 time_t files_timestamp(BUF *f, size_t offset);
 
@@ -35,6 +35,8 @@ format_from_str(const char *format)
 		return FORMAT_TCX;
 	} else if (!strcmp(format, "txt")) {
 		return FORMAT_TXT;
+	} else if (!strcmp(format, "dump")) {
+		return FORMAT_DUMP;
 	}
 	return FORMAT_UNKNOWN;
 }
@@ -55,6 +57,9 @@ format_to_str(int format)
 	case FORMAT_HRM:
 		return "hrm";
 		break;
+	case FORMAT_DUMP:
+		return "dump";
+		break;
 	}
 	return "unknown";
 }
@@ -27,6 +27,7 @@ enum {
 	FORMAT_SRD,
 	FORMAT_TCX,
 	FORMAT_TXT,
+	FORMAT_DUMP,
 };
 
 int format_from_str(const char *format);
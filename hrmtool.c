@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
@@ -30,26 +31,86 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "cache.h"
 #include "conf.h"
 #include "driver.h"
 #include "files.h"
 #include "format.h"
 #include "log.h"
 #include "misc.h"
+#include "sink.h"
 #include "workout.h"
 #include "workout_print.h"
 
 static void
 usage(void) {
 	printf("usage: hrmtool [options] [-i intype] [-s srdversion] [-o outtype] [-f infile] [-F outfile]\n");
+	printf("        -c cachefile   keep parsed workouts in cachefile and reuse them\n");
 	printf("        -i intype      input file type: srd\n");
 	printf("        -I variant     input variant: S610, S625, S725 (default: auto)\n");
 	printf("        -o outtype     output file type: hrm, tcx, txt\n");
-	printf("        -f infile      input file name\n");
-	printf("        -F outfile     output file name\n");
+	printf("        -f infile      input file name, - for stdin\n");
+	printf("        -F outfile     output file name, - for stdout\n");
 	printf("        -v             verbose output\n");
 }
 
+/*
+ * Read the next workout from <fd> into <in>, and return its offset
+ * and size. Every workout starts with its size in two bytes, little
+ * endian, so a stream of them like the data from files_get() can be
+ * split without knowing the model. A workout is returned as soon as
+ * it is complete, the rest of the stream may not have been written
+ * yet. Returns 1 for a workout, 0 at the end of the stream and -1 on
+ * errors.
+ */
+static int
+read_workout(int fd, const char *name, BUF *in, size_t *off, size_t *size)
+{
+	u_char chunk[SINK_BUFSIZ];
+	size_t avail;
+	ssize_t n;
+
+	/* drop the workout returned last time */
+	*off += *size;
+	*size = 0;
+
+	for (;;) {
+		avail = buf_len(in) - *off;
+		if (avail >= 2) {
+			*size = buf_getc(in, *off) | (buf_getc(in, *off + 1) << 8);
+			if (*size < 2) {
+				log_error("%s: invalid workout size %zu", name, *size);
+				return -1;
+			}
+			if (*size <= avail)
+				return 1;
+			*size = 0;
+		}
+
+		/* keep the start of the next workout at the front */
+		if (*off > 0) {
+			memmove(buf_get(in), buf_get(in) + *off, avail);
+			buf_set_len(in, avail);
+			*off = 0;
+		}
+
+		if ((n = read(fd, chunk, sizeof(chunk))) == -1) {
+			if (errno == EINTR)
+				continue;
+			log_error("%s: %s", name, strerror(errno));
+			return -1;
+		}
+		if (n == 0) {
+			if (avail > 0) {
+				log_error("%s: truncated workout", name);
+				return -1;
+			}
+			return 0;
+		}
+		buf_append(in, chunk, n);
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -58,12 +119,26 @@ main(int argc, char **argv)
 	char *opt_output_file = NULL;
 	char *opt_input_type = NULL;
 	char *opt_output_type = NULL;
+	char *opt_cache_file = NULL;
 	int ch;
+	workout_arena_t *arena;
 	workout_t *w;
-	FILE *f;
+	workout_t *pending = NULL;
+	SINK *out = NULL;
+	CACHE *cache = NULL;
+	BUF *in, *buf;
+	size_t off = 0, size = 0;
+	int infd, outfd = -1;
+	int count = 0;
+	int converted = 0;
+	int ret = 0;
+	int n;
 
-	while ((ch = getopt(argc, argv, "i:I:o:f:F:vh")) != -1) {
+	while ((ch = getopt(argc, argv, "c:i:I:o:f:F:vh")) != -1) {
 		switch (ch) {
+		case 'c':
+			opt_cache_file = optarg;
+			break;
 		case 'i':
 			opt_input_type = optarg;
 			break;
@@ -129,23 +204,102 @@ main(int argc, char **argv)
 		return 1;
 	}
 
-	w = workout_read(opt_input_file, input_variant);
-	if (w != NULL) {
-		f = fopen(opt_output_file, "w");
-		if (f) {
-			if (output_type == FORMAT_TCX) {
-				workout_print_tcx(w, f);
-			} else if (output_type == FORMAT_TXT) {
-				workout_print_txt(w, f, S725_WORKOUT_FULL);
-			} else if (output_type == FORMAT_HRM) {
-				workout_print_hrm(w, f);
-			}
-			fclose(f);
+	if (!strcmp(opt_input_file, "-")) {
+		infd = STDIN_FILENO;
+		opt_input_file = "stdin";
+	} else if ((infd = open(opt_input_file, O_RDONLY)) == -1) {
+		fatal("%s", opt_input_file);
+	}
+
+	if (opt_cache_file != NULL) {
+		if ((cache = cache_open(opt_cache_file)) == NULL)
+			fatalx("%s: cannot open cache", opt_cache_file);
+		workout_set_cache(cache);
+	}
+
+	/*
+	 * The input can hold any number of workouts, all are converted.
+	 * Several workouts go into one TCX document with an Activity for
+	 * each. A single workout is written as before, so the first one
+	 * is held back until it is known whether another one follows.
+	 * HRM files hold a single workout.
+	 */
+	in = buf_alloc(0);
+	if ((arena = workout_arena_new()) == NULL)
+		fatalx("workout_arena_new failed");
+	while ((n = read_workout(infd, opt_input_file, in, &off, &size)) == 1) {
+		count++;
+		/* before the next parse reuses the arena */
+		if (pending != NULL) {
+			workout_print_tcx_begin(out);
+			workout_print_tcx_activity(pending, out);
+			pending = NULL;
+		}
+		if ((buf = buf_wrap(buf_get(in) + off, size)) == NULL)
+			fatalx("out of memory");
+		w = workout_read_buf_arena(buf, input_variant, S725_WORKOUT_FULL, arena);
+		buf_free(buf);
+		if (w == NULL) {
+			log_error("%s: workout %d: invalid workout", opt_input_file, count);
+			ret = 1;
+			continue;
+		}
+
+		/* no output file unless there is something to write */
+		if (out == NULL) {
+			if (!strcmp(opt_output_file, "-"))
+				outfd = STDOUT_FILENO;
+			else if ((outfd = open(opt_output_file,
+								   O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+				fatal("%s", opt_output_file);
+			out = sink_fd(outfd);
 		}
-	} else {
+
+		if (output_type == FORMAT_HRM && converted > 0) {
+			log_error("%s: workout %d: hrm output holds a single workout",
+					  opt_input_file, count);
+			ret = 1;
+			break;
+		}
+
+		if (output_type == FORMAT_TCX) {
+			if (converted == 0)
+				pending = w;
+			else
+				workout_print_tcx_activity(w, out);
+		} else if (output_type == FORMAT_TXT) {
+			workout_print_txt(w, out, S725_WORKOUT_FULL);
+		} else if (output_type == FORMAT_HRM) {
+			workout_print_hrm(w, out);
+		}
+		converted++;
+		/* pass each workout on as soon as it is converted */
+		if (sink_flush(out) == -1)
+			fatal("%s", opt_output_file);
+	}
+	if (n == -1)
+		ret = 1;
+	if (pending != NULL)
+		workout_print_tcx(pending, out);
+	else if (output_type == FORMAT_TCX && converted > 0)
+		workout_print_tcx_end(out);
+	if (count == 0 && n == 0)
 		fatalx("%s: invalid file\n", opt_input_file);
+
+	if (out != NULL) {
+		if (sink_close(out) == -1)
+			fatal("%s", opt_output_file);
+		if (outfd != STDOUT_FILENO)
+			close(outfd);
+	}
+	if (infd != STDIN_FILENO)
+		close(infd);
+	workout_arena_free(arena);
+	buf_free(in);
+	if (cache != NULL) {
+		workout_set_cache(NULL);
+		cache_close(cache);
 	}
-	workout_free(w);
 
-	return 0;
+	return ret;
 }
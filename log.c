@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,13 +29,34 @@
 #include <unistd.h>
 
 #include "log.h"
+#include "xmalloc.h"
+
+/* the functions are defined here, callers use the macros from log.h */
+#undef log_info
+#undef log_debug
 
 static FILE *log_file;
-static int log_level;
+int log_level;
+
+/* set by log_set_fn(), replaces the log file and stderr */
+static int log_redirect;
+static log_fn log_func;
+static void *log_func_ctx;
+
+/* in-memory sink, keeps the most recent output */
+static struct {
+	char			*data;
+	size_t			 size;
+	size_t			 pos;
+	int				 wrapped;
+	pthread_mutex_t	 lock;
+} log_ring = { NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
 
 #define HASH_MARKS   40
+#define LOG_LINE_MAX 1024
 
 static void log_vwrite(int, const char *, va_list);
+static void log_ring_put(const char *, size_t);
 
 /* Increment log level. */
 void
@@ -63,10 +85,23 @@ log_open(const char *name)
 		log_file = fopen(name, "w");
 }
 
+/*
+ * Pass every message to <fn> instead of writing it, or drop them if
+ * <fn> is NULL. Messages are passed without the trailing newline.
+ */
+void
+log_set_fn(log_fn fn, void *ctx)
+{
+	log_func = fn;
+	log_func_ctx = ctx;
+	log_redirect = 1;
+}
+
 /* Close logging. */
 void
 log_close(void)
 {
+	log_ring_flush();
 	if (log_file != NULL)
 		fclose(log_file);
 	log_file = NULL;
@@ -77,12 +112,39 @@ log_close(void)
 static void
 log_vwrite(int newline, const char *msg, va_list ap)
 {
-	char *fmt;
+	char line[LOG_LINE_MAX];
+	char *fmt = line;
+	va_list aq;
+	int len;
 
-	if (vasprintf(&fmt, msg, ap) == -1)
+	/* messages are dropped, so do not format them */
+	if (log_redirect && log_func == NULL)
+		return;
+
+	/* format on the stack unless the message is very long */
+	va_copy(aq, ap);
+	len = vsnprintf(line, sizeof(line) - 1, msg, aq);
+	va_end(aq);
+	if (len < 0) {
+		if (log_redirect)
+			return;
 		exit(1);
+	}
+	if (len >= sizeof(line) - 1) {
+		if ((len = vasprintf(&fmt, msg, ap)) == -1) {
+			if (log_redirect)
+				return;
+			exit(1);
+		}
+	}
 
-	if (log_file != NULL) {
+	if (log_redirect) {
+		log_func(log_func_ctx, fmt);
+	} else if (log_ring.data != NULL) {
+		if (newline)
+			fmt[len++] = '\n';
+		log_ring_put(fmt, len);
+	} else if (log_file != NULL) {
 		if (fprintf(log_file, "%s%s", fmt, newline ? "\n" : "") == -1)
 			exit(1);
 		fflush(log_file);
@@ -91,39 +153,149 @@ log_vwrite(int newline, const char *msg, va_list ap)
 			exit(1);
 	}
 
-	free(fmt);
+	if (fmt != line)
+		free(fmt);
 }
 
-/* Write hexdump of a buffer */
+/* Keep log output in a preallocated ring until log_ring_flush(). */
 void
-log_hexdump(void *buf, size_t len)
+log_ring_open(size_t size)
 {
-	unsigned char b[16];
-	size_t i, j, l;
+	if (log_ring.data != NULL || size == 0)
+		return;
 
-	for (i = 0; i < len; i += l) {
-		log_write("%4zi:", i);
-		l = sizeof(b) < len - i ? sizeof(b) : len - i;
-		memcpy(b, (char *)buf + i, l);
-
-		for (j = 0; j < sizeof(b); j++) {
-			if (j % 2 == 0)
-				log_write(" ");
-			if (j % 8 == 0)
-				log_write(" ");
-			if (j < l)
-				log_write("%02x", (int)b[j]);
-			else
-				log_write("  ");
+	log_ring.data = xmalloc(size);
+	log_ring.size = size;
+	log_ring.pos = 0;
+	log_ring.wrapped = 0;
+	atexit(log_ring_flush);
+}
+
+/* Append to the ring, overwriting the oldest output. */
+static void
+log_ring_put(const char *s, size_t len)
+{
+	FILE *fp;
+	size_t n;
+
+	pthread_mutex_lock(&log_ring.lock);
+	/* the ring may have been flushed since the caller looked */
+	if (log_ring.data == NULL) {
+		pthread_mutex_unlock(&log_ring.lock);
+		fp = log_file ? log_file : stderr;
+		fwrite(s, 1, len, fp);
+		fflush(fp);
+		return;
+	}
+	if (len > log_ring.size) {
+		s += len - log_ring.size;
+		len = log_ring.size;
+	}
+	while (len > 0) {
+		n = log_ring.size - log_ring.pos;
+		if (n > len)
+			n = len;
+		memcpy(log_ring.data + log_ring.pos, s, n);
+		log_ring.pos += n;
+		if (log_ring.pos == log_ring.size) {
+			log_ring.pos = 0;
+			log_ring.wrapped = 1;
 		}
-		log_write("  |");
-		for (j = 0; j < l; j++) {
-			if (b[j] >= 0x20 && b[j] <= 0x7e)
-				log_write("%c", b[j]);
-			else
-				log_write(".");
+		s += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&log_ring.lock);
+}
+
+/* Write the ring contents to the log file or stderr and release it. */
+void
+log_ring_flush(void)
+{
+	FILE *fp = log_file ? log_file : stderr;
+	char *data;
+
+	pthread_mutex_lock(&log_ring.lock);
+	data = log_ring.data;
+	log_ring.data = NULL;
+	pthread_mutex_unlock(&log_ring.lock);
+
+	if (data == NULL)
+		return;
+
+	if (log_ring.wrapped)
+		fwrite(data + log_ring.pos, 1, log_ring.size - log_ring.pos, fp);
+	fwrite(data, 1, log_ring.pos, fp);
+	fflush(fp);
+	xfree(data);
+}
+
+/* Format one hexdump line of up to 16 bytes at <off>. */
+static void
+hexdump_line(char *line, size_t size, const u_char *b, size_t off, size_t l)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *p;
+	size_t j;
+	int n;
+
+	n = snprintf(line, size, "%4zi:", off);
+	if (n < 0 || n >= size - 64) {
+		line[0] = '\0';
+		return;
+	}
+	p = line + n;
+
+	for (j = 0; j < 16; j++) {
+		if (j % 2 == 0)
+			*p++ = ' ';
+		if (j % 8 == 0)
+			*p++ = ' ';
+		if (j < l) {
+			*p++ = hex[b[off + j] >> 4];
+			*p++ = hex[b[off + j] & 0x0f];
+		} else {
+			*p++ = ' ';
+			*p++ = ' ';
 		}
-		log_writeln("|");
+	}
+	*p++ = ' ';
+	*p++ = ' ';
+	*p++ = '|';
+	for (j = 0; j < l; j++) {
+		if (b[off + j] >= 0x20 && b[off + j] <= 0x7e)
+			*p++ = b[off + j];
+		else
+			*p++ = '.';
+	}
+	*p++ = '|';
+	*p = '\0';
+}
+
+/* Write hexdump of a buffer, one line per 16 bytes */
+void
+log_hexdump(void *buf, size_t len)
+{
+	char line[128];
+	size_t i, l;
+
+	for (i = 0; i < len; i += l) {
+		l = 16 < len - i ? 16 : len - i;
+		hexdump_line(line, sizeof(line), buf, i, l);
+		log_writeln("%s", line);
+	}
+}
+
+/* Write hexdump of a buffer to <fp> */
+void
+log_hexdump_file(FILE *fp, const void *buf, size_t len)
+{
+	char line[128];
+	size_t i, l;
+
+	for (i = 0; i < len; i += l) {
+		l = 16 < len - i ? 16 : len - i;
+		hexdump_line(line, sizeof(line), buf, i, l);
+		fprintf(fp, "%s\n", line);
 	}
 }
 
@@ -200,6 +372,7 @@ fatal(const char *msg, ...)
 	if (asprintf(&fmt, "fatal: %s: %s", msg, strerror(errno)) == -1)
 		exit(1);
 	log_vwrite(1, fmt, ap);
+	log_ring_flush();
 	exit(1);
 }
 
@@ -214,6 +387,7 @@ fatalx(const char *msg, ...)
 	if (asprintf(&fmt, "fatal: %s", msg) == -1)
 		exit(1);
 	log_vwrite(1, fmt, ap);
+	log_ring_flush();
 	exit(1);
 }
 
@@ -234,21 +408,22 @@ log_prep_hash_marks(void)
 void
 log_print_hash_marks(int pct, int bytes)
 {
+	char marks[HASH_MARKS + 1];
+	char back[HASH_MARKS + 25 + 1];
 	float here;
 	int i;
 
 	if (log_level != 0 || log_file != NULL)
 		return;
 
-	for (i = 0; i < HASH_MARKS+25; i++)
-		log_write("\b");
-	log_write("[%5d bytes] [", bytes);
+	memset(back, '\b', sizeof(back) - 1);
+	back[sizeof(back) - 1] = '\0';
 	for (i = 0; i < HASH_MARKS; i++) {
 		here = i * 100 / HASH_MARKS;
-		if (here < pct)
-			log_write("#");
-		else
-			log_write(" ");
+		marks[i] = here < pct ? '#' : ' ';
 	}
-	log_write("] [%5d%%]", pct);
+	marks[HASH_MARKS] = '\0';
+
+	/* one write, so other threads can not interleave with the bar */
+	log_write("%s[%5d bytes] [%s] [%5d%%]", back, bytes, marks, pct);
 }
@@ -18,17 +18,42 @@
  * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
+
+#define LOG_LEVEL_INFO		1
+#define LOG_LEVEL_DEBUG		2
+
+#define LOG_RING_SIZE		(1024 * 1024)
+
+extern int log_level;
+
+typedef void (*log_fn)(void *ctx, const char *msg);
+
 void log_add_level(void);
+void log_set_fn(log_fn, void *);
 int log_get_level(void);
 void log_open(const char *);
 void log_close(void);
+void log_ring_open(size_t);
+void log_ring_flush(void);
 void log_error(const char *, ...);
 void log_info(const char *, ...);
 void log_debug(const char *, ...);
 void log_write(const char *, ...);
 void log_writeln(const char *, ...);
 void log_hexdump(void *, size_t);
+void log_hexdump_file(FILE *, const void *, size_t);
 void __attribute__ ((format (printf, 1, 2))) fatal(const char *, ...);
 void __attribute__ ((format (printf, 1, 2))) fatalx(const char *, ...);
 void log_prep_hash_marks(void);
 void log_print_hash_marks(int pct, int bytes);
+
+/*
+ * Check the level before the arguments are evaluated, so disabled
+ * messages in the receive path cost no more than a compare.
+ */
+#define log_enabled(l)	(log_level >= (l))
+#define log_info(...)	do { if (log_enabled(LOG_LEVEL_INFO)) \
+			log_info(__VA_ARGS__); } while (0)
+#define log_debug(...)	do { if (log_enabled(LOG_LEVEL_DEBUG)) \
+			log_debug(__VA_ARGS__); } while (0)
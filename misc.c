@@ -23,10 +23,10 @@
 #include "log.h"
 #include "packet.h"
 
-int time_get(void) {
+int time_get(struct s725_driver *d) {
 	packet_t *p = NULL;
 
-	p = packet_get_response(S725_GET_WATCH);
+	p = packet_get_response(d, S725_GET_WATCH);
 	if (p == NULL) {
 		log_write("[error]\n");
 		return 0;
@@ -43,10 +43,10 @@ int time_get(void) {
 	return 0;
 }
 
-int user_get(void) {
+int user_get(struct s725_driver *d) {
 	packet_t *p = NULL;
 
-	p = packet_get_response(S725_GET_USER);
+	p = packet_get_response(d, S725_GET_USER);
 	if (p == NULL) {
 		log_write("[error]\n");
 		return 0;
@@ -19,7 +19,9 @@
 #ifndef MISC_H
 #define MISC_H
 
-int time_get(void);
-int user_get(void);
+struct s725_driver;
+
+int time_get(struct s725_driver *d);
+int user_get(struct s725_driver *d);
 
 #endif	/* MISC_H */
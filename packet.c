@@ -27,6 +27,7 @@
 #include "driver.h"
 #include "log.h"
 #include "packet.h"
+#include "stats.h"
 
 /* defines the packet types */
 typedef const char    *PacketName;
@@ -45,9 +46,6 @@ struct packet {
 	PacketData     data;
 };
 
-void packet_crc_process(unsigned short *context, unsigned char ch);
-void packet_crc_block(unsigned short *context, const unsigned char *blk, int len);
-
 static packet_t gPacket[] = {
 
 	/* packet name, subtype, payload length, checksum value, payload data */
@@ -187,6 +185,33 @@ packet_get_type(packet_t *p)
 	return p->type;
 }
 
+unsigned char
+packet_get_id(packet_t *p)
+{
+	return p->id;
+}
+
+/*
+ * Find the name of a request by its id and payload. Requests that
+ * share an id differ in the first data byte.
+ */
+const char *
+packet_request_name(unsigned char id, const unsigned char *data,
+					unsigned short len)
+{
+	int i;
+
+	for (i = 0; i < gNumPackets; i++) {
+		if (gPacket[i].id != id)
+			continue;
+		if (gPacket[i].length == 0 || len == 0 ||
+			gPacket[i].data[0] == data[0])
+			return gPacket[i].name;
+	}
+
+	return NULL;
+}
+
 /* return a packet pointer for a given packet index */
 packet_t *
 packet_get(S725_Packet_Index idx)
@@ -196,14 +221,14 @@ packet_get(S725_Packet_Index idx)
 
 /* get a single-packet response to a request */
 packet_t *
-packet_get_response(S725_Packet_Index request)
+packet_get_response(struct s725_driver *d, S725_Packet_Index request)
 {
 	packet_t *send = NULL;
 	packet_t *recv = NULL;
 
 	if (request == S725_LISTEN) {
 		while (1) {
-			recv = packet_recv();
+			recv = packet_recv(d);
 			if (recv)
 				return(recv);
 		}
@@ -211,14 +236,19 @@ packet_get_response(S725_Packet_Index request)
 
 	send = packet_get(request);
 
-	if (send != NULL && packet_send(send) > 0)
-		recv = packet_recv();
+	if (send != NULL && packet_send(d, send) > 0)
+		recv = packet_recv(d);
 	if (recv == NULL) {
 		if (send != NULL) {
 			if (request != S725_CONTINUE_TRANSFER &&
 				 request != S725_CLOSE_CONNECTION) {
-				log_write("\n%s: %s\n\n", send->name,
-						  (errno) ? strerror(errno) : "No response");
+				/* an idle port in daemon mode is no news */
+				if (driver_quiet(d))
+					log_info("packet_get_response: %s: %s", send->name,
+							 (errno) ? strerror(errno) : "No response");
+				else
+					log_write("\n%s: %s\n\n", send->name,
+							  (errno) ? strerror(errno) : "No response");
 			}
 		} else {
 			log_write("\n%d: bad packet index\n\n", request);
@@ -232,56 +262,67 @@ packet_get_response(S725_Packet_Index request)
 #define READ_TRIES   10
 
 /* static helper functions */
-static int packet_recv_short(unsigned short *s);
+static int packet_recv_short(struct s725_driver *d, unsigned short *s);
 static unsigned short packet_checksum(packet_t *p);
-static int packet_serialize(packet_t *p, BUF *buf);
+static int packet_serialize(packet_t *p, unsigned short checksum, BUF *buf);
 
 /*
  * send a packet via the S725 driver
  */
 int
-packet_send(packet_t *p)
+packet_send(struct s725_driver *d, packet_t *p)
 {
 	int  ret = 1;
 	BUF *buf;
 
+	/*
+	 * The checksum is not stored in the packet, request packets are
+	 * shared between all driver instances.
+	 */
 	buf = buf_alloc(0);
-	p->checksum = packet_checksum(p);
 
-	if (driver_uses_frames()) {
-		packet_serialize(p, buf);
+	if (driver_uses_frames(d)) {
+		packet_serialize(p, packet_checksum(p), buf);
 	} else {
 		buf_putc(buf, p->id);
 	}
-	ret = driver_write(buf);
+	ret = driver_write(d, buf);
 
 	buf_free(buf);
 
 	return ret != -1;
 }
 
-packet_t * packet_recv_noframes(void);
-packet_t * packet_recv_frames(void);
+packet_t * packet_recv_noframes(struct s725_driver *d);
+packet_t * packet_recv_frames(struct s725_driver *d);
 
 packet_t *
-packet_recv(void)
+packet_recv(struct s725_driver *d)
 {
-	if (driver_uses_frames()) {
-		return packet_recv_frames();
+	uint64_t t = stats_begin();
+	packet_t *p;
+
+	if (driver_uses_frames(d)) {
+		p = packet_recv_frames(d);
 	} else {
-		return packet_recv_noframes();
+		p = packet_recv_noframes(d);
 	}
+
+	if (p)
+		stats_add(STATS_PACKETS, 1);
+	stats_end(STATS_PACKET_RECV, t);
+	return p;
 }
 
 packet_t *
-packet_recv_noframes(void)
+packet_recv_noframes(struct s725_driver *d)
 {
 	BUF *buf = NULL;
 	packet_t *p = NULL;
 
 	buf = buf_alloc(1024);
 
-	if (driver_read(buf) <= 0) {
+	if (driver_read(d, buf) <= 0) {
 		log_info("packet_recv_noframes: driver_read returned no data");
 		goto error;
 	}
@@ -289,6 +330,7 @@ packet_recv_noframes(void)
 	p = calloc(1, sizeof(packet_t) + buf_len(buf));
 	if (!p)
 		goto error;
+	stats_add(STATS_ALLOCS, 1);
 
 	p->type   = S725_RESPONSE;
 	p->id     = buf_getc(buf, 0);
@@ -310,7 +352,7 @@ error:
  * receive a packet from the S725 driver (allocates memory)
  */
 packet_t *
-packet_recv_frames(void)
+packet_recv_frames(struct s725_driver *d)
 {
 	BUF *buf;
 	int r;
@@ -324,7 +366,7 @@ packet_recv_frames(void)
 
 	buf = buf_alloc(0);
 
-	r = driver_read_byte(&c);
+	r = driver_read_byte(d, &c);
 	if (r <= 0)
 		goto error;
 	packet_crc_process(&crc, c);
@@ -336,7 +378,7 @@ packet_recv_frames(void)
 		goto error;
 	}
 
-	r = driver_read_byte(&id);
+	r = driver_read_byte(d, &id);
 	if (r <= 0)
 		goto error;
 
@@ -344,14 +386,14 @@ packet_recv_frames(void)
 	log_info("packet_recv: subtype=%02hhx", id);
 	packet_crc_process(&crc, id);
 
-	r = driver_read_byte(&c);
+	r = driver_read_byte(d, &c);
 	if (r <= 0)
 		goto error;
 	packet_crc_process(&crc, c);
 	buf_putc(buf, c);
 	log_info("packet_recv: first=%02x remaining=%02x", c & 0x80, c & 0x7f);
 
-	r = packet_recv_short(&len);
+	r = packet_recv_short(d, &len);
 	if (r <= 0)
 		goto error;
 	log_info("packet_recv: len=%04hx (%hu)", len, len);
@@ -365,12 +407,13 @@ packet_recv_frames(void)
 	p = calloc(1, sizeof(packet_t) + siz);
 	if (!p)
 		goto error;
+	stats_add(STATS_ALLOCS, 1);
 
 	p->type   = S725_RESPONSE;
 	p->id     = id;
 	p->length = len;
 	for (i = 0; i < len; i++) {
-		r = driver_read_byte(&p->data[i]);
+		r = driver_read_byte(d, &p->data[i]);
 		packet_crc_process(&crc, p->data[i]);
 		buf_putc(buf, p->data[i]);
 		if (r <= 0) {
@@ -384,7 +427,7 @@ packet_recv_frames(void)
 	if (p == NULL)
 		goto error;
 
-	r = packet_recv_short(&p->checksum);
+	r = packet_recv_short(d, &p->checksum);
 	if (r <= 0) {
 		log_error("packet_recv: recv_short failed");
 		free(p);
@@ -403,11 +446,12 @@ packet_recv_frames(void)
 	if (crc != p->checksum) {
 		/* discard the whole transmission on crc mismatch,
 		   there is no way to retransmit a single packet   */
+		stats_add(STATS_CRC_ERRORS, 1);
 		log_error("packet_recv: CRC failed [id %d, length %d]",
 				  p->id, p->length );
 		log_info("packet_recv: reading remaining bytes");
 		while (1) {
-			r = driver_read_byte(&c);
+			r = driver_read_byte(d, &c);
 			if (r <= 0) {
 				log_error("packet_recv: driver_read_byte failed (recv_short)");
 				break;
@@ -433,16 +477,16 @@ error:
  * read a short from fd
  */
 static int
-packet_recv_short(unsigned short *s)
+packet_recv_short(struct s725_driver *d, unsigned short *s)
 {
 	int r = 0;
 	unsigned char u = 0;
 	unsigned char l = 0;
 
-	r = driver_read_byte(&u);
+	r = driver_read_byte(d, &u);
 	if (r <= 0)
 		return r;
-	r = driver_read_byte(&l);
+	r = driver_read_byte(d, &l);
 	if (r <= 0)
 		return r;
 	*s = (unsigned short)(u<<8)|l;
@@ -465,7 +509,7 @@ packet_checksum(packet_t *p)
 }
 
 static int
-packet_serialize(packet_t *p, BUF *buf)
+packet_serialize(packet_t *p, unsigned short checksum, BUF *buf)
 {
 	unsigned short l = p->length + 5;
 
@@ -476,8 +520,8 @@ packet_serialize(packet_t *p, BUF *buf)
 	buf_putc(buf, l & 0xff);
 	if (p->length > 0)
 		buf_append(buf, p->data, p->length);
-	buf_putc(buf, p->checksum >> 8);
-	buf_putc(buf, p->checksum & 0xff);
+	buf_putc(buf, checksum >> 8);
+	buf_putc(buf, checksum & 0xff);
 
 	return buf_len(buf);
 }
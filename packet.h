@@ -71,13 +71,18 @@ typedef enum {
 	S725_LISTEN = 255,
 } S725_Packet_Index;
 
-int       packet_send(packet_t *packet);
-packet_t *packet_recv(void);
+struct s725_driver;
+
+int       packet_send(struct s725_driver *d, packet_t *packet);
+packet_t *packet_recv(struct s725_driver *d);
 packet_t *packet_get(S725_Packet_Index idx);
-packet_t *packet_get_response(S725_Packet_Index request);
-packet_t *packet_listen(void);
+packet_t *packet_get_response(struct s725_driver *d, S725_Packet_Index request);
 u_char   *packet_data(packet_t *p);
 u_short   packet_len(packet_t *p);
 u_char    packet_get_type(packet_t *p);
+u_char    packet_get_id(packet_t *p);
+const char *packet_request_name(u_char id, const u_char *data, u_short len);
+void      packet_crc_process(unsigned short *context, unsigned char ch);
+void      packet_crc_block(unsigned short *context, const unsigned char *blk, int len);
 
 #endif	/* PACKET_H */
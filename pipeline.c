@@ -0,0 +1,155 @@
+/* pipeline.c - process workouts while the transfer is running */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Workouts in the files buffer are length prefixed, so each one can
+ * be handed off as soon as its last byte has arrived. The receiving
+ * thread copies complete workouts out of the files buffer and queues
+ * them, a worker thread parses and writes them. The worker never
+ * touches the files buffer, which may be reallocated while it grows.
+ */
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "buf.h"
+#include "files.h"
+#include "log.h"
+#include "pipeline.h"
+#include "xmalloc.h"
+
+struct pipeline_item {
+	TAILQ_ENTRY(pipeline_item) entry;
+	BUF		*workout;
+	int		 count;
+};
+
+struct pipeline {
+	TAILQ_HEAD(, pipeline_item) queue;
+	pthread_mutex_t	 lock;
+	pthread_cond_t	 cond;
+	pthread_t		 thread;
+	int				 done;
+	int				 offset;	/* end of the last queued workout */
+	int				 count;		/* number of queued workouts */
+	pipeline_fn		 fn;
+	void			*arg;
+};
+
+static void *pipeline_worker(void *arg);
+
+PIPELINE *
+pipeline_start(pipeline_fn fn, void *arg)
+{
+	PIPELINE *p;
+
+	p = xcalloc(1, sizeof(*p));
+	TAILQ_INIT(&p->queue);
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->fn = fn;
+	p->arg = arg;
+
+	if (pthread_create(&p->thread, NULL, pipeline_worker, p) != 0)
+		fatal("pthread_create");
+
+	return p;
+}
+
+/*
+ * Queue all workouts that have been received completely since the
+ * last call.
+ */
+void
+pipeline_feed(PIPELINE *p, BUF *files)
+{
+	struct pipeline_item *item;
+	BUF *buf;
+
+	/* the files buffer was restarted, e.g. after a stale checkpoint */
+	if (p->offset > buf_len(files))
+		p->offset = 0;
+
+	buf = buf_alloc(0);
+	while (files_split(files, &p->offset, buf)) {
+		item = xmalloc(sizeof(*item));
+		item->workout = buf;
+		item->count = ++p->count;
+		log_info("pipeline_feed: workout %d, %zu bytes",
+				 item->count, buf_len(buf));
+
+		pthread_mutex_lock(&p->lock);
+		TAILQ_INSERT_TAIL(&p->queue, item, entry);
+		pthread_cond_signal(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+
+		buf = buf_alloc(0);
+	}
+	buf_free(buf);
+}
+
+/*
+ * Queue what is left in <files>, if given, wait until the worker has
+ * processed everything and release the pipeline.
+ */
+void
+pipeline_finish(PIPELINE *p, BUF *files)
+{
+	if (files)
+		pipeline_feed(p, files);
+
+	pthread_mutex_lock(&p->lock);
+	p->done = 1;
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	pthread_join(p->thread, NULL);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	xfree(p);
+}
+
+static void *
+pipeline_worker(void *arg)
+{
+	PIPELINE *p = arg;
+	struct pipeline_item *item;
+
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (TAILQ_EMPTY(&p->queue) && !p->done)
+			pthread_cond_wait(&p->cond, &p->lock);
+		item = TAILQ_FIRST(&p->queue);
+		if (item != NULL)
+			TAILQ_REMOVE(&p->queue, item, entry);
+		pthread_mutex_unlock(&p->lock);
+
+		if (item == NULL)
+			break;
+
+		p->fn(item->workout, item->count, p->arg);
+		buf_free(item->workout);
+		xfree(item);
+	}
+
+	return NULL;
+}
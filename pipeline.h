@@ -0,0 +1,35 @@
+/* pipeline.h - process workouts while the transfer is running */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "buf.h"
+
+typedef struct pipeline PIPELINE;
+
+/* called on the worker thread for each complete workout */
+typedef void (*pipeline_fn)(BUF *workout, int count, void *arg);
+
+PIPELINE	*pipeline_start(pipeline_fn fn, void *arg);
+void		 pipeline_feed(PIPELINE *p, BUF *files);
+void		 pipeline_finish(PIPELINE *p, BUF *files);
+
+#endif	/* PIPELINE_H */
@@ -0,0 +1,457 @@
+/* plot.c - SVG charts of a workout */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Draws the charts of s725plot straight from the workout arrays:
+ * heart rate, speed and altitude over time, and the heart rate
+ * histogram. Size, colours, ticks and labels follow the matplotlib
+ * output of s725plot. Line charts keep at most the lowest and the
+ * highest sample of every pixel column, so the size of the SVG does
+ * not grow with the number of samples.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "plot.h"
+#include "workout_int.h"
+#include "workout_time.h"
+#include "xmalloc.h"
+
+#define PLOT_WIDTH		720		/* 8 x 5 inches at 90 dpi, like s725plot */
+#define PLOT_HEIGHT		450
+#define PLOT_LEFT		80		/* the area inside the axes */
+#define PLOT_RIGHT		700
+#define PLOT_TOP		45
+#define PLOT_BOTTOM		395
+
+#define PLOT_GRID		"#b0b0b0"
+#define PLOT_MARK		"#505050"
+
+struct plot {
+	SINK		*out;
+	double		 xmin;
+	double		 xmax;
+	double		 ymin;
+	double		 ymax;
+};
+
+static const char *plot_names[PLOT_NCHARTS] = {
+	"time-hr", "time-spd", "time-alt", "hist"
+};
+
+static double
+plot_x(struct plot *p, double x)
+{
+	return PLOT_LEFT + (x - p->xmin) / (p->xmax - p->xmin) *
+		(PLOT_RIGHT - PLOT_LEFT);
+}
+
+static double
+plot_y(struct plot *p, double y)
+{
+	return PLOT_BOTTOM - (y - p->ymin) / (p->ymax - p->ymin) *
+		(PLOT_BOTTOM - PLOT_TOP);
+}
+
+/*
+ * Returns 1, 2 or 5 times a power of ten, the smallest such step
+ * that gives at most <n> ticks over <range>.
+ */
+static double
+plot_step(double range, int n)
+{
+	static const double m[] = { 1, 2, 5 };
+	double step;
+	int i;
+
+	for (step = 0.001; ; step *= 10) {
+		for (i = 0; i < 3; i++)
+			if (range / (step * m[i]) <= n)
+				return step * m[i];
+	}
+}
+
+/* Returns the first multiple of <step> that is not below <v>. */
+static double
+plot_first(double v, double step)
+{
+	double t = (long)(v / step) * step;
+
+	return t < v ? t + step : t;
+}
+
+static void
+plot_begin(struct plot *p, const char *title)
+{
+	sink_puts(p->out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	sink_printf(p->out, "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+				"width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" "
+				"font-family=\"sans-serif\" font-size=\"12\">\n",
+				PLOT_WIDTH, PLOT_HEIGHT, PLOT_WIDTH, PLOT_HEIGHT);
+	sink_printf(p->out, "<rect width=\"%d\" height=\"%d\" fill=\"#ffffff\"/>\n",
+				PLOT_WIDTH, PLOT_HEIGHT);
+	sink_printf(p->out, "<clipPath id=\"area\"><rect x=\"%d\" y=\"%d\" "
+				"width=\"%d\" height=\"%d\"/></clipPath>\n", PLOT_LEFT, PLOT_TOP,
+				PLOT_RIGHT - PLOT_LEFT, PLOT_BOTTOM - PLOT_TOP);
+	sink_printf(p->out, "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\" "
+				"font-size=\"14\">%s</text>\n", (PLOT_LEFT + PLOT_RIGHT) / 2,
+				PLOT_TOP - 12, title);
+}
+
+static void
+plot_end(struct plot *p, const char *xlabel, const char *ylabel)
+{
+	sink_printf(p->out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
+				"fill=\"none\" stroke=\"#000000\"/>\n", PLOT_LEFT, PLOT_TOP,
+				PLOT_RIGHT - PLOT_LEFT, PLOT_BOTTOM - PLOT_TOP);
+	sink_printf(p->out, "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\">%s</text>\n",
+				(PLOT_LEFT + PLOT_RIGHT) / 2, PLOT_HEIGHT - 15, xlabel);
+	sink_printf(p->out, "<text transform=\"translate(%d,%d) rotate(-90)\" "
+				"text-anchor=\"middle\">%s</text>\n", 25,
+				(PLOT_TOP + PLOT_BOTTOM) / 2, ylabel);
+	sink_puts(p->out, "</svg>\n");
+}
+
+/* A grid line with its label at <x> on the x axis. */
+static void
+plot_xtick(struct plot *p, double x, const char *label)
+{
+	double px = plot_x(p, x);
+
+	sink_printf(p->out, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\" "
+				"stroke=\"%s\" stroke-width=\"0.8\"/>\n",
+				px, PLOT_TOP, px, PLOT_BOTTOM, PLOT_GRID);
+	sink_printf(p->out, "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">%s</text>\n",
+				px, PLOT_BOTTOM + 18, label);
+}
+
+static void
+plot_ytick(struct plot *p, double y, const char *label)
+{
+	double py = plot_y(p, y);
+
+	sink_printf(p->out, "<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\" "
+				"stroke=\"%s\" stroke-width=\"0.8\"/>\n",
+				PLOT_LEFT, py, PLOT_RIGHT, py, PLOT_GRID);
+	sink_printf(p->out, "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\">%s</text>\n",
+				PLOT_LEFT - 6, py + 4, label);
+}
+
+/* Grid lines every <step> from the first multiple above ymin. */
+static void
+plot_yticks(struct plot *p, double step)
+{
+	char label[32];
+	double y;
+
+	for (y = plot_first(p->ymin, step); y <= p->ymax; y += step) {
+		snprintf(label, sizeof(label), "%g", y);
+		plot_ytick(p, y, label);
+	}
+}
+
+/*
+ * Ticks on a time axis in seconds, every 10 minutes up to 1.5 hours,
+ * every 20 minutes up to 3 hours and every hour above.
+ */
+static void
+plot_time_ticks(struct plot *p, double span)
+{
+	char label[32];
+	double step;
+	double t;
+
+	if (span < 360)
+		return;
+	else if (span < 5400)
+		step = 600;
+	else if (span < 10800)
+		step = 1200;
+	else
+		step = 3600;
+
+	for (t = 0; t <= p->xmax; t += step) {
+		snprintf(label, sizeof(label), "%02d:%02d",
+				 (int)t / 3600, (int)t / 60 % 60);
+		plot_xtick(p, t, label);
+	}
+}
+
+static void
+plot_vline(struct plot *p, double x, const char *color)
+{
+	double px = plot_x(p, x);
+
+	sink_printf(p->out, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\" "
+				"stroke=\"%s\" stroke-dasharray=\"6,4\"/>\n",
+				px, PLOT_TOP, px, PLOT_BOTTOM, color);
+}
+
+static void
+plot_hline(struct plot *p, double y, const char *color)
+{
+	double py = plot_y(p, y);
+
+	sink_printf(p->out, "<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\" "
+				"stroke=\"%s\" stroke-dasharray=\"6,4\"/>\n",
+				PLOT_LEFT, py, PLOT_RIGHT, py, color);
+}
+
+static void
+plot_point(struct plot *p, double x, double y)
+{
+	sink_printf(p->out, "%.1f,%.1f ", plot_x(p, x), plot_y(p, y));
+}
+
+/*
+ * Draw <v>, one value every <dx> along the x axis. Of the samples
+ * that fall into one pixel column, only the lowest and the highest
+ * are drawn, in their order.
+ */
+static void
+plot_line(struct plot *p, const float *v, int n, double dx, const char *color)
+{
+	int imin, imax;
+	int col;
+	int i;
+
+	sink_printf(p->out, "<polyline fill=\"none\" stroke=\"%s\" "
+				"stroke-width=\"1\" clip-path=\"url(#area)\" points=\"", color);
+	imin = imax = 0;
+	col = plot_x(p, 0);
+	for (i = 1; i <= n; i++) {
+		if (i < n && (int)plot_x(p, i * dx) == col) {
+			if (v[i] < v[imin])
+				imin = i;
+			if (v[i] > v[imax])
+				imax = i;
+			continue;
+		}
+		if (imin < imax) {
+			plot_point(p, imin * dx, v[imin]);
+			plot_point(p, imax * dx, v[imax]);
+		} else if (imin > imax) {
+			plot_point(p, imax * dx, v[imax]);
+			plot_point(p, imin * dx, v[imin]);
+		} else {
+			plot_point(p, imin * dx, v[imin]);
+		}
+		if (i < n) {
+			imin = imax = i;
+			col = plot_x(p, i * dx);
+		}
+	}
+	sink_puts(p->out, "\"/>\n");
+}
+
+static void
+plot_time(struct plot *p, workout_t *w, int chart, const char *title)
+{
+	const char *color;
+	char ylabel[32];
+	char text[32];
+	double span, lo, hi, d, mean;
+	float *v;
+	int n = w->samples;
+	int ri = w->recording_interval;
+	int i;
+
+	v = xcalloc(n, sizeof(*v));
+	for (i = 0; i < n; i++) {
+		if (chart == PLOT_TIME_HR)
+			v[i] = w->hr_data[i];
+		else if (chart == PLOT_TIME_SPD)
+			v[i] = w->speed_data[i] / 16.0;
+		else
+			v[i] = w->alt_data[i];
+	}
+
+	span = (double)(n - 1) * ri;
+	if (span <= 0)
+		span = 1;
+	p->xmin = -0.03 * span;
+	p->xmax = 1.03 * span;
+
+	if (chart == PLOT_TIME_HR) {
+		p->ymin = 30;
+		p->ymax = 210;
+	} else {
+		lo = hi = v[0];
+		for (i = 1; i < n; i++) {
+			if (v[i] < lo)
+				lo = v[i];
+			if (v[i] > hi)
+				hi = v[i];
+		}
+		d = hi > lo ? hi - lo : 1;
+		d *= chart == PLOT_TIME_ALT ? 0.15 : 0.05;
+		p->ymin = lo - d;
+		p->ymax = hi + d;
+	}
+
+	plot_begin(p, title);
+	if (chart == PLOT_TIME_HR) {
+		for (i = 40; i <= 200; i += 20) {
+			snprintf(text, sizeof(text), "%d", i);
+			plot_ytick(p, i, text);
+		}
+	} else {
+		plot_yticks(p, plot_step(p->ymax - p->ymin, 8));
+	}
+	plot_time_ticks(p, span);
+
+	if (chart == PLOT_TIME_HR) {
+		color = "#700000";
+		snprintf(ylabel, sizeof(ylabel), "Heart Rate (bpm)");
+	} else if (chart == PLOT_TIME_SPD) {
+		color = "#000070";
+		snprintf(ylabel, sizeof(ylabel), "Speed (%s)",
+				 w->units.system == S725_UNITS_ENGLISH ? "mph" : "km/h");
+	} else {
+		color = "#007000";
+		snprintf(ylabel, sizeof(ylabel), "Altitude (%s)", w->units.altitude);
+	}
+	plot_line(p, v, n, ri, color);
+
+	if (chart == PLOT_TIME_HR) {
+		mean = 0;
+		for (i = 0; i < n; i++)
+			mean += v[i];
+		plot_hline(p, mean / n, PLOT_MARK);
+	}
+	for (i = 0; i < w->laps - 1; i++)
+		plot_vline(p, workout_time_to_tenths(&w->lap_data[i].cumulative) / 10,
+				   PLOT_MARK);
+	if (chart == PLOT_TIME_ALT)
+		sink_printf(p->out, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\" "
+					"font-size=\"14\" fill=\"%s\">Ascent: %d%s</text>\n",
+					PLOT_RIGHT - 8, PLOT_BOTTOM - 10, PLOT_MARK, w->ascent,
+					w->units.altitude);
+
+	plot_end(p, "Time (h)", ylabel);
+	xfree(v);
+}
+
+/* Minutes in 10 bpm bins from 35 to 205 bpm. */
+static void
+plot_hist(struct plot *p, workout_t *w, const char *title)
+{
+	double bins[17];
+	double minutes = w->recording_interval / 60.0;
+	double hi;
+	char text[32];
+	int i, b;
+
+	memset(bins, 0, sizeof(bins));
+	for (i = 0; i < w->samples; i++) {
+		b = (w->hr_data[i] - 35) / 10;
+		if (w->hr_data[i] >= 35 && b < 17)
+			bins[b] += minutes;
+	}
+	hi = 0;
+	for (b = 0; b < 17; b++)
+		if (bins[b] > hi)
+			hi = bins[b];
+
+	p->xmin = 30;
+	p->xmax = 210;
+	p->ymin = 0;
+	p->ymax = hi > 0 ? hi * 1.05 : 1;
+
+	plot_begin(p, title);
+	plot_yticks(p, plot_step(p->ymax, 8));
+	for (i = 40; i <= 200; i += 10) {
+		snprintf(text, sizeof(text), "%d", i);
+		plot_xtick(p, i, text);
+	}
+	for (b = 0; b < 17; b++) {
+		if (bins[b] == 0)
+			continue;
+		sink_printf(p->out, "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" "
+					"height=\"%.1f\" fill=\"#0000ff\" fill-opacity=\"0.5\"/>\n",
+					plot_x(p, 35 + b * 10), plot_y(p, bins[b]),
+					plot_x(p, 45) - plot_x(p, 35),
+					plot_y(p, 0) - plot_y(p, bins[b]));
+	}
+	plot_end(p, "Heart Rate (bpm)", "Histogram (minutes)");
+}
+
+/* The file name suffix s725plot uses for <chart>. */
+const char *
+plot_name(int chart)
+{
+	return plot_names[chart];
+}
+
+/* Returns 1 if <w> has data for <chart>, like s725plot decides. */
+int
+plot_available(workout_t *w, int chart)
+{
+	int max = 0;
+	int i;
+
+	if (!workout_load(w, S725_WORKOUT_FULL) || w->samples < 2)
+		return 0;
+	if (chart == PLOT_TIME_SPD && !S725_HAS_SPEED(w->mode))
+		return 0;
+	if (chart == PLOT_TIME_ALT && !S725_HAS_ALTITUDE(w->mode))
+		return 0;
+
+	for (i = 0; i < w->samples; i++) {
+		if (chart == PLOT_TIME_SPD && w->speed_data[i] > max)
+			max = w->speed_data[i];
+		else if (chart == PLOT_TIME_ALT && w->alt_data[i] > max)
+			max = w->alt_data[i];
+		else if ((chart == PLOT_TIME_HR || chart == PLOT_HIST) &&
+				 w->hr_data[i] > max)
+			max = w->hr_data[i];
+	}
+	return max > 0;
+}
+
+/*
+ * Write <chart> of <w> as an SVG image to <out>. Returns 0 if the
+ * workout has no data for the chart.
+ */
+int
+plot_svg(workout_t *w, int chart, SINK *out)
+{
+	struct plot p;
+	struct tm tm;
+	char title[64];
+
+	if (!plot_available(w, chart))
+		return 0;
+
+	/* the workout date as in the txt format, which s725plot uses */
+	strftime(title, sizeof(title), "%Y-%m-%d %H:%M:%S (%a, %d %b %Y)",
+			 localtime_r(&w->unixtime, &tm));
+
+	memset(&p, 0, sizeof(p));
+	p.out = out;
+	if (chart == PLOT_HIST)
+		plot_hist(&p, w, title);
+	else
+		plot_time(&p, w, chart, title);
+
+	return 1;
+}
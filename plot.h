@@ -0,0 +1,40 @@
+/* plot.h - SVG charts of a workout */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PLOT_H
+#define PLOT_H
+
+#include "sink.h"
+#include "workout.h"
+
+/* the charts of s725plot */
+enum {
+	PLOT_TIME_HR,
+	PLOT_TIME_SPD,
+	PLOT_TIME_ALT,
+	PLOT_HIST,
+	PLOT_NCHARTS
+};
+
+const char	*plot_name(int chart);
+int			 plot_available(workout_t *w, int chart);
+int			 plot_svg(workout_t *w, int chart, SINK *out);
+
+#endif	/* PLOT_H */
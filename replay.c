@@ -0,0 +1,147 @@
+/* replay.c - driver that plays back a capture file */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The replay driver answers requests with the data received in a
+ * capture (see capture.c), so a download can be repeated offline.
+ * Received runs are only handed out up to the next recorded write,
+ * like a watch that does not send anything before it is asked to.
+ */
+
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "capture.h"
+#include "driver_int.h"
+#include "log.h"
+#include "xmalloc.h"
+
+static int replay_init(struct s725_driver *d);
+static int replay_write(struct s725_driver *d, BUF *buf);
+static int replay_read_byte(struct s725_driver *d, unsigned char *byte);
+static int replay_close(struct s725_driver *d);
+static int replay_reopen(struct s725_driver *d);
+
+struct s725_driver_ops replay_driver_ops = {
+	.init = replay_init,
+	.read = NULL,
+	.read_byte = replay_read_byte,
+	.write = replay_write,
+	.close = replay_close,
+	.reopen = replay_reopen,
+};
+
+struct driver_private {
+	CAPTURE *capture;
+	struct capture_rec rec;		/* current record */
+	size_t pos;					/* bytes of rec handed out */
+	int have;					/* rec is valid */
+};
+
+#define DP(x) ((struct driver_private *)x->data)
+
+static int
+replay_init(struct s725_driver *d)
+{
+	CAPTURE *c;
+
+	if ((c = capture_open(d->path)) == NULL)
+		return -1;
+
+	d->data = xmalloc(sizeof(struct driver_private));
+	memset(d->data, 0, sizeof(struct driver_private));
+	DP(d)->capture = c;
+
+	return 0;
+}
+
+static int
+replay_next(struct s725_driver *d)
+{
+	DP(d)->pos = 0;
+	DP(d)->have = capture_next(DP(d)->capture, &DP(d)->rec);
+	return DP(d)->have;
+}
+
+/*
+ * Skip ahead to the next recorded write, dropping received data
+ * that was not read.
+ */
+static int
+replay_write(struct s725_driver *d, BUF *buf)
+{
+	struct capture_rec *r = &DP(d)->rec;
+
+	if (!DP(d)->have)
+		replay_next(d);
+
+	while (DP(d)->have && r->dir != CAPTURE_TX) {
+		if (r->len > DP(d)->pos)
+			log_info("replay_write: skipping %zu bytes", r->len - DP(d)->pos);
+		replay_next(d);
+	}
+
+	if (!DP(d)->have) {
+		log_info("replay_write: end of capture");
+		return buf_len(buf);
+	}
+
+	if (r->len != buf_len(buf) || memcmp(r->data, buf_get(buf), r->len) != 0)
+		log_info("replay_write: request differs from capture");
+
+	replay_next(d);
+	return buf_len(buf);
+}
+
+static int
+replay_read_byte(struct s725_driver *d, unsigned char *byte)
+{
+	struct capture_rec *r = &DP(d)->rec;
+
+	if (!DP(d)->have)
+		replay_next(d);
+
+	while (DP(d)->have && r->dir == CAPTURE_RX && DP(d)->pos == r->len)
+		replay_next(d);
+
+	/* nothing more to receive before the next request */
+	if (!DP(d)->have || r->dir != CAPTURE_RX)
+		return 0;
+
+	*byte = r->data[DP(d)->pos++];
+	return 1;
+}
+
+static int
+replay_close(struct s725_driver *d)
+{
+	capture_close(DP(d)->capture);
+	xfree(DP(d));
+	d->data = NULL;
+	return 0;
+}
+
+/* keep the position, the capture continues after a reopen */
+static int
+replay_reopen(struct s725_driver *d)
+{
+	return 0;
+}
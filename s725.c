@@ -0,0 +1,176 @@
+/* s725.c - libs725 interface */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The functions of the library are thin wrappers around the parser
+ * and writers that the tools use, so they behave the same. Only the
+ * functions in s725.h are exported from the shared object.
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "buf.h"
+#include "log.h"
+#include "s725.h"
+#include "sink.h"
+#include "workout.h"
+#include "workout_int.h"
+#include "workout_print.h"
+#include "xmalloc.h"
+
+int
+s725_api_version(void)
+{
+	return S725_API_VERSION;
+}
+
+/*
+ * Use <a> for all memory of the library, or malloc if <a> is NULL.
+ * Must be called before any workout is parsed.
+ */
+void
+s725_set_allocator(const struct s725_allocator *a)
+{
+	struct xmalloc_hooks h;
+
+	if (a == NULL) {
+		xmalloc_set_hooks(NULL);
+		return;
+	}
+	h.malloc = a->malloc;
+	h.realloc = a->realloc;
+	h.free = a->free;
+	h.ctx = a->ctx;
+	xmalloc_set_hooks(&h);
+}
+
+/*
+ * Pass the messages of the library, such as why a workout could not
+ * be parsed, to <fn> instead of writing them to stderr. NULL drops
+ * them. Must be called before any workout is parsed.
+ */
+void
+s725_set_log(s725_log_fn fn, void *ctx)
+{
+	log_set_fn(fn, ctx);
+}
+
+/*
+ * Parse the <len> bytes of .srd data at <data>, which are not copied
+ * unless some <parts> are left for s725_load(). Returns NULL if the
+ * data is not a valid workout or there is not enough memory.
+ */
+s725_workout *
+s725_parse(const void *data, size_t len, int model, int parts)
+{
+	workout_t *w;
+	BUF *buf;
+
+	if ((buf = buf_wrap(data, len)) == NULL)
+		return NULL;
+	w = workout_read_buf(buf, model, parts);
+	buf_free(buf);
+	return w;
+}
+
+/* Parse the <parts> of <w> that s725_parse() left out. */
+int
+s725_load(s725_workout *w, int parts)
+{
+	return workout_load(w, parts) ? 0 : -1;
+}
+
+void
+s725_free(s725_workout *w)
+{
+	workout_free(w);
+}
+
+/*
+ * Write <w> in <format> to <fn>, in pieces of up to SINK_BUFSIZ
+ * bytes. Returns 0, or -1 if the format is unknown, the parts left
+ * out by s725_parse() cannot be decoded, <fn> failed or there is not
+ * enough memory.
+ */
+int
+s725_write(s725_workout *w, int format, s725_write_fn fn, void *ctx)
+{
+	SINK *out;
+
+	if (format != S725_FORMAT_HRM && format != S725_FORMAT_TCX &&
+		format != S725_FORMAT_TXT)
+		return -1;
+
+	/* the writers only log parts they cannot decode */
+	if (!workout_load(w, S725_WORKOUT_FULL))
+		return -1;
+
+	if ((out = sink_callback(fn, ctx)) == NULL)
+		return -1;
+
+	switch (format) {
+	case S725_FORMAT_HRM:
+		workout_print_hrm(w, out);
+		break;
+	case S725_FORMAT_TCX:
+		workout_print_tcx(w, out);
+		break;
+	case S725_FORMAT_TXT:
+		workout_print_txt(w, out, S725_WORKOUT_FULL);
+		break;
+	}
+
+	return sink_close(out);
+}
+
+int
+s725_model(const s725_workout *w)
+{
+	return w->type;
+}
+
+time_t
+s725_start(const s725_workout *w)
+{
+	return w->unixtime;
+}
+
+/* Duration in seconds. */
+int
+s725_duration(const s725_workout *w)
+{
+	return w->duration.hours * 3600 + w->duration.minutes * 60 +
+		w->duration.seconds;
+}
+
+int
+s725_laps(const s725_workout *w)
+{
+	return w->laps;
+}
+
+int
+s725_samples(const s725_workout *w)
+{
+	return w->samples;
+}
@@ -0,0 +1,96 @@
+/* s725.h - libs725 interface */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * libs725 parses workouts in the .srd format of the Polar S610, S625X
+ * and S725 from memory and writes them as HRM, TCX or text. Nothing
+ * in this file changes within one major version of the library, new
+ * functions may be added.
+ */
+
+#ifndef S725_H
+#define S725_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define S725_API_VERSION	1
+
+#ifdef __GNUC__
+#define S725_EXPORT	__attribute__((visibility("default")))
+#else
+#define S725_EXPORT
+#endif
+
+/* watch models, S725_MODEL_AUTO detects the model from the data */
+#define S725_MODEL_AUTO		 0
+#define S725_MODEL_S610		11
+#define S725_MODEL_S725		12
+#define S725_MODEL_S625		22
+
+/* parts of a workout to parse, the header is always parsed */
+#define S725_WORKOUT_HEADER   1
+#define S725_WORKOUT_LAPS     2
+#define S725_WORKOUT_SAMPLES  4
+#define S725_WORKOUT_FULL     7
+
+/* output formats */
+#define S725_FORMAT_HRM		1
+#define S725_FORMAT_TCX		3
+#define S725_FORMAT_TXT		4
+
+typedef struct workout_t s725_workout;
+
+/*
+ * Called instead of malloc, realloc and free, with <ctx> as the last
+ * argument. If an allocation fails, s725_parse() returns NULL and
+ * s725_load() and s725_write() return -1.
+ */
+struct s725_allocator {
+	void	*(*malloc)(size_t size, void *ctx);
+	void	*(*realloc)(void *ptr, size_t size, void *ctx);
+	void	 (*free)(void *ptr, void *ctx);
+	void	*ctx;
+};
+
+/* Called with each piece of output. Returns 0, or -1 to stop writing. */
+typedef int (*s725_write_fn)(void *ctx, const void *data, size_t len);
+
+/* Called with each message of the library, without a newline. */
+typedef void (*s725_log_fn)(void *ctx, const char *msg);
+
+S725_EXPORT int		 s725_api_version(void);
+S725_EXPORT void	 s725_set_allocator(const struct s725_allocator *a);
+S725_EXPORT void	 s725_set_log(s725_log_fn fn, void *ctx);
+
+S725_EXPORT s725_workout	*s725_parse(const void *data, size_t len, int model,
+									int parts);
+S725_EXPORT int		 s725_load(s725_workout *w, int parts);
+S725_EXPORT void	 s725_free(s725_workout *w);
+S725_EXPORT int		 s725_write(s725_workout *w, int format, s725_write_fn fn,
+								void *ctx);
+
+S725_EXPORT int		 s725_model(const s725_workout *w);
+S725_EXPORT time_t	 s725_start(const s725_workout *w);
+S725_EXPORT int		 s725_duration(const s725_workout *w);
+S725_EXPORT int		 s725_laps(const s725_workout *w);
+S725_EXPORT int		 s725_samples(const s725_workout *w);
+
+#endif	/* S725_H */
@@ -0,0 +1,360 @@
+/* s725arc.c - s725arc main */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "log.h"
+#include "scan.h"
+#include "workout.h"
+#include "xmalloc.h"
+
+/* one per thread of the stats scan */
+struct stats_part {
+	const struct query *q;
+	struct archive_totals t;
+	int			 invalid;
+};
+
+struct query {
+	time_t		 after;
+	time_t		 before;
+	int			 min_distance;
+	int			 max_distance;
+	int			 min_duration;
+	int			 type;
+};
+
+static void
+usage(void) {
+	printf("usage: s725arc [options] update|query|stats directory\n");
+	printf("        -a YYYY-MM-DD  only workouts on or after this day\n");
+	printf("        -b YYYY-MM-DD  only workouts before this day\n");
+	printf("        -y year        only workouts in this year\n");
+	printf("        -d km          minimum distance\n");
+	printf("        -D km          maximum distance\n");
+	printf("        -t minutes     minimum duration\n");
+	printf("        -m model       only workouts from S610, S625 or S725\n");
+	printf("        -j threads     number of threads to parse files on\n");
+	printf("        -n             query without updating the index\n");
+	printf("        -v             verbose output\n");
+}
+
+static time_t
+parse_day(const char *s)
+{
+	struct tm tm;
+	char *end;
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(s, "%Y-%m-%d", &tm);
+	if (end == NULL || *end != '\0') {
+		usage();
+		exit(1);
+	}
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+static int
+parse_number(const char *s)
+{
+	int v;
+
+	if ((v = scan_number(s)) == -1) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+static const char *
+type_str(int type)
+{
+	switch (type) {
+	case S725_HRM_S610:
+		return "S610";
+	case S725_HRM_S625:
+		return "S625";
+	case S725_HRM_S725:
+		return "S725";
+	}
+	return "?";
+}
+
+static int
+query_match(const struct query *q, const struct archive_rec *r)
+{
+	if (r->type == 0)
+		return 0;
+	if (q->type != 0 && r->type != q->type)
+		return 0;
+	if (q->after != 0 && r->time < q->after)
+		return 0;
+	if (q->before != 0 && r->time >= q->before)
+		return 0;
+	if (r->distance < q->min_distance)
+		return 0;
+	if (q->max_distance != 0 && r->distance > q->max_distance)
+		return 0;
+	if (r->duration < q->min_duration)
+		return 0;
+	return 1;
+}
+
+static int
+rec_cmp(const void *a, const void *b)
+{
+	const struct archive_rec *ra = a;
+	const struct archive_rec *rb = b;
+
+	if (ra->time != rb->time)
+		return ra->time < rb->time ? -1 : 1;
+	return strcmp(ra->name, rb->name);
+}
+
+static void
+query(ARCHIVE *a, const struct query *q)
+{
+	struct archive_rec *recs;
+	struct tm tm;
+	char date[32];
+	size_t count, n, i;
+	long distance = 0, duration = 0;
+
+	count = archive_count(a);
+	recs = xcalloc(count + 1, sizeof(*recs));
+	for (n = 0, i = 0; i < count; i++) {
+		archive_get(a, i, &recs[n]);
+		if (query_match(q, &recs[n]))
+			n++;
+	}
+	qsort(recs, n, sizeof(*recs), rec_cmp);
+
+	for (i = 0; i < n; i++) {
+		localtime_r(&recs[i].time, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &tm);
+		printf("%s  %-22s %s  %2d:%02d:%02d %7.2f km %5d m %3d/%3d bpm %2d laps\n",
+			   date, recs[i].name, type_str(recs[i].type),
+			   recs[i].duration / 3600, recs[i].duration / 60 % 60,
+			   recs[i].duration % 60, recs[i].distance / 1000.0,
+			   recs[i].ascent, recs[i].avg_hr, recs[i].max_hr, recs[i].laps);
+		distance += recs[i].distance;
+		duration += recs[i].duration;
+	}
+	printf("%zu workouts, %.2f km, %ld:%02ld:%02ld\n", n, distance / 1000.0,
+		   duration / 3600, duration / 60 % 60, duration % 60);
+	xfree(recs);
+}
+
+static void
+print_duration(long s)
+{
+	printf("%3ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+}
+
+/* called by scan_run for every file */
+static void
+stats_file(int worker, size_t i, const char *path, workout_t *w, void *arg)
+{
+	struct stats_part *part = ((struct stats_part **)arg)[worker];
+	struct archive_rec r;
+
+	if (w == NULL) {
+		part->invalid++;
+		return;
+	}
+	memset(&r, 0, sizeof(r));
+	archive_rec_set(&r, w);
+	if (query_match(part->q, &r))
+		archive_totals_add(&part->t, &r, w);
+}
+
+/*
+ * Parse the headers of all files below <dir> in parallel, and sum up
+ * the workouts that match the query per week.
+ */
+static void
+stats(const char *dir, const struct query *q, int threads)
+{
+	static const char *zone[] = { "below", "within", "above" };
+	struct stats_part **parts;
+	struct archive_totals t;
+	char date[32];
+	char **paths;
+	ssize_t n;
+	size_t i;
+	int invalid = 0;
+	int j, k;
+
+	if ((n = scan_dir(dir, &paths)) == -1)
+		fatalx("%s: cannot read directory", dir);
+
+	if (threads <= 0)
+		threads = scan_threads();
+	parts = xcalloc(threads, sizeof(*parts));
+	for (j = 0; j < threads; j++) {
+		parts[j] = xcalloc(1, sizeof(**parts));
+		parts[j]->q = q;
+	}
+	scan_run(paths, n, S725_WORKOUT_HEADER, threads, stats_file, parts);
+
+	memset(&t, 0, sizeof(t));
+	for (j = 0; j < threads; j++) {
+		archive_totals_merge(&t, &parts[j]->t);
+		invalid += parts[j]->invalid;
+		archive_totals_free(&parts[j]->t);
+		xfree(parts[j]);
+	}
+	xfree(parts);
+	scan_paths_free(paths, n);
+
+	printf("week         workouts   duration   distance   ascent\n");
+	for (i = 0; i < t.nweeks; i++) {
+		strftime(date, sizeof(date), "%Y-%m-%d", localtime(&t.weeks[i].start));
+		printf("%s   %8d  ", date, t.weeks[i].workouts);
+		print_duration(t.weeks[i].duration);
+		printf(" %7.2f km %6ld m\n", t.weeks[i].distance / 1000.0,
+			   t.weeks[i].ascent);
+	}
+	printf("total        %8d  ", t.workouts);
+	print_duration(t.duration);
+	printf(" %7.2f km %6ld m\n", t.distance / 1000.0, t.ascent);
+
+	for (j = 0; j < 3; j++) {
+		printf("HR limit %d:", j + 1);
+		for (k = 0; k < 3; k++) {
+			printf("  %s ", zone[k]);
+			print_duration(t.zone[j][k]);
+		}
+		printf("\n");
+	}
+	printf("energy:      %ld\n", t.energy);
+	if (invalid)
+		printf("invalid files: %d\n", invalid);
+	archive_totals_free(&t);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct query q;
+	struct tm tm;
+	ARCHIVE *a;
+	int opt_update = 1;
+	int opt_threads = 0;
+	int ch, n;
+
+	memset(&q, 0, sizeof(q));
+	while ((ch = getopt(argc, argv, "a:b:y:d:D:t:j:m:nvh")) != -1) {
+		switch (ch) {
+		case 'a':
+			q.after = parse_day(optarg);
+			break;
+		case 'b':
+			q.before = parse_day(optarg);
+			break;
+		case 'y':
+			memset(&tm, 0, sizeof(tm));
+			tm.tm_year = parse_number(optarg) - 1900;
+			tm.tm_mday = 1;
+			tm.tm_isdst = -1;
+			q.after = mktime(&tm);
+			tm.tm_year++;
+			tm.tm_isdst = -1;
+			q.before = mktime(&tm);
+			break;
+		case 'd':
+			q.min_distance = parse_number(optarg) * 1000;
+			break;
+		case 'D':
+			q.max_distance = parse_number(optarg) * 1000;
+			break;
+		case 't':
+			q.min_duration = parse_number(optarg) * 60;
+			break;
+		case 'm':
+			if (!strcmp(optarg, "S610")) {
+				q.type = S725_HRM_S610;
+			} else if (!strcmp(optarg, "S625")) {
+				q.type = S725_HRM_S625;
+			} else if (!strcmp(optarg, "S725")) {
+				q.type = S725_HRM_S725;
+			} else {
+				usage();
+				return 1;
+			}
+			break;
+		case 'j':
+			opt_threads = parse_number(optarg);
+			break;
+		case 'n':
+			opt_update = 0;
+			break;
+		case 'v':
+			log_add_level();
+			break;
+		case 'h':
+			usage();
+			return 0;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2 ||
+		(strcmp(argv[0], "update") != 0 && strcmp(argv[0], "query") != 0 &&
+		 strcmp(argv[0], "stats") != 0)) {
+		usage();
+		return 1;
+	}
+
+	if (!strcmp(argv[0], "stats")) {
+		stats(argv[1], &q, opt_threads);
+		return 0;
+	}
+
+	if ((a = archive_open(argv[1])) == NULL)
+		fatalx("%s: cannot open index", argv[1]);
+
+	if (!strcmp(argv[0], "update")) {
+		if ((n = archive_update(a, opt_threads)) == -1)
+			fatalx("%s: update failed", argv[1]);
+		log_info("%d files indexed, %zu in index", n, archive_count(a));
+	} else {
+		if (opt_update && archive_update(a, opt_threads) == -1)
+			fatalx("%s: update failed", argv[1]);
+		query(a, &q);
+	}
+
+	archive_close(a);
+
+	return 0;
+}
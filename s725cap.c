@@ -0,0 +1,248 @@
+/* s725cap.c - show, filter and decode capture files */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "capture.h"
+#include "driver.h"
+#include "log.h"
+#include "packet.h"
+
+#define SHOW_TX		(1 << CAPTURE_TX)
+#define SHOW_RX		(1 << CAPTURE_RX)
+
+static int opt_hexdump;
+static int opt_replay;
+
+static void
+usage(void) {
+	printf("usage: s725cap [-hprvx] [-d direction] file\n");
+	printf("        -d direction   only show data sent (tx) or received (rx)\n");
+	printf("        -p             decode protocol frames\n");
+	printf("        -r             replay with the original timing\n");
+	printf("        -x             hexdump of the data\n");
+	printf("        -v             verbose output\n");
+}
+
+static const char *
+dir_name(int dir)
+{
+	return dir == CAPTURE_TX ? "tx" : "rx";
+}
+
+/* wait until <time> nanoseconds have passed since the first call */
+static void
+replay_wait(uint64_t time)
+{
+	static struct timespec start;
+	struct timespec now, ts;
+	uint64_t elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (start.tv_sec == 0 && start.tv_nsec == 0)
+		start = now;
+	elapsed = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000 +
+		now.tv_nsec - start.tv_nsec;
+	if (time <= elapsed)
+		return;
+	ts.tv_sec = (time - elapsed) / 1000000000;
+	ts.tv_nsec = (time - elapsed) % 1000000000;
+	nanosleep(&ts, NULL);
+}
+
+static void
+print_time(uint64_t time)
+{
+	if (opt_replay)
+		replay_wait(time);
+	printf("%6llu.%06llu ", (unsigned long long)(time / 1000000000),
+		   (unsigned long long)(time % 1000000000 / 1000));
+}
+
+static void
+print_record(struct capture_rec *r)
+{
+	print_time(r->time);
+	printf("%s %5zu bytes\n", dir_name(r->dir), r->len);
+	if (opt_hexdump)
+		log_hexdump_file(stdout, r->data, r->len);
+}
+
+static void
+print_request(struct capture_rec *r)
+{
+	const char *name;
+	unsigned short crc = 0;
+	unsigned short len;
+
+	print_time(r->time);
+	if (r->len < 7 || r->data[0] != S725_REQUEST ||
+		(len = (r->data[3] << 8) + r->data[4]) < 5 || len + 2 != r->len) {
+		printf("tx invalid request, %zu bytes\n", r->len);
+	} else {
+		packet_crc_block(&crc, r->data, len);
+		name = packet_request_name(r->data[1], r->data + 5, len - 5);
+		printf("tx %s (id %02x) len %hu crc %s\n", name ? name : "unknown",
+			   r->data[1], len - 5,
+			   crc == ((r->data[len] << 8) | r->data[len + 1]) ? "ok" : "failed");
+	}
+	if (opt_hexdump)
+		log_hexdump_file(stdout, r->data, r->len);
+}
+
+static void
+print_response(struct capture_rec *r, packet_t *p)
+{
+	u_char *d = packet_data(p);
+
+	print_time(r->time);
+	printf("rx response (id %02x) len %hu", packet_get_id(p), packet_len(p));
+	if (packet_len(p) > 0)
+		printf(" %s remaining %d", d[0] & 0x80 ? "first" : "next", d[0] & 0x7f);
+	printf("\n");
+	if (opt_hexdump)
+		log_hexdump_file(stdout, d, packet_len(p));
+}
+
+/*
+ * Decode the capture with the same framing code that s725get uses.
+ * Received data is fed to packet_recv() through the replay driver,
+ * which runs in step with the records read here.
+ */
+static int
+decode(const char *path, CAPTURE *c, int show)
+{
+	struct s725_driver *d;
+	struct capture_rec r;
+	packet_t *p;
+	BUF *b;
+	int prev = CAPTURE_TX;
+
+	if ((d = driver_init(DRIVER_REPLAY, path)) == NULL)
+		return 1;
+	if (driver_open(d) < 0) {
+		driver_close(d);
+		return 1;
+	}
+
+	b = buf_alloc(0);
+	while (capture_next(c, &r)) {
+		if (r.dir == CAPTURE_TX) {
+			if (show & SHOW_TX)
+				print_request(&r);
+			buf_empty(b);
+			buf_append(b, r.data, r.len);
+			driver_write(d, b);
+		} else if (prev == CAPTURE_TX) {
+			/* first run after a request, decode all responses */
+			while ((p = packet_recv(d)) != NULL) {
+				if (show & SHOW_RX)
+					print_response(&r, p);
+				free(p);
+			}
+		}
+		prev = r.dir;
+	}
+	buf_free(b);
+	driver_close(d);
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	CAPTURE *c;
+	struct capture_rec r;
+	char date[64];
+	time_t start;
+	int opt_decode = 0;
+	int show = SHOW_TX | SHOW_RX;
+	int ret = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "d:hprvx")) != -1) {
+		switch (ch) {
+		case 'd':
+			if (!strcmp(optarg, "tx"))
+				show = SHOW_TX;
+			else if (!strcmp(optarg, "rx"))
+				show = SHOW_RX;
+			else
+				fatalx("unknown direction: %s", optarg);
+			break;
+		case 'p':
+			opt_decode = 1;
+			break;
+		case 'r':
+			opt_replay = 1;
+			break;
+		case 'x':
+			opt_hexdump = 1;
+			break;
+		case 'v':
+			log_add_level();
+			break;
+		case 'h':
+			usage();
+			return 0;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) {
+		usage();
+		return 1;
+	}
+
+	if ((c = capture_open(argv[0])) == NULL)
+		return 1;
+
+	if (opt_replay)
+		setvbuf(stdout, NULL, _IOLBF, 0);
+
+	start = capture_start_time(c);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&start));
+	printf("# capture started %s\n", date);
+
+	if (opt_decode) {
+		ret = decode(argv[0], c, show);
+	} else {
+		while (capture_next(c, &r)) {
+			if (show & (1 << r.dir))
+				print_record(&r);
+		}
+	}
+
+	capture_close(c);
+	return ret;
+}
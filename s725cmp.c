@@ -0,0 +1,178 @@
+/* s725cmp.c - s725cmp main */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compare.h"
+#include "log.h"
+#include "scan.h"
+#include "sink.h"
+#include "workout.h"
+#include "xmalloc.h"
+
+static void
+usage(void) {
+	printf("usage: s725cmp [options] file|directory ...\n");
+	printf("        -d             align by distance (default)\n");
+	printf("        -t             align by time\n");
+	printf("        -s step        grid step in km or seconds (default: 0.1 km, 15 s)\n");
+	printf("        -r n           compare to the n-th workout (default: 1)\n");
+	printf("        -j threads     number of threads to parse files on\n");
+	printf("        -F outfile     output file name, - for stdout (default)\n");
+	printf("        -v             verbose output\n");
+}
+
+static double
+parse_step(const char *s)
+{
+	char *end;
+	double v;
+
+	errno = 0;
+	v = strtod(s, &end);
+	if (errno != 0 || *s == '\0' || *end != '\0' || !(v > 0)) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+static int
+parse_number(const char *s)
+{
+	int v;
+
+	if ((v = scan_number(s)) == -1) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+/* called by scan_run for every file */
+static void
+compare_file(int worker, size_t i, const char *path, workout_t *w, void *arg)
+{
+	if (w == NULL) {
+		log_error("%s: invalid file", path);
+		compare_add(arg, i, path, NULL);
+		return;
+	}
+	if (!compare_add(arg, i, path, w))
+		log_error("%s: cannot be compared", path);
+}
+
+int
+main(int argc, char **argv)
+{
+	char *opt_output_file = "-";
+	int opt_axis = COMPARE_DISTANCE;
+	double opt_step = 0;
+	int opt_ref = 1;
+	int opt_threads = 0;
+	char **paths = NULL;
+	size_t n = 0;
+	COMPARE *c;
+	SINK *out;
+	int outfd;
+	int ch;
+	int i;
+
+	while ((ch = getopt(argc, argv, "dts:r:j:F:vh")) != -1) {
+		switch (ch) {
+		case 'd':
+			opt_axis = COMPARE_DISTANCE;
+			break;
+		case 't':
+			opt_axis = COMPARE_TIME;
+			break;
+		case 's':
+			opt_step = parse_step(optarg);
+			break;
+		case 'r':
+			opt_ref = parse_number(optarg);
+			break;
+		case 'j':
+			opt_threads = parse_number(optarg);
+			break;
+		case 'F':
+			opt_output_file = optarg;
+			break;
+		case 'v':
+			log_add_level();
+			break;
+		case 'h':
+			usage();
+			return 0;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) {
+		usage();
+		return 1;
+	}
+
+	for (i = 0; i < argc; i++)
+		n = scan_add_path(argv[i], &paths, n);
+	if (n == 0)
+		fatalx("no workouts found");
+	if (opt_ref < 1 || opt_ref > n)
+		fatalx("reference %d out of range, %zu workouts", opt_ref, n);
+	if (opt_step == 0)
+		opt_step = opt_axis == COMPARE_DISTANCE ? 0.1 : 15;
+	if (opt_threads <= 0)
+		opt_threads = scan_threads();
+
+	c = compare_new(opt_axis, opt_step, n);
+	scan_run(paths, n, S725_WORKOUT_FULL, opt_threads, compare_file, c);
+	if (compare_track(c, opt_ref - 1)->n == 0)
+		fatalx("%s: reference cannot be compared", paths[opt_ref - 1]);
+	compare_deltas(c, opt_ref - 1);
+
+	if (!strcmp(opt_output_file, "-"))
+		outfd = STDOUT_FILENO;
+	else if ((outfd = open(opt_output_file,
+						   O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+		fatal("%s", opt_output_file);
+	out = sink_fd(outfd);
+	compare_print(c, out);
+	if (sink_close(out) == -1)
+		fatal("%s", opt_output_file);
+	if (outfd != STDOUT_FILENO)
+		close(outfd);
+
+	compare_free(c);
+	scan_paths_free(paths, n);
+
+	return 0;
+}
@@ -22,7 +22,11 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,30 +34,90 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "capture.h"
+#include "checkpoint.h"
 #include "conf.h"
+#include "dedup.h"
 #include "driver.h"
 #include "files.h"
 #include "format.h"
 #include "log.h"
 #include "misc.h"
+#include "pipeline.h"
+#include "sink.h"
+#include "stats.h"
 #include "workout.h"
 #include "workout_print.h"
 
-static void write_hrm_data(BUF *files, const char *directory, int format);
+#define MAX_DEVICES 16
+
+struct write_ctx {
+	const char	*directory;
+	const int	*formats;
+	int			 nformats;
+	DEDUP		*dedup;
+	workout_arena_t	*arena;		/* reused for every workout */
+	BUF			*text;		/* formatted output of one workout */
+};
+
+/* settings shared by all devices */
+struct get_opts {
+	const char	*directory;
+	int			 driver_type;
+	int			 formats[5];
+	int			 listen;
+	int			 retries;
+	int			 checkpoint;
+	int			 pipeline;
+	int			 new;
+	int			 interval;		/* daemon mode poll interval */
+};
+
+struct session {
+	const char		*device;
+	struct get_opts	*opts;
+	pthread_t		 thread;
+};
+
+static pthread_mutex_t	daemon_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	daemon_cond = PTHREAD_COND_INITIALIZER;
+static int				daemon_stop;
+
+static int get_files(struct s725_driver *d, const char *device, struct get_opts *o);
+static void run_daemon(struct session *sessions, int nsessions);
+static void *daemon_session(void *arg);
+
+static void write_dump(BUF *files, struct write_ctx *ctx);
+static void write_hrm_data(BUF *files, struct write_ctx *ctx, int format);
+static void write_workout(BUF *buf, int count, struct write_ctx *ctx, int format);
+static void write_pipeline(BUF *buf, int count, void *arg);
+static void feed_pipeline(BUF *files, void *arg);
 
 static void
 usage(void) {
-	printf("usage: s725get [-hvt] [-d driver] [-D device] [-f directory] [-o format]\n");
-	printf("        -d driver      driver type: serial. (default: serial).\n");
+	printf("usage: s725get [-bchlnprsStuv] [-C file] [-d driver] [-D device] [-f directory]\n");
+	printf("               [-o format] [-w interval]\n");
+	printf("        -b             buffer log output in memory, write it on exit\n");
+	printf("        -c             keep partial transfers in a checkpoint file\n");
+	printf("        -C file        capture all data sent and received in file\n");
+	printf("        -d driver      driver type: serial, replay. (default: serial).\n");
 	printf("        -D device      device file. required for serial and ir driver.\n");
+	printf("                       (can be used multiple times with -w)\n");
 	printf("        -f directory   directory where output files are written to.\n");
 	printf("                       default: current working directory\n");
 	printf("        -l             listen for incoming data\n");
-	printf("        -o format      output format: hrm, srd, tcx, txt\n");
+	printf("        -n             only write workouts that were not saved before\n");
+	printf("        -o format      output format: hrm, srd, tcx, txt, dump\n");
 	printf("                       (can be used multiple times)n");
+	printf("        -p             write workouts while the transfer is running\n");
+	printf("        -r             restart transfer on transmission errors\n");
+	printf("        -s             print timing and counters on exit\n");
+	printf("        -S             print timing and counters on exit as JSON\n");
 	printf("        -t             get time\n");
 	printf("        -u             get user data\n");
 	printf("        -v             verbose output\n");
+	printf("        -w interval    keep running and download from all devices\n");
+	printf("                       every <interval> seconds\n");
 }
 
 int
@@ -64,21 +128,27 @@ main(int argc, char **argv)
 	char			  inipath[PATH_MAX];
 	const char		 *opt_directory_name = NULL;
 	const char		 *opt_driver_name = NULL;
-	int				  opt_driver_type = DRIVER_SERIAL;
-	const char		 *opt_device_name = NULL;
-	int				  opt_format_list[5] = { 0 /* FORMAT_UNKNOWN */ };
+	const char		 *opt_capture_name = NULL;
+	const char		 *opt_device_list[MAX_DEVICES];
+	int				  opt_device_index = 0;
 	int				  opt_format_index = 0;
-	BUF				 *files;
+	struct get_opts	  opts;
+	struct session	  sessions[MAX_DEVICES];
+	struct s725_driver *driver;
+	CAPTURE			 *capture = NULL;
 	int				  opt_time = 0;
 	int				  opt_user = 0;
-	int				  opt_listen = 0;
 	int				  ch;
-	int				  ok;
 	char			 *ap;
+	char			 *ep;
+	long			  lval;
 	int				  format;
 	int				  ret;
 	int				  i;
 
+	memset(&opts, 0, sizeof(opts));
+	opts.driver_type = DRIVER_SERIAL;
+
 	snprintf(inipath, PATH_MAX, "%s/.s725rc", getenv("HOME"));
 	yyin = fopen(inipath, "r");
 	if (yyin != NULL) {
@@ -87,42 +157,68 @@ main(int argc, char **argv)
 		if (ret != 0)
 			exit(1);
 		if (conf_driver_type != DRIVER_UNKNOWN)
-			opt_driver_type = conf_driver_type;
+			opts.driver_type = conf_driver_type;
 		if (conf_format_type != FORMAT_UNKNOWN)
-			opt_format_list[opt_format_index] = conf_format_type;
+			opts.formats[opt_format_index] = conf_format_type;
 		if (conf_device_name != NULL)
-			opt_device_name = conf_device_name;
+			opt_device_list[0] = conf_device_name;
 		if (conf_directory_name != NULL)
 			opt_directory_name = conf_directory_name;
 	}
 
-	while ((ch = getopt(argc, argv, "d:D:f:hlo:rtuv")) != -1) {
+	while ((ch = getopt(argc, argv, "bcC:d:D:f:hlno:prsStuvw:")) != -1) {
 		switch (ch) {
+		case 'b':
+			log_ring_open(LOG_RING_SIZE);
+			break;
+		case 'c':
+			opts.checkpoint = 1;
+			break;
+		case 'C':
+			opt_capture_name = optarg;
+			break;
 		case 'd':
 			opt_driver_name = optarg;
-			opt_driver_type = driver_name_to_type(opt_driver_name);
-			if (opt_driver_type == DRIVER_UNKNOWN)
+			opts.driver_type = driver_name_to_type(opt_driver_name);
+			if (opts.driver_type == DRIVER_UNKNOWN)
 				fatalx("unknown driver type: %s", opt_driver_name);
 			break;
 		case 'D':
-			opt_device_name = optarg;
+			if (opt_device_index >= MAX_DEVICES)
+				fatalx("too many devices");
+			opt_device_list[opt_device_index++] = optarg;
 			break;
 		case 'f':
 			opt_directory_name = optarg;
 			break;
 		case 'l':
-			opt_listen = 1;
+			opts.listen = 1;
+			break;
+		case 'n':
+			opts.new = 1;
 			break;
 		case 'o':
 			ap = optarg;
-			if (opt_format_index < (sizeof(opt_format_list) /
-									sizeof(opt_format_list[0]))) {
+			if (opt_format_index < (sizeof(opts.formats) /
+									sizeof(opts.formats[0]))) {
 				if ((format = format_from_str(ap)) != FORMAT_UNKNOWN)
-					opt_format_list[opt_format_index++] = format;
+					opts.formats[opt_format_index++] = format;
 				else
 					fatalx("unknown output format: %s", ap);
 			}
 			break;
+		case 'p':
+			opts.pipeline = 1;
+			break;
+		case 'r':
+			opts.retries = FILES_RETRIES;
+			break;
+		case 's':
+			stats_enable(STATS_TEXT);
+			break;
+		case 'S':
+			stats_enable(STATS_JSON);
+			break;
 		case 't':
 			opt_time = 1;
 			break;
@@ -132,6 +228,14 @@ main(int argc, char **argv)
 		case 'v':
 			log_add_level();
 			break;
+		case 'w':
+			errno = 0;
+			lval = strtol(optarg, &ep, 10);
+			if (*optarg == '\0' || *ep != '\0' || errno != 0 ||
+				lval < 1 || lval > 86400)
+				fatalx("invalid interval: %s", optarg);
+			opts.interval = lval;
+			break;
 		case 'h':
 			usage();
 			return 0;
@@ -142,30 +246,39 @@ main(int argc, char **argv)
 		}
 	}
 
-	if (opt_driver_type == DRIVER_SERIAL) {
-		if (!opt_device_name)
+	/* the configuration file provides the default device */
+	if (opt_device_index == 0 && conf_device_name != NULL)
+		opt_device_index = 1;
+
+	if (opts.driver_type == DRIVER_SERIAL ||
+		opts.driver_type == DRIVER_REPLAY) {
+		if (opt_device_index == 0)
 			fatalx("device name required for %s driver",
-				   driver_type_to_name(opt_driver_type));
+				   driver_type_to_name(opts.driver_type));
 	}
 
+	if (opt_device_index > 1 && opts.interval == 0)
+		fatalx("multiple devices require -w");
+
+	if (opts.interval && (opt_time || opt_user || opts.listen ||
+						  opt_capture_name))
+		fatalx("-w can not be used with -C, -l, -t or -u");
+
 	if (! (opt_time || opt_user)) {
-		if (opt_format_list[0] == FORMAT_UNKNOWN)
+		if (opts.formats[0] == FORMAT_UNKNOWN)
 			fatalx("no output format specified");
 	}
 
-	for (i = 0; i < sizeof(opt_format_list) / sizeof(opt_format_list[0]); ++i) {
-		log_info("format: %s", format_to_str(opt_format_list[i]));
+	for (i = 0; i < sizeof(opts.formats) / sizeof(opts.formats[0]); ++i) {
+		log_info("format: %s", format_to_str(opts.formats[i]));
 	}
 
-	log_info("driver name: %s", driver_type_to_name(opt_driver_type));
-	log_info("driver type: %d", opt_driver_type);
-	log_info("device name: %s", opt_device_name ? opt_device_name : "");
+	log_info("driver name: %s", driver_type_to_name(opts.driver_type));
+	log_info("driver type: %d", opts.driver_type);
+	for (i = 0; i < opt_device_index; ++i)
+		log_info("device name: %s", opt_device_list[i]);
 	log_info("directory name: %s", opt_directory_name ? opt_directory_name : "");
 
-	ok = driver_init(opt_driver_type, opt_device_name);
-	if (ok != 1)
-		fatalx("driver_init failed");
-
 	if (opt_directory_name) {
 		opt_directory_name = realpath(opt_directory_name, path);
 	} else {
@@ -185,100 +298,411 @@ main(int argc, char **argv)
 	if (! S_ISDIR(s.st_mode))
 		fatalx("not a directory directory: %s", opt_directory_name);
 
-	if (driver_open() < 0)
-		fatalx("unable to open port: %s", strerror(errno));
+	opts.directory = opt_directory_name;
 
-	if (opt_time) {
-		time_get();
-		driver_close();
+	if (opts.interval) {
+		for (i = 0; i < opt_device_index; ++i) {
+			sessions[i].device = opt_device_list[i];
+			sessions[i].opts = &opts;
+		}
+		run_daemon(sessions, opt_device_index);
 		return 0;
 	}
 
-	if (opt_user) {
-		user_get();
-		driver_close();
-		return 0;
+	driver = driver_init(opts.driver_type, opt_device_list[0]);
+	if (driver == NULL)
+		fatalx("driver_init failed");
+
+	if (opt_capture_name) {
+		if ((capture = capture_create(opt_capture_name)) == NULL)
+			fatalx("unable to create capture file");
+		driver_set_capture(driver, capture);
 	}
 
+	if (driver_open(driver) < 0)
+		fatalx("unable to open port: %s", strerror(errno));
+
+	if (opt_time)
+		time_get(driver);
+	else if (opt_user)
+		user_get(driver);
+	else
+		get_files(driver, opt_device_list[0], &opts);
+
+	driver_close(driver);
+	if (capture)
+		capture_close(capture);
+	return 0;
+}
+
+/*
+ * Download all workouts from an open device and write them in all
+ * requested formats. Returns 1 if the transfer was complete.
+ */
+static int
+get_files(struct s725_driver *d, const char *device, struct get_opts *o)
+{
+	char			  ckpath[PATH_MAX];
+	char			  dedup_path[PATH_MAX];
+	char			  devname[PATH_MAX];
+	BUF				 *files;
+	struct files_xfer xfer;
+	struct write_ctx  wctx;
+	PIPELINE		 *pipeline = NULL;
+	int				  ret;
+	int				  i;
+
 	files = buf_alloc(0);
 
-	if (opt_listen) {
-		ret = files_listen(files);
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.driver = d;
+	xfer.files = files;
+	xfer.retries = o->retries;
+	xfer.quiet = o->interval != 0;
+	driver_set_quiet(d, xfer.quiet);
+
+	if (o->checkpoint) {
+		/* in daemon mode, every device has its own checkpoint */
+		if (o->interval) {
+			strncpy(devname, device, sizeof(devname) - 1);
+			devname[sizeof(devname) - 1] = '\0';
+			ret = snprintf(ckpath, sizeof(ckpath), "%s/%s.%s",
+						   o->directory, CHECKPOINT_NAME, basename(devname));
+		} else {
+			ret = snprintf(ckpath, sizeof(ckpath), "%s/%s",
+						   o->directory, CHECKPOINT_NAME);
+		}
+		if (ret >= sizeof(ckpath))
+			fatalx("checkpoint path too long");
+		xfer.checkpoint = checkpoint_open(ckpath);
+		if (xfer.checkpoint &&
+			checkpoint_load(xfer.checkpoint, files, &xfer.p_bytes, &xfer.p_count))
+			log_writeln("%s: Resuming transfer at %zu of %hu bytes",
+						device, buf_len(files), xfer.p_bytes);
+	}
+
+	memset(&wctx, 0, sizeof(wctx));
+	wctx.directory = o->directory;
+	wctx.formats = o->formats;
+	wctx.nformats = sizeof(o->formats) / sizeof(o->formats[0]);
+	if ((wctx.arena = workout_arena_new()) == NULL)
+		fatalx("%s: out of memory", device);
+	wctx.text = buf_alloc(0);
+
+	if (o->new) {
+		if (snprintf(dedup_path, sizeof(dedup_path), "%s/%s", o->directory,
+					 DEDUP_NAME) >= sizeof(dedup_path))
+			fatalx("index path too long");
+		wctx.dedup = dedup_open(dedup_path);
+	}
+
+	if (o->pipeline) {
+		pipeline = pipeline_start(write_pipeline, &wctx);
+		xfer.received = feed_pipeline;
+		xfer.arg = pipeline;
+	}
+
+	if (o->listen) {
+		ret = files_listen(&xfer);
 	} else {
-		ret = files_get(files);
+		ret = files_get(&xfer);
+	}
+
+	/* save complete workouts of a partial transfer that can be resumed */
+	if (!ret && xfer.checkpoint && buf_len(files) > 0)
+		log_writeln("%s: Transfer incomplete, saving complete files", device);
+
+	if (pipeline) {
+		/* complete workouts have been written as they arrived */
+		pipeline_finish(pipeline, files);
+	} else if (ret || (xfer.checkpoint && buf_len(files) > 0)) {
+		for (i = 0; i < wctx.nformats; ++i) {
+			if (o->formats[i] != FORMAT_UNKNOWN &&
+				o->formats[i] != FORMAT_DUMP) {
+				write_hrm_data(files, &wctx, o->formats[i]);
+			}
+		}
 	}
 
-	if (ret) {
-		for (i = 0; i < sizeof(opt_format_list) / sizeof(opt_format_list[0]); ++i) {
-			if (opt_format_list[i] != FORMAT_UNKNOWN) {
-				write_hrm_data(files, opt_directory_name, opt_format_list[i]);
+	/* the dump holds the whole transfer, it is written once at the end */
+	if (ret || (xfer.checkpoint && buf_len(files) > 0)) {
+		for (i = 0; i < wctx.nformats; ++i) {
+			if (o->formats[i] == FORMAT_DUMP) {
+				write_dump(files, &wctx);
+				break;
 			}
 		}
 	}
 
+	if (wctx.dedup)
+		dedup_close(wctx.dedup);
+	workout_arena_free(wctx.arena);
+	buf_free(wctx.text);
+
+	if (xfer.checkpoint)
+		checkpoint_close(xfer.checkpoint, ret);
+
 	buf_free(files);
-	driver_close();
-	return 0;
+	return ret;
 }
 
+/*
+ * Serve all devices until SIGINT, SIGTERM or SIGHUP is received. Each
+ * device has its own thread with an independent driver instance and
+ * conversion pipeline, the main thread only waits for signals.
+ */
 static void
-write_hrm_data(BUF *files, const char* directory, int format)
+run_daemon(struct session *sessions, int nsessions)
+{
+	sigset_t set;
+	int sig;
+	int i;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	for (i = 0; i < nsessions; i++) {
+		if (pthread_create(&sessions[i].thread, NULL, daemon_session,
+						   &sessions[i]) != 0)
+			fatal("pthread_create");
+	}
+
+	sigwait(&set, &sig);
+	log_info("run_daemon: signal %d, waiting for transfers", sig);
+
+	pthread_mutex_lock(&daemon_lock);
+	daemon_stop = 1;
+	pthread_cond_broadcast(&daemon_cond);
+	pthread_mutex_unlock(&daemon_lock);
+
+	for (i = 0; i < nsessions; i++)
+		pthread_join(sessions[i].thread, NULL);
+}
+
+static void *
+daemon_session(void *arg)
+{
+	struct session *s = arg;
+	struct s725_driver *d;
+	struct timespec ts;
+
+	pthread_mutex_lock(&daemon_lock);
+	while (!daemon_stop) {
+		pthread_mutex_unlock(&daemon_lock);
+
+		/* a failure only ends this round, the other devices go on */
+		d = driver_init(s->opts->driver_type, s->device);
+		if (d == NULL) {
+			log_error("%s: driver_init failed", s->device);
+		} else {
+			if (driver_open(d) >= 0) {
+				log_info("%s: polling", s->device);
+				get_files(d, s->device, s->opts);
+			}
+			driver_close(d);
+		}
+
+		pthread_mutex_lock(&daemon_lock);
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += s->opts->interval;
+		while (!daemon_stop &&
+			   pthread_cond_timedwait(&daemon_cond, &daemon_lock, &ts) == 0)
+			;
+	}
+	pthread_mutex_unlock(&daemon_lock);
+
+	return NULL;
+}
+
+static void
+feed_pipeline(BUF *files, void *arg)
+{
+	pipeline_feed(arg, files);
+}
+
+static void
+write_pipeline(BUF *buf, int count, void *arg)
+{
+	struct write_ctx *ctx = arg;
+	int i;
+
+	for (i = 0; i < ctx->nformats; ++i) {
+		if (ctx->formats[i] != FORMAT_UNKNOWN &&
+			ctx->formats[i] != FORMAT_DUMP)
+			write_workout(buf, count, ctx, ctx->formats[i]);
+	}
+}
+
+/*
+ * Write the complete workouts of a transfer exactly as received from
+ * the watch, size prefixes included, with a single write. Nothing is
+ * parsed, so this is the cheapest way to get the data off the watch;
+ * hrmtool -f file.dump converts or splits it later. The file is named
+ * after the download time since a dump usually holds many workouts.
+ */
+static void
+write_dump(BUF *files, struct write_ctx *ctx)
+{
+	char tmbuf[128];
+	char fnbuf[BUFSIZ];
+	struct tm tm;
+	time_t now;
+	size_t len;
+	size_t size;
+	ssize_t n;
+	uint64_t t;
+	int fd;
+	int i;
+
+	/* leave out a truncated workout at the end of a partial transfer */
+	len = 0;
+	while (len + 2 < buf_len(files)) {
+		size = (buf_getc(files, len + 1) << 8) + buf_getc(files, len);
+		if (size < 2 || len + size > buf_len(files))
+			break;
+		len += size;
+	}
+	if (len == 0)
+		return;
+
+	t = stats_begin();
+
+	now = time(NULL);
+	strftime(tmbuf, sizeof(tmbuf), "%Y%m%dT%H%M%S", localtime_r(&now, &tm));
+
+	/* daemon sessions may finish within the same second */
+	fd = -1;
+	for (i = 0; i < 100 && fd == -1; ++i) {
+		if (i == 0)
+			snprintf(fnbuf, sizeof(fnbuf), "%s/%s.dump", ctx->directory, tmbuf);
+		else
+			snprintf(fnbuf, sizeof(fnbuf), "%s/%s-%d.dump",
+					 ctx->directory, tmbuf, i);
+		fd = open(fnbuf, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd == -1 && errno != EEXIST)
+			break;
+	}
+	if (fd == -1) {
+		log_writeln("Unable to save %s: %s", fnbuf, strerror(errno));
+		stats_end(STATS_FILE_WRITE, t);
+		return;
+	}
+
+	n = write(fd, buf_get(files), len);
+	if (n == len) {
+		log_writeln("Dump: Saved %zu bytes as %s", len, fnbuf);
+	} else {
+		log_writeln("Unable to save %s: %s", fnbuf,
+					n == -1 ? strerror(errno) : "short write");
+		unlink(fnbuf);
+	}
+	close(fd);
+
+	stats_end(STATS_FILE_WRITE, t);
+}
+
+static void
+write_hrm_data(BUF *files, struct write_ctx *ctx, int format)
 {
-	const char *suffix;
-	workout_t *w;
-	FILE* f;
 	BUF *buf;
-	time_t ft;
 	int	offset;
 	int count;
 
-	suffix = format_to_str(format);
-
 	buf = buf_alloc(0);
 	offset = 0;
 	count = 0;
-	while (files_split(files, &offset, buf)) {
-		char tmbuf[128];
-		char fnbuf[BUFSIZ];
-
-		count++;
-		ft = files_timestamp(buf, 0);
-		strftime(tmbuf, sizeof(tmbuf), "%Y%m%dT%H%M%S", localtime(&ft));
-		snprintf(fnbuf, sizeof(fnbuf), "%s/%s.%s", directory, tmbuf, suffix);
-
-		if (format == FORMAT_SRD) {
-			f = fopen(fnbuf, "w");
-			if (f) {
-				log_writeln("File %02d: Saved as %s", count, fnbuf);
-				fwrite(buf_get(buf), buf_len(buf), 1, f);
-				fclose(f);
-			} else {
-				log_writeln("File %02d: Unable to save %s: %s",
-							count, fnbuf, strerror(errno));
-			}
-		} else {
-			w = workout_read_buf(buf, S725_HRM_AUTO);
-			if (w) {
-				f = fopen(fnbuf, "w");
-				if (f) {
-					log_writeln("File %02d: Saved as %s", count, fnbuf);
-					if (format == FORMAT_HRM) {
-						workout_print_hrm(w, f);
-					} else if (format == FORMAT_TCX) {
-						workout_print_tcx(w, f);
-					} else if (format == FORMAT_TXT) {
-						workout_print_txt(w, f, S725_WORKOUT_FULL);
-					}
-					fclose(f);
-				} else {
-					log_writeln("File %02d: Unable to save %s: %s",
-								count, fnbuf, strerror(errno));
-				}
-				workout_free(w);
-			} else {
-				log_writeln("Failed to parse workout for %s", fnbuf);
-			}
+	while (files_split(files, &offset, buf))
+		write_workout(buf, ++count, ctx, format);
+	buf_free(buf);
+}
+
+/*
+ * Write a single workout. With an index, workouts that have been
+ * saved before and whose file still exists are skipped without
+ * parsing them.
+ */
+static void
+write_workout(BUF *buf, int count, struct write_ctx *ctx, int format)
+{
+	const char *suffix;
+	workout_t *w;
+	SINK *out;
+	BUF *data;
+	int fd;
+	int ret;
+	time_t ft;
+	uint64_t hash = 0;
+	char tmbuf[128];
+	char fnbuf[BUFSIZ];
+	struct tm tm;
+	struct stat st;
+	uint64_t t;
+
+	suffix = format_to_str(format);
+
+	ft = files_timestamp(buf, 0);
+	strftime(tmbuf, sizeof(tmbuf), "%Y%m%dT%H%M%S", localtime_r(&ft, &tm));
+	snprintf(fnbuf, sizeof(fnbuf), "%s/%s.%s", ctx->directory, tmbuf, suffix);
+
+	if (ctx->dedup) {
+		hash = buf_hash(buf);
+		if (dedup_lookup(ctx->dedup, ft, hash, format) &&
+			stat(fnbuf, &st) == 0) {
+			log_writeln("File %02d: Already saved as %s", count, fnbuf);
+			return;
 		}
 	}
-	buf_free(buf);
+
+	/* format in memory first, so the file write span is only the I/O */
+	if (format == FORMAT_SRD) {
+		data = buf;
+	} else {
+		w = workout_read_buf_arena(buf, S725_HRM_AUTO, S725_WORKOUT_FULL,
+								   ctx->arena);
+		if (w == NULL) {
+			log_writeln("Failed to parse workout for %s", fnbuf);
+			return;
+		}
+		data = ctx->text;
+		buf_set_len(data, 0);
+		out = sink_buf(data);
+		if (format == FORMAT_HRM) {
+			workout_print_hrm(w, out);
+		} else if (format == FORMAT_TCX) {
+			workout_print_tcx(w, out);
+		} else if (format == FORMAT_TXT) {
+			workout_print_txt(w, out, S725_WORKOUT_FULL);
+		}
+		sink_close(out);
+	}
+
+	t = stats_begin();
+
+	fd = open(fnbuf, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		stats_end(STATS_FILE_WRITE, t);
+		log_writeln("File %02d: Unable to save %s: %s",
+					count, fnbuf, strerror(errno));
+		return;
+	}
+	out = sink_fd(fd);
+	sink_write(out, buf_get(data), buf_len(data));
+	ret = sink_close(out);
+	if (close(fd) == -1)
+		ret = -1;
+	stats_end(STATS_FILE_WRITE, t);
+
+	/* a truncated file must not be recorded, or -n would skip it */
+	if (ret == -1) {
+		log_writeln("File %02d: Unable to save %s: %s",
+					count, fnbuf, strerror(errno));
+		unlink(fnbuf);
+		return;
+	}
+	log_writeln("File %02d: Saved as %s", count, fnbuf);
+	if (ctx->dedup)
+		dedup_add(ctx->dedup, ft, hash, format);
 }
@@ -0,0 +1,188 @@
+/* s725svg.c - s725svg main */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "plot.h"
+#include "scan.h"
+#include "sink.h"
+#include "workout.h"
+#include "xmalloc.h"
+
+static void
+usage(void) {
+	printf("usage: s725svg [options] file|directory ... outdir\n");
+	printf("        -j threads     number of threads to draw charts on\n");
+	printf("        -v             verbose output\n");
+}
+
+static int
+parse_number(const char *s)
+{
+	int v;
+
+	if ((v = scan_number(s)) == -1) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+struct draw {
+	const char	*outdir;
+	int			*failed;		/* files that failed, per worker */
+};
+
+/* Write <chart> of <w> to <outdir>/<name>-<chart>.svg. */
+static int
+draw_chart(workout_t *w, int chart, const char *outdir, const char *path)
+{
+	char file[PATH_MAX];
+	const char *base;
+	size_t len;
+	SINK *out;
+	int fd;
+	int ret;
+
+	if ((base = strrchr(path, '/')) != NULL)
+		base++;
+	else
+		base = path;
+	len = strlen(base);
+	if (len > 4 && strcmp(base + len - 4, ".srd") == 0)
+		len -= 4;
+	if (snprintf(file, sizeof(file), "%s/%.*s-%s.svg", outdir, (int)len,
+				 base, plot_name(chart)) >= sizeof(file)) {
+		log_error("%s: file name too long", path);
+		return 0;
+	}
+
+	if ((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		log_error("%s: %s", file, strerror(errno));
+		return 0;
+	}
+	out = sink_fd(fd);
+	ret = plot_svg(w, chart, out);
+	if (sink_close(out) == -1)
+		ret = 0;
+	close(fd);
+	if (!ret) {
+		log_error("%s: cannot write chart", file);
+		unlink(file);
+		return 0;
+	}
+	printf("%s\n", file);
+	return 1;
+}
+
+/* called by scan_run for every file */
+static void
+draw_file(int worker, size_t i, const char *path, workout_t *w, void *arg)
+{
+	struct draw *d = arg;
+	int chart;
+	int ok = 1;
+
+	if (w == NULL) {
+		log_error("%s: invalid file", path);
+		d->failed[worker]++;
+		return;
+	}
+	for (chart = 0; chart < PLOT_NCHARTS; chart++)
+		if (plot_available(w, chart))
+			ok &= draw_chart(w, chart, d->outdir, path);
+	if (!ok)
+		d->failed[worker]++;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt_threads = 0;
+	char **paths = NULL;
+	char *outdir;
+	struct draw d;
+	struct stat st;
+	size_t n = 0;
+	size_t len;
+	int failed = 0;
+	int ch;
+	int i;
+
+	while ((ch = getopt(argc, argv, "j:vh")) != -1) {
+		switch (ch) {
+		case 'j':
+			opt_threads = parse_number(optarg);
+			break;
+		case 'v':
+			log_add_level();
+			break;
+		case 'h':
+			usage();
+			return 0;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	outdir = argv[argc - 1];
+	for (len = strlen(outdir); len > 1 && outdir[len - 1] == '/'; len--)
+		outdir[len - 1] = '\0';
+	if (stat(outdir, &st) == -1)
+		fatal("%s", outdir);
+	if (!S_ISDIR(st.st_mode))
+		fatalx("%s: not a directory", outdir);
+
+	for (i = 0; i < argc - 1; i++)
+		n = scan_add_path(argv[i], &paths, n);
+	if (n == 0)
+		fatalx("no workouts found");
+	if (opt_threads <= 0)
+		opt_threads = scan_threads();
+
+	d.outdir = outdir;
+	d.failed = xcalloc(opt_threads, sizeof(*d.failed));
+	scan_run(paths, n, S725_WORKOUT_FULL, opt_threads, draw_file, &d);
+	for (i = 0; i < opt_threads; i++)
+		failed += d.failed[i];
+	xfree(d.failed);
+	scan_paths_free(paths, n);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,332 @@
+/* scan.c - parse many workouts on a pool of threads */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Every worker starts with an equal share of the file list, kept as
+ * a range of indices. It takes files from the front of its own range,
+ * and when that is empty it steals the back half of the range of
+ * another worker. Ranges only ever shrink, so a worker is done when
+ * it finds no range left to steal from. Each worker parses into its
+ * own arena, so there is no allocation per file after the first few.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "log.h"
+#include "scan.h"
+#include "workout.h"
+#include "xmalloc.h"
+
+struct scan;
+
+struct scan_worker {
+	struct scan		*s;
+	int				 id;
+	pthread_t		 thread;
+	pthread_mutex_t	 lock;
+	size_t			 lo;		/* next file to parse */
+	size_t			 hi;		/* end of the range */
+	workout_arena_t	*arena;
+};
+
+struct scan {
+	char			**paths;
+	int				 what;
+	scan_fn			 fn;
+	void			*arg;
+	int				 nworkers;
+	struct scan_worker *workers;
+};
+
+struct scan_list {
+	char			**paths;
+	size_t			 n;
+	size_t			 max;
+};
+
+/* Number of threads to use by default, one per online CPU. */
+int
+scan_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n < 1 ? 1 : n;
+}
+
+static int
+scan_is_srd(const char *name)
+{
+	size_t len = strlen(name);
+
+	return len > 4 && strcmp(name + len - 4, ".srd") == 0;
+}
+
+static int
+scan_walk(const char *dir, struct scan_list *l)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+
+	if ((d = opendir(dir)) == NULL) {
+		log_error("%s: %s", dir, strerror(errno));
+		return 0;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= sizeof(path))
+			continue;
+		/* symbolic links are not followed, so there are no loops */
+		if (lstat(path, &st) == -1)
+			continue;
+		if (S_ISDIR(st.st_mode)) {
+			if (!scan_walk(path, l)) {
+				closedir(d);
+				return 0;
+			}
+		} else if (S_ISREG(st.st_mode) && scan_is_srd(de->d_name)) {
+			if (l->n == l->max) {
+				l->max = l->max ? 2 * l->max : 256;
+				l->paths = xrealloc(l->paths, l->max, sizeof(*l->paths));
+			}
+			l->paths[l->n++] = xstrdup(path);
+		}
+	}
+	closedir(d);
+	return 1;
+}
+
+static int
+scan_path_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Find the .srd files in <dir> and all directories below it, sorted
+ * by name. Returns the number of files, or -1 on error.
+ */
+ssize_t
+scan_dir(const char *dir, char ***paths)
+{
+	struct scan_list l;
+
+	memset(&l, 0, sizeof(l));
+	if (!scan_walk(dir, &l)) {
+		scan_paths_free(l.paths, l.n);
+		return -1;
+	}
+	qsort(l.paths, l.n, sizeof(*l.paths), scan_path_cmp);
+	*paths = l.paths;
+	return l.n;
+}
+
+void
+scan_paths_free(char **paths, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		xfree(paths[i]);
+	if (paths != NULL)
+		xfree(paths);
+}
+
+/*
+ * Append <path> to the <n> entries of <paths>, or all workouts below
+ * it if it is a directory. Returns the new number of entries.
+ */
+size_t
+scan_add_path(const char *path, char ***paths, size_t n)
+{
+	struct stat st;
+	char **dir;
+	ssize_t m;
+	ssize_t i;
+
+	if (stat(path, &st) == -1)
+		fatal("%s", path);
+
+	if (S_ISDIR(st.st_mode)) {
+		if ((m = scan_dir(path, &dir)) == -1)
+			fatalx("%s: cannot read directory", path);
+		if (m == 0)
+			return n;
+		*paths = xrealloc(*paths, n + m, sizeof(**paths));
+		for (i = 0; i < m; i++)
+			(*paths)[n++] = dir[i];
+		xfree(dir);
+	} else {
+		*paths = xrealloc(*paths, n + 1, sizeof(**paths));
+		(*paths)[n++] = xstrdup(path);
+	}
+	return n;
+}
+
+/*
+ * Parse a command line number from 0 to INT_MAX. Returns -1 if <s> is
+ * not such a number.
+ */
+int
+scan_number(const char *s)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(s, &end, 10);
+	if (errno != 0 || *s == '\0' || *end != '\0' || v < 0 || v > INT_MAX)
+		return -1;
+	return v;
+}
+
+/* Move the back half of the range of another worker to <self>. */
+static int
+scan_steal(struct scan *s, struct scan_worker *self)
+{
+	struct scan_worker *v;
+	size_t n, mid, hi;
+	int k;
+
+	for (k = 1; k < s->nworkers; k++) {
+		v = &s->workers[(self->id + k) % s->nworkers];
+		pthread_mutex_lock(&v->lock);
+		n = v->hi - v->lo;
+		if (n == 0) {
+			pthread_mutex_unlock(&v->lock);
+			continue;
+		}
+		hi = v->hi;
+		mid = hi - (n + 1) / 2;
+		v->hi = mid;
+		pthread_mutex_unlock(&v->lock);
+
+		pthread_mutex_lock(&self->lock);
+		self->lo = mid;
+		self->hi = hi;
+		pthread_mutex_unlock(&self->lock);
+		return 1;
+	}
+	return 0;
+}
+
+static void
+scan_file(struct scan_worker *sw, size_t i)
+{
+	struct scan *s = sw->s;
+	const char *path = s->paths[i];
+	workout_t *w = NULL;
+	BUF *buf;
+
+	if ((buf = buf_load(path)) == NULL) {
+		log_error("%s: %s", path, strerror(errno));
+	} else {
+		w = workout_read_buf_arena(buf, S725_HRM_AUTO, s->what, sw->arena);
+		if (w == NULL)
+			log_info("%s: invalid file", path);
+		buf_free(buf);
+	}
+	s->fn(sw->id, i, path, w, s->arg);
+}
+
+static void *
+scan_worker(void *arg)
+{
+	struct scan_worker *sw = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&sw->lock);
+		if (sw->lo == sw->hi) {
+			pthread_mutex_unlock(&sw->lock);
+			if (!scan_steal(sw->s, sw))
+				break;
+			continue;
+		}
+		i = sw->lo++;
+		pthread_mutex_unlock(&sw->lock);
+		scan_file(sw, i);
+	}
+	return NULL;
+}
+
+/*
+ * Parse the parts given by <what> of the <n> files in <paths> on
+ * <threads> threads, or one per CPU if <threads> is 0, and call <fn>
+ * for each of them.
+ */
+void
+scan_run(char **paths, size_t n, int what, int threads,
+		 scan_fn fn, void *arg)
+{
+	struct scan s;
+	struct scan_worker *sw;
+	int i;
+
+	if (threads <= 0)
+		threads = scan_threads();
+	if (threads > n)
+		threads = n ? n : 1;
+
+	s.paths = paths;
+	s.what = what;
+	s.fn = fn;
+	s.arg = arg;
+	s.nworkers = threads;
+	s.workers = xcalloc(threads, sizeof(*s.workers));
+	for (i = 0; i < threads; i++) {
+		sw = &s.workers[i];
+		sw->s = &s;
+		sw->id = i;
+		sw->lo = n * i / threads;
+		sw->hi = n * (i + 1) / threads;
+		sw->arena = workout_arena_new();
+		pthread_mutex_init(&sw->lock, NULL);
+	}
+
+	/* the calling thread is worker 0 */
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&s.workers[i].thread, NULL, scan_worker,
+						   &s.workers[i]) != 0)
+			fatal("pthread_create");
+	}
+	scan_worker(&s.workers[0]);
+	for (i = 1; i < threads; i++)
+		pthread_join(s.workers[i].thread, NULL);
+
+	for (i = 0; i < threads; i++) {
+		pthread_mutex_destroy(&s.workers[i].lock);
+		workout_arena_free(s.workers[i].arena);
+	}
+	xfree(s.workers);
+}
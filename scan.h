@@ -0,0 +1,44 @@
+/* scan.h - parse many workouts on a pool of threads */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <sys/types.h>
+
+#include "workout.h"
+
+/*
+ * Called on worker thread <worker> for file <i> of the list. <w> is
+ * NULL if the file could not be read or parsed, otherwise it is only
+ * valid until the callback returns.
+ */
+typedef void (*scan_fn)(int worker, size_t i, const char *path,
+						workout_t *w, void *arg);
+
+int		 scan_threads(void);
+ssize_t	 scan_dir(const char *dir, char ***paths);
+void	 scan_paths_free(char **paths, size_t n);
+size_t	 scan_add_path(const char *path, char ***paths, size_t n);
+int		 scan_number(const char *s);
+void	 scan_run(char **paths, size_t n, int what, int threads,
+				  scan_fn fn, void *arg);
+
+#endif	/* SCAN_H */
@@ -32,6 +32,7 @@
 
 #include "driver_int.h"
 #include "log.h"
+#include "stats.h"
 #include "xmalloc.h"
 
 #define SERIAL_READ_TRIES 10
@@ -47,6 +48,7 @@ struct s725_driver_ops serial_driver_ops = {
 	.read_byte = serial_read_byte,
 	.write = serial_write,
 	.close = serial_close,
+	.reopen = NULL,
 };
 
 struct driver_private {
@@ -130,6 +132,7 @@ serial_init(struct s725_driver *d)
 
 	if (tcgetattr(fd, &t) == -1) {
 		log_error("%s: %s", d->path, strerror(errno));
+		close(fd);
 		return -1;
 	}
 
@@ -203,6 +206,7 @@ serial_close(struct s725_driver *d)
  	usleep(50000);
 	close(DP(d)->fd);
 	xfree(DP(d));
+	d->data = NULL;
 	return 0;
 }
 
@@ -227,6 +231,7 @@ serial_read_byte(struct s725_driver *d, unsigned char *byte)
 		if (nready == 0) {
 			r = 0;
 			log_debug("serial_read_byte: poll timeout");
+			stats_add(STATS_POLL_TIMEOUTS, 1);
 		}
 		if ((pfd[0].revents & (POLLERR|POLLNVAL))) {
 			r = 0;
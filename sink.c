@@ -0,0 +1,279 @@
+/* sink.c - output sinks for the writers */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * A sink collects output in a buffer of SINK_BUFSIZ bytes and hands
+ * it on in one piece when the buffer is full or the sink is flushed:
+ * appended to a BUF, written to a file descriptor or a FILE, or
+ * passed to a callback. Formatted output goes straight into the
+ * buffer, without stdio in between. After the first error the sink
+ * drops all output, and sink_flush() and sink_close() return -1.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "sink.h"
+#include "stats.h"
+#include "xmalloc.h"
+
+enum {
+	SINK_BUF,
+	SINK_FD,
+	SINK_FILE,
+	SINK_CALLBACK
+};
+
+struct sink {
+	int				 type;
+	BUF				*buf;
+	int				 fd;
+	FILE			*fp;
+	sink_write_fn	 fn;
+	void			*ctx;
+	int				 error;
+	size_t			 len;
+	char			 data[SINK_BUFSIZ];
+};
+
+/* Returns NULL if there is not enough memory. */
+static SINK *
+sink_new(int type)
+{
+	SINK *s;
+
+	if ((s = hmalloc(sizeof(*s))) == NULL)
+		return NULL;
+	stats_add(STATS_ALLOCS, 1);
+	s->type = type;
+	s->buf = NULL;
+	s->fd = -1;
+	s->fp = NULL;
+	s->fn = NULL;
+	s->ctx = NULL;
+	s->error = 0;
+	s->len = 0;
+	return s;
+}
+
+static SINK *
+sink_xnew(int type)
+{
+	SINK *s;
+
+	if ((s = sink_new(type)) == NULL)
+		errx(1, "sink_new: out of memory");
+	return s;
+}
+
+/* Append the output to <b>. */
+SINK *
+sink_buf(BUF *b)
+{
+	SINK *s = sink_xnew(SINK_BUF);
+
+	s->buf = b;
+	return s;
+}
+
+/* Write the output to <fd>, which is left open by sink_close(). */
+SINK *
+sink_fd(int fd)
+{
+	SINK *s = sink_xnew(SINK_FD);
+
+	s->fd = fd;
+	return s;
+}
+
+/* Write the output to <fp>, which is left open by sink_close(). */
+SINK *
+sink_file(FILE *fp)
+{
+	SINK *s = sink_xnew(SINK_FILE);
+
+	s->fp = fp;
+	return s;
+}
+
+/*
+ * Pass the output to <fn> with <ctx> as first argument. Unlike the
+ * other sinks, returns NULL if there is not enough memory, since the
+ * library uses it.
+ */
+SINK *
+sink_callback(sink_write_fn fn, void *ctx)
+{
+	SINK *s;
+
+	if ((s = sink_new(SINK_CALLBACK)) == NULL)
+		return NULL;
+	s->fn = fn;
+	s->ctx = ctx;
+	return s;
+}
+
+/* Hand <len> bytes at <data> to the destination of <s>. */
+static int
+sink_emit(SINK *s, const void *data, size_t len)
+{
+	const char *p = data;
+	ssize_t n;
+
+	if (s->error)
+		return -1;
+
+	switch (s->type) {
+	case SINK_BUF:
+		buf_append(s->buf, data, len);
+		break;
+	case SINK_FD:
+		while (len > 0) {
+			if ((n = write(s->fd, p, len)) == -1) {
+				if (errno == EINTR)
+					continue;
+				s->error = 1;
+				return -1;
+			}
+			p += n;
+			len -= n;
+		}
+		break;
+	case SINK_FILE:
+		if (len > 0 && fwrite(data, len, 1, s->fp) != 1)
+			s->error = 1;
+		break;
+	case SINK_CALLBACK:
+		if (len > 0 && s->fn(s->ctx, data, len) == -1)
+			s->error = 1;
+		break;
+	}
+
+	return s->error ? -1 : 0;
+}
+
+int
+sink_flush(SINK *s)
+{
+	if (s->len > 0) {
+		sink_emit(s, s->data, s->len);
+		s->len = 0;
+	}
+	if (s->type == SINK_FILE && !s->error && fflush(s->fp) == EOF)
+		s->error = 1;
+	return s->error ? -1 : 0;
+}
+
+int
+sink_write(SINK *s, const void *data, size_t len)
+{
+	if (s->len + len > sizeof(s->data)) {
+		if (sink_flush(s) == -1)
+			return -1;
+		/* too large to buffer, pass it on as it is */
+		if (len > sizeof(s->data))
+			return sink_emit(s, data, len);
+	}
+	memcpy(s->data + s->len, data, len);
+	s->len += len;
+	return s->error ? -1 : 0;
+}
+
+int
+sink_puts(SINK *s, const char *str)
+{
+	return sink_write(s, str, strlen(str));
+}
+
+int
+sink_putc(SINK *s, int c)
+{
+	if (s->len == sizeof(s->data) && sink_flush(s) == -1)
+		return -1;
+	s->data[s->len++] = c;
+	return s->error ? -1 : 0;
+}
+
+int
+sink_printf(SINK *s, const char *fmt, ...)
+{
+	va_list ap;
+	char *p;
+	int n;
+
+	/* format in place, if it does not fit try again in an empty buffer */
+	va_start(ap, fmt);
+	n = vsnprintf(s->data + s->len, sizeof(s->data) - s->len, fmt, ap);
+	va_end(ap);
+	if (n < 0) {
+		s->error = 1;
+		return -1;
+	}
+	if (n < sizeof(s->data) - s->len) {
+		s->len += n;
+		return s->error ? -1 : 0;
+	}
+
+	if (sink_flush(s) == -1)
+		return -1;
+	if (n < sizeof(s->data)) {
+		va_start(ap, fmt);
+		vsnprintf(s->data, sizeof(s->data), fmt, ap);
+		va_end(ap);
+		s->len = n;
+		return 0;
+	}
+
+	va_start(ap, fmt);
+	n = vasprintf(&p, fmt, ap);
+	va_end(ap);
+	if (n < 0) {
+		s->error = 1;
+		return -1;
+	}
+	sink_emit(s, p, n);
+	free(p);
+	return s->error ? -1 : 0;
+}
+
+int
+sink_error(SINK *s)
+{
+	return s->error;
+}
+
+/* Flush and free <s>. Returns -1 if any output was lost. */
+int
+sink_close(SINK *s)
+{
+	int ret;
+
+	ret = sink_flush(s);
+	hfree(s);
+	return ret;
+}
@@ -0,0 +1,50 @@
+/* sink.h - output sinks for the writers */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SINK_H
+#define SINK_H
+
+#include <sys/types.h>
+
+#include <stdio.h>
+
+#include "buf.h"
+
+#define SINK_BUFSIZ	65536
+
+typedef struct sink SINK;
+
+/* called with each chunk of output, returns 0, or -1 on error */
+typedef int (*sink_write_fn)(void *ctx, const void *data, size_t len);
+
+SINK	*sink_buf(BUF *b);
+SINK	*sink_fd(int fd);
+SINK	*sink_file(FILE *fp);
+SINK	*sink_callback(sink_write_fn fn, void *ctx);
+int		 sink_write(SINK *s, const void *data, size_t len);
+int		 sink_puts(SINK *s, const char *str);
+int		 sink_putc(SINK *s, int c);
+int		 sink_printf(SINK *s, const char *fmt, ...)
+			__attribute__((__format__ (printf, 2, 3)));
+int		 sink_flush(SINK *s);
+int		 sink_error(SINK *s);
+int		 sink_close(SINK *s);
+
+#endif	/* SINK_H */
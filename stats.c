@@ -0,0 +1,196 @@
+/* stats.c - timing and counters */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* the functions are defined here, callers use the macros from stats.h */
+#undef stats_begin
+#undef stats_end
+#undef stats_add
+
+struct span {
+	uint64_t	 count;
+	uint64_t	 total;			/* nanoseconds */
+	uint64_t	 max;
+};
+
+static const char *span_names[STATS_NSPANS] = {
+	"driver_open",
+	"driver_close",
+	"driver_write",
+	"driver_read",
+	"packet_recv",
+	"files_transfer",
+	"workout_read",
+	"workout_print_txt",
+	"workout_print_hrm",
+	"workout_print_tcx",
+	"file_write",
+};
+
+static const char *counter_names[STATS_NCOUNTERS] = {
+	"bytes_sent",
+	"bytes_received",
+	"packets",
+	"crc_errors",
+	"retries",
+	"poll_timeouts",
+	"allocations",
+};
+
+int stats_enabled;
+
+static int stats_format;
+static struct span spans[STATS_NSPANS];
+static uint64_t counters[STATS_NCOUNTERS];
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Start collecting, the report is written on exit. */
+void
+stats_enable(int format)
+{
+	if (stats_enabled)
+		return;
+
+	stats_enabled = 1;
+	if (stats_format == STATS_NONE && format != STATS_NONE)
+		atexit(stats_report);
+	stats_format = format;
+}
+
+/* Stop collecting, the numbers so far are kept. */
+void
+stats_disable(void)
+{
+	stats_enabled = 0;
+}
+
+uint64_t
+stats_get(int counter)
+{
+	uint64_t n;
+
+	pthread_mutex_lock(&stats_lock);
+	n = counters[counter];
+	pthread_mutex_unlock(&stats_lock);
+
+	return n;
+}
+
+/* Get a timestamp for the start of a span, never 0. */
+uint64_t
+stats_begin(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+}
+
+void
+stats_end(int span, uint64_t begin)
+{
+	uint64_t d;
+
+	d = stats_begin() - begin;
+
+	pthread_mutex_lock(&stats_lock);
+	spans[span].count++;
+	spans[span].total += d;
+	if (d > spans[span].max)
+		spans[span].max = d;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void
+stats_add(int counter, uint64_t n)
+{
+	pthread_mutex_lock(&stats_lock);
+	counters[counter] += n;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void
+stats_report_text(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "%-20s %10s %12s %12s %12s\n",
+			"span", "count", "total ms", "avg us", "max us");
+	for (i = 0; i < STATS_NSPANS; i++) {
+		if (spans[i].count == 0)
+			continue;
+		fprintf(fp, "%-20s %10llu %12.3f %12.1f %12.1f\n", span_names[i],
+				(unsigned long long)spans[i].count,
+				spans[i].total / 1e6,
+				spans[i].total / 1e3 / spans[i].count,
+				spans[i].max / 1e3);
+	}
+
+	fprintf(fp, "%-20s %10s\n", "counter", "value");
+	for (i = 0; i < STATS_NCOUNTERS; i++) {
+		fprintf(fp, "%-20s %10llu\n", counter_names[i],
+				(unsigned long long)counters[i]);
+	}
+}
+
+static void
+stats_report_json(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "{\"spans\": {");
+	for (i = 0; i < STATS_NSPANS; i++) {
+		fprintf(fp, "%s\n  \"%s\": {\"count\": %llu, \"total_ns\": %llu, "
+				"\"max_ns\": %llu}", i ? "," : "", span_names[i],
+				(unsigned long long)spans[i].count,
+				(unsigned long long)spans[i].total,
+				(unsigned long long)spans[i].max);
+	}
+	fprintf(fp, "},\n\"counters\": {");
+	for (i = 0; i < STATS_NCOUNTERS; i++) {
+		fprintf(fp, "%s\n  \"%s\": %llu", i ? "," : "", counter_names[i],
+				(unsigned long long)counters[i]);
+	}
+	fprintf(fp, "}}\n");
+}
+
+/*
+ * Write the report, as text to stderr or as JSON to stdout so it can
+ * be redirected separately from the progress output.
+ */
+void
+stats_report(void)
+{
+	if (stats_format == STATS_NONE)
+		return;
+
+	pthread_mutex_lock(&stats_lock);
+	if (stats_format == STATS_JSON)
+		stats_report_json(stdout);
+	else
+		stats_report_text(stderr);
+	pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,77 @@
+/* stats.h - timing and counters */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* timed spans */
+enum {
+	STATS_DRIVER_OPEN,
+	STATS_DRIVER_CLOSE,
+	STATS_DRIVER_WRITE,
+	STATS_DRIVER_READ,
+	STATS_PACKET_RECV,
+	STATS_FILES_TRANSFER,
+	STATS_WORKOUT_READ,
+	STATS_PRINT_TXT,
+	STATS_PRINT_HRM,
+	STATS_PRINT_TCX,
+	STATS_FILE_WRITE,
+	STATS_NSPANS
+};
+
+/* counters */
+enum {
+	STATS_BYTES_SENT,
+	STATS_BYTES_RECEIVED,
+	STATS_PACKETS,
+	STATS_CRC_ERRORS,
+	STATS_RETRIES,
+	STATS_POLL_TIMEOUTS,
+	STATS_ALLOCS,
+	STATS_NCOUNTERS
+};
+
+/* report formats */
+#define STATS_NONE	0		/* collect only */
+#define STATS_TEXT	1
+#define STATS_JSON	2
+
+extern int stats_enabled;
+
+void		 stats_enable(int format);
+void		 stats_disable(void);
+uint64_t	 stats_get(int counter);
+uint64_t	 stats_begin(void);
+void		 stats_end(int span, uint64_t begin);
+void		 stats_add(int counter, uint64_t n);
+void		 stats_report(void);
+
+/*
+ * Nothing is measured and no clock is read unless stats_enable() was
+ * called, stats_begin() then returns 0 and stats_end() does nothing.
+ */
+#define stats_begin()	(stats_enabled ? stats_begin() : 0)
+#define stats_end(s, t)	do { if (t) stats_end(s, t); } while (0)
+#define stats_add(c, n)	do { if (stats_enabled) stats_add(c, n); } while (0)
+
+#endif	/* STATS_H */
@@ -0,0 +1,583 @@
+/* bench.c - benchmark for the parser and the writers */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Times each stage of reading and writing a workout for every file
+ * given on the command line, plus a synthetic copy of each file that
+ * is grown to the largest size a watch can store by repeating its
+ * samples, and the largest workout srdgen can build for each model
+ * with all recording modes and 99 laps. Every stage runs until at
+ * least BENCH_MIN_NS have passed.
+ * workout_read_cached takes the same workout from a warm cache file,
+ * compare it with workout_read_buf_arena for the cold parse.
+ * Allocations are counted in a separate run with the stats module
+ * enabled, so the counting does not affect the timing. Finally a
+ * directory of generated workouts is scanned with scan_run on a
+ * growing number of threads, to show how the scan scales, and with
+ * a cold and a warm cache.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "cache.h"
+#include "log.h"
+#include "scan.h"
+#include "srdgen.h"
+#include "stats.h"
+#include "workout.h"
+#include "workout_int.h"
+#include "workout_print.h"
+
+#define BENCH_MIN_NS	200000000ULL
+#define BENCH_MAX_SIZE	65535
+#define BENCH_SCAN_FILES	512
+
+struct bench_ctx {
+	const char	*path;			/* file on disk */
+	BUF			*buf;
+	workout_t	*w;
+	workout_arena_t	*arena;
+	CACHE		*cache;			/* holds the workout */
+	SINK		*out;
+};
+
+struct bench_op {
+	const char	*name;
+	void		(*fn)(struct bench_ctx *);
+};
+
+static int opt_json;
+static int nresults;
+
+static void
+op_buf_load(struct bench_ctx *c)
+{
+	BUF *b;
+
+	if ((b = buf_load(c->path)) == NULL)
+		fatal("%s", c->path);
+	buf_free(b);
+}
+
+static void
+op_read_buf(struct bench_ctx *c)
+{
+	workout_free(workout_read_buf(c->buf, S725_HRM_AUTO, S725_WORKOUT_FULL));
+}
+
+static void
+op_read_buf_arena(struct bench_ctx *c)
+{
+	if (workout_read_buf_arena(c->buf, S725_HRM_AUTO, S725_WORKOUT_FULL,
+							   c->arena) == NULL)
+		fatalx("workout_read_buf_arena failed");
+}
+
+static void
+op_read_cached(struct bench_ctx *c)
+{
+	workout_set_cache(c->cache);
+	if (workout_read_buf_arena(c->buf, S725_HRM_AUTO, S725_WORKOUT_FULL,
+							   c->arena) == NULL)
+		fatalx("workout_read_buf_arena failed");
+	workout_set_cache(NULL);
+}
+
+static void
+op_read_header(struct bench_ctx *c)
+{
+	if (workout_read_buf_arena(c->buf, S725_HRM_AUTO, S725_WORKOUT_HEADER,
+							   c->arena) == NULL)
+		fatalx("workout_read_buf_arena failed");
+}
+
+/* the arrays belong to the workout, so the stages parse into them again */
+static void
+op_read_laps(struct bench_ctx *c)
+{
+	if (!workout_read_laps(c->w, c->buf))
+		fatalx("workout_read_laps failed");
+}
+
+static void
+op_read_samples(struct bench_ctx *c)
+{
+	if (!workout_read_samples(c->w, c->buf))
+		fatalx("workout_read_samples failed");
+}
+
+static void
+op_print_txt(struct bench_ctx *c)
+{
+	workout_print_txt(c->w, c->out, S725_WORKOUT_FULL);
+}
+
+static void
+op_print_hrm(struct bench_ctx *c)
+{
+	workout_print_hrm(c->w, c->out);
+}
+
+static void
+op_print_tcx(struct bench_ctx *c)
+{
+	workout_print_tcx(c->w, c->out);
+}
+
+static struct bench_op ops[] = {
+	{ "buf_load",                op_buf_load },
+	{ "workout_read_buf",        op_read_buf },
+	{ "workout_read_buf_arena",  op_read_buf_arena },
+	{ "workout_read_cached",     op_read_cached },
+	{ "workout_read_header",     op_read_header },
+	{ "workout_read_laps",       op_read_laps },
+	{ "workout_read_samples",    op_read_samples },
+	{ "workout_print_txt",       op_print_txt },
+	{ "workout_print_hrm",       op_print_hrm },
+	{ "workout_print_tcx",       op_print_tcx },
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Print <s> as a JSON string, labels hold file names. */
+static void
+print_json_string(const char *s)
+{
+	const unsigned char *p;
+
+	putchar('"');
+	for (p = (const unsigned char *)s; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\')
+			printf("\\%c", *p);
+		else if (*p < 0x20)
+			printf("\\u%04x", *p);
+		else
+			putchar(*p);
+	}
+	putchar('"');
+}
+
+static void
+bench_op(struct bench_ctx *c, const char *label, struct bench_op *op)
+{
+	uint64_t start, elapsed;
+	uint64_t allocs;
+	uint64_t iter = 0;
+	uint64_t batch = 1;
+	uint64_t i;
+	double ns, mbs;
+
+	/* count allocations of a single run, after one to warm up caches */
+	op->fn(c);
+	stats_enable(STATS_NONE);
+	allocs = stats_get(STATS_ALLOCS);
+	op->fn(c);
+	allocs = stats_get(STATS_ALLOCS) - allocs;
+	stats_disable();
+
+	start = now_ns();
+	do {
+		for (i = 0; i < batch; i++)
+			op->fn(c);
+		iter += batch;
+		batch *= 2;
+		elapsed = now_ns() - start;
+	} while (elapsed < BENCH_MIN_NS);
+
+	ns = (double)elapsed / iter;
+	mbs = buf_len(c->buf) / ns * 1e9 / (1024 * 1024);
+
+	if (opt_json) {
+		printf("%s\n  {\"file\": ", nresults ? "," : "");
+		print_json_string(label);
+		printf(", \"op\": \"%s\", \"bytes\": %zu, "
+			   "\"iterations\": %llu, \"ns_per_op\": %.1f, \"mb_per_s\": %.2f, "
+			   "\"allocs_per_op\": %llu}", op->name,
+			   buf_len(c->buf), (unsigned long long)iter, ns, mbs,
+			   (unsigned long long)allocs);
+	} else {
+		printf("%-32s %-24s %6zu %12.1f %10.2f %8llu\n", label, op->name,
+			   buf_len(c->buf), ns / 1000, mbs, (unsigned long long)allocs);
+	}
+	nresults++;
+}
+
+/* Create an empty file for a cache and return its name. */
+static char *
+temp_cache(void)
+{
+	static char tmp[] = "/tmp/s725cache.XXXXXX";
+	char *name;
+	int fd;
+
+	if ((name = strdup(tmp)) == NULL || (fd = mkstemp(name)) == -1)
+		fatal("mkstemp");
+	close(fd);
+	return name;
+}
+
+static void
+bench_file(const char *path, const char *label)
+{
+	struct bench_ctx c;
+	char *cache_name;
+	int i, fd;
+
+	c.path = path;
+	if ((c.buf = buf_load(path)) == NULL)
+		fatal("%s", path);
+	if ((c.w = workout_read_buf(c.buf, S725_HRM_AUTO, S725_WORKOUT_FULL)) == NULL)
+		fatalx("%s: invalid file", path);
+	if ((fd = open("/dev/null", O_WRONLY)) == -1)
+		fatal("/dev/null");
+	c.out = sink_fd(fd);
+	if ((c.arena = workout_arena_new()) == NULL)
+		fatalx("workout_arena_new failed");
+
+	/* entries added to a cache are found after opening it again */
+	cache_name = temp_cache();
+	if ((c.cache = cache_open(cache_name)) == NULL)
+		fatalx("%s: cache_open failed", cache_name);
+	op_read_cached(&c);
+	cache_close(c.cache);
+	if ((c.cache = cache_open(cache_name)) == NULL)
+		fatalx("%s: cache_open failed", cache_name);
+
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+		bench_op(&c, label, &ops[i]);
+
+	sink_close(c.out);
+	close(fd);
+	cache_close(c.cache);
+	unlink(cache_name);
+	free(cache_name);
+	workout_arena_free(c.arena);
+	workout_free(c.w);
+	buf_free(c.buf);
+}
+
+/* Write <b> to a temporary file and return its name. */
+static char *
+write_temp(BUF *b)
+{
+	static char tmp[] = "/tmp/s725bench.XXXXXX";
+	char *name;
+	FILE *f;
+	int fd;
+
+	if ((name = strdup(tmp)) == NULL || (fd = mkstemp(name)) == -1)
+		fatal("mkstemp");
+	if ((f = fdopen(fd, "w")) == NULL ||
+		fwrite(buf_get(b), buf_len(b), 1, f) != 1 || fclose(f) != 0)
+		fatal("%s", name);
+	return name;
+}
+
+/*
+ * Write a copy of <path> with the sample data repeated up to the
+ * maximum file size to a temporary file. Samples are stored after
+ * the header and the laps, so they can be appended at the end.
+ */
+static char *
+make_synthetic(const char *path)
+{
+	char *name;
+	BUF *in, *out;
+	workout_t *w;
+	size_t start, len, ssize;
+
+	if ((in = buf_load(path)) == NULL)
+		fatal("%s", path);
+	if ((w = workout_read_buf(in, S725_HRM_AUTO, S725_WORKOUT_FULL)) == NULL)
+		fatalx("%s: invalid file", path);
+
+	/* the samples follow the header and the laps */
+	ssize = workout_bytes_per_sample(w->mode);
+	start = workout_header_size(w) +
+		w->laps * workout_bytes_per_lap(w->type, w->mode, w->interval_mode);
+	len = (size_t)w->samples * ssize;
+	workout_free(w);
+
+	out = buf_alloc(BENCH_MAX_SIZE);
+	buf_append(out, buf_get(in), start + len);
+	while (len > 0 && buf_len(out) + len <= BENCH_MAX_SIZE)
+		buf_append(out, buf_get(in) + start, len);
+	buf_get(out)[0] = buf_len(out) & 0xff;
+	buf_get(out)[1] = buf_len(out) >> 8;
+
+	name = write_temp(out);
+	buf_free(out);
+	buf_free(in);
+	return name;
+}
+
+/* Write the largest workout that fits for <type> to a temporary file. */
+static char *
+make_generated(S725_HRM_Type type)
+{
+	struct srdgen g;
+	char *name;
+	BUF *b;
+
+	srdgen_init(&g, type);
+	if (type != S725_HRM_S610)
+		g.mode = S725_MODE_ALTITUDE | S725_MODE_CADENCE |
+			S725_MODE_POWER | S725_MODE_SPEED1;
+	g.laps = SRDGEN_MAX_LAPS;
+	g.duration = srdgen_max_duration(&g);
+	if ((b = srdgen(&g)) == NULL)
+		fatalx("srdgen failed");
+	name = write_temp(b);
+	buf_free(b);
+	return name;
+}
+
+static void
+scan_nop(int worker, size_t i, const char *path, workout_t *w, void *arg)
+{
+}
+
+static void
+scan_result(const char *label, const char *op, size_t bytes, uint64_t iter,
+			uint64_t elapsed, int threads)
+{
+	if (opt_json) {
+		printf("%s\n  {\"file\": ", nresults ? "," : "");
+		print_json_string(label);
+		printf(", \"op\": \"%s\", \"bytes\": %zu, "
+			   "\"iterations\": %llu, \"ns_per_op\": %.1f, \"mb_per_s\": %.2f, "
+			   "\"threads\": %d}", op, bytes,
+			   (unsigned long long)iter, (double)elapsed / iter,
+			   bytes / ((double)elapsed / iter) * 1e9 / (1024 * 1024),
+			   threads);
+	} else {
+		printf("%-32s %-24s %6zu %12.1f %10.2f %8s\n", label, op, bytes,
+			   (double)elapsed / iter / 1000,
+			   bytes / ((double)elapsed / iter) * 1e9 / (1024 * 1024), "-");
+	}
+	nresults++;
+}
+
+/*
+ * Time scan_run over BENCH_SCAN_FILES generated workouts with 1, 2,
+ * 4, ... threads up to the number of CPUs.
+ */
+static void
+bench_scan(void)
+{
+	static const S725_HRM_Type types[] = {
+		S725_HRM_S610, S725_HRM_S625, S725_HRM_S725
+	};
+	static const struct {
+		const char	*name;
+		int			 what;
+	} parts[] = {
+		{ "header",                  S725_WORKOUT_HEADER },
+		{ "full",                    S725_WORKOUT_FULL },
+	};
+	char dir[] = "/tmp/s725scan.XXXXXX";
+	char path[PATH_MAX];
+	char op[64];
+	char label[64];
+	struct srdgen g;
+	uint64_t start, elapsed, iter;
+	size_t bytes = 0;
+	char **paths;
+	char *cache_name;
+	CACHE *cache;
+	ssize_t n;
+	int threads, maxthreads;
+	int i, p;
+	FILE *f;
+	BUF *b;
+
+	if (mkdtemp(dir) == NULL)
+		fatal("mkdtemp");
+	for (i = 0; i < BENCH_SCAN_FILES; i++) {
+		srdgen_init(&g, types[i % 3]);
+		g.laps = 1 + i % 10;
+		g.seed = i;
+		if ((b = srdgen(&g)) == NULL)
+			fatalx("srdgen failed");
+		snprintf(path, sizeof(path), "%s/%04d.srd", dir, i);
+		if ((f = fopen(path, "w")) == NULL ||
+			fwrite(buf_get(b), buf_len(b), 1, f) != 1 || fclose(f) != 0)
+			fatal("%s", path);
+		bytes += buf_len(b);
+		buf_free(b);
+	}
+	if ((n = scan_dir(dir, &paths)) != BENCH_SCAN_FILES)
+		fatalx("%s: scan_dir failed", dir);
+
+	snprintf(label, sizeof(label), "archive (%d files)", BENCH_SCAN_FILES);
+	maxthreads = scan_threads();
+	for (p = 0; p < sizeof(parts) / sizeof(parts[0]); p++) {
+		for (threads = 1; ; threads *= 2) {
+			if (threads > maxthreads)
+				threads = maxthreads;
+			iter = 0;
+			start = now_ns();
+			do {
+				scan_run(paths, n, parts[p].what, threads, scan_nop, NULL);
+				iter++;
+				elapsed = now_ns() - start;
+			} while (elapsed < BENCH_MIN_NS);
+			snprintf(op, sizeof(op), "scan_run %s %dt", parts[p].name, threads);
+			scan_result(label, op, bytes, iter, elapsed, threads);
+			if (threads == maxthreads)
+				break;
+		}
+	}
+
+	/* a cold cache is filled by the scan, a warm one holds every workout */
+	cache_name = temp_cache();
+	iter = 0;
+	start = now_ns();
+	do {
+		if (truncate(cache_name, 0) == -1)
+			fatal("%s", cache_name);
+		if ((cache = cache_open(cache_name)) == NULL)
+			fatalx("%s: cache_open failed", cache_name);
+		workout_set_cache(cache);
+		scan_run(paths, n, S725_WORKOUT_FULL, maxthreads, scan_nop, NULL);
+		workout_set_cache(NULL);
+		cache_close(cache);
+		iter++;
+		elapsed = now_ns() - start;
+	} while (elapsed < BENCH_MIN_NS);
+	snprintf(op, sizeof(op), "scan_run cold cache %dt", maxthreads);
+	scan_result(label, op, bytes, iter, elapsed, maxthreads);
+
+	if ((cache = cache_open(cache_name)) == NULL)
+		fatalx("%s: cache_open failed", cache_name);
+	workout_set_cache(cache);
+	iter = 0;
+	start = now_ns();
+	do {
+		scan_run(paths, n, S725_WORKOUT_FULL, maxthreads, scan_nop, NULL);
+		iter++;
+		elapsed = now_ns() - start;
+	} while (elapsed < BENCH_MIN_NS);
+	workout_set_cache(NULL);
+	cache_close(cache);
+	snprintf(op, sizeof(op), "scan_run warm cache %dt", maxthreads);
+	scan_result(label, op, bytes, iter, elapsed, maxthreads);
+
+	unlink(cache_name);
+	free(cache_name);
+
+	for (i = 0; i < n; i++)
+		unlink(paths[i]);
+	scan_paths_free(paths, n);
+	rmdir(dir);
+}
+
+static void
+usage(void)
+{
+	printf("usage: bench [-hj] file ...\n");
+	printf("        -j             JSON output\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	char label[PATH_MAX];
+	static const struct {
+		const char		*name;
+		S725_HRM_Type	 type;
+	} models[] = {
+		{ "S610",                    S725_HRM_S610 },
+		{ "S625",                    S725_HRM_S625 },
+		{ "S725",                    S725_HRM_S725 },
+	};
+	char *synth;
+	int ch;
+	int i;
+
+	while ((ch = getopt(argc, argv, "hj")) != -1) {
+		switch (ch) {
+		case 'j':
+			opt_json = 1;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) {
+		usage();
+		return 1;
+	}
+
+	if (opt_json)
+		printf("{\"results\": [");
+	else
+		printf("%-32s %-24s %6s %12s %10s %8s\n", "file", "op", "bytes",
+			   "us/op", "MB/s", "allocs");
+
+	for (i = 0; i < argc; i++) {
+		bench_file(argv[i], argv[i]);
+
+		synth = make_synthetic(argv[i]);
+		snprintf(label, sizeof(label), "%s (synthetic)", argv[i]);
+		bench_file(synth, label);
+		unlink(synth);
+		free(synth);
+	}
+
+	for (i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+		synth = make_generated(models[i].type);
+		snprintf(label, sizeof(label), "generated %s (99 laps)", models[i].name);
+		bench_file(synth, label);
+		unlink(synth);
+		free(synth);
+	}
+
+	bench_scan();
+
+	if (opt_json)
+		printf("\n]}\n");
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/* fuzz.c - fuzz target for the workout parser and writers */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The target patches the size field, parses the header of the input
+ * with automatic type detection, decodes the rest, which must work
+ * once the header parsed, and writes it with every writer. The input
+ * is parsed again in one go with the detected type given explicitly
+ * into a reused arena, which must work as well, and both text outputs
+ * must be the same. Any difference aborts, so libFuzzer and the
+ * standalone driver in fuzz_main.c treat it like a crash.
+ */
+
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "fuzz.h"
+#include "log.h"
+#include "workout.h"
+#include "workout_int.h"
+#include "workout_print.h"
+
+#define FUZZ_MAX_SIZE	65535
+
+const char *fuzz_op_names[FUZZ_NOPS] = {
+	"workout_read_buf",
+	"workout_print_txt",
+	"workout_print_hrm",
+	"workout_print_tcx",
+};
+
+static SINK *fuzz_null;
+static workout_arena_t *fuzz_arena;	/* reused by every input */
+
+uint64_t
+fuzz_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+fuzz_init(void)
+{
+	int fd;
+
+	if (fuzz_null != NULL)
+		return;
+	/* invalid input makes the parser complain a lot */
+	log_open("/dev/null");
+	if ((fd = open("/dev/null", O_WRONLY)) == -1)
+		fatal("/dev/null");
+	fuzz_null = sink_fd(fd);
+	if ((fuzz_arena = workout_arena_new()) == NULL)
+		fatalx("workout_arena_new failed");
+}
+
+/* Write the text output of <w> to memory. */
+static char *
+print_txt(workout_t *w, size_t *len)
+{
+	SINK *out;
+	BUF *b;
+
+	b = buf_alloc(0);
+	out = sink_buf(b);
+	workout_print_txt(w, out, S725_WORKOUT_FULL);
+	if (sink_close(out) == -1)
+		fatalx("sink_close failed");
+	*len = buf_len(b);
+	return buf_release(b);
+}
+
+/* Parse <buf> again with the detected type and compare the results. */
+static void
+check_explicit_type(BUF *buf, workout_t *w, const char *txt, size_t len)
+{
+	workout_t *x;
+	char *s;
+	size_t l;
+
+	x = workout_read_buf_arena(buf, w->type, S725_WORKOUT_FULL, fuzz_arena);
+	if (x == NULL) {
+		fprintf(stderr, "fuzz: detected type %d, explicit type fails\n",
+				w->type);
+		abort();
+	}
+	s = print_txt(x, &l);
+	if (x->samples != w->samples || x->laps != w->laps ||
+		x->mode != w->mode || l != len || memcmp(s, txt, len) != 0) {
+		fprintf(stderr, "fuzz: detected type %d, explicit type differs\n",
+				w->type);
+		abort();
+	}
+	free(s);
+}
+
+/*
+ * Run one input. Returns 1 if it parsed. If <t> is not NULL, the time
+ * of each operation is stored there.
+ */
+int
+fuzz_one(const uint8_t *data, size_t size, struct fuzz_times *t)
+{
+	struct fuzz_times dummy;
+	workout_t *w;
+	uint64_t start;
+	char *txt;
+	size_t len;
+	BUF *buf;
+
+	if (t == NULL)
+		t = &dummy;
+	memset(t, 0, sizeof(*t));
+	if (size < 2 || size > FUZZ_MAX_SIZE)
+		return 0;
+
+	fuzz_init();
+
+	/* a wrong size field is rejected right away, so fix it up */
+	buf = buf_alloc(size);
+	buf_append(buf, data, size);
+	buf_get(buf)[0] = size & 0xff;
+	buf_get(buf)[1] = size >> 8;
+
+	start = fuzz_now();
+	w = workout_read_buf(buf, S725_HRM_AUTO, S725_WORKOUT_HEADER);
+	/* every input that passes the header check can be decoded */
+	if (w != NULL && !workout_load(w, S725_WORKOUT_FULL)) {
+		fprintf(stderr, "fuzz: header parses, the rest cannot be decoded\n");
+		abort();
+	}
+	t->ns[FUZZ_READ] = fuzz_now() - start;
+	if (w == NULL) {
+		buf_free(buf);
+		return 0;
+	}
+
+	start = fuzz_now();
+	txt = print_txt(w, &len);
+	t->ns[FUZZ_PRINT_TXT] = fuzz_now() - start;
+
+	start = fuzz_now();
+	workout_print_hrm(w, fuzz_null);
+	t->ns[FUZZ_PRINT_HRM] = fuzz_now() - start;
+
+	start = fuzz_now();
+	workout_print_tcx(w, fuzz_null);
+	t->ns[FUZZ_PRINT_TCX] = fuzz_now() - start;
+
+	check_explicit_type(buf, w, txt, len);
+
+	free(txt);
+	workout_free(w);
+	buf_free(buf);
+	return 1;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	fuzz_one(data, size, NULL);
+	return 0;
+}
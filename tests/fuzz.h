@@ -0,0 +1,49 @@
+/* fuzz.h - fuzz target for the workout parser and writers */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+enum fuzz_op {
+	FUZZ_READ,
+	FUZZ_PRINT_TXT,
+	FUZZ_PRINT_HRM,
+	FUZZ_PRINT_TCX,
+	FUZZ_NOPS
+};
+
+/* time spent in each operation, 0 if it did not run */
+struct fuzz_times {
+	uint64_t	ns[FUZZ_NOPS];
+};
+
+extern const char *fuzz_op_names[FUZZ_NOPS];
+
+void	 fuzz_init(void);
+int		 fuzz_one(const uint8_t *data, size_t size, struct fuzz_times *t);
+uint64_t fuzz_now(void);
+
+int		 LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif	/* FUZZ_H */
@@ -0,0 +1,423 @@
+/* fuzz_main.c - standalone driver for the fuzz target */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Runs the fuzz target on a corpus of files and on mutations of them,
+ * for builds without libFuzzer. The time of every operation is
+ * measured per input byte and compared with the slowest seed; inputs
+ * that are much slower hint at work that grows faster than the input,
+ * such as nested loops over laps and samples. Such inputs, inputs
+ * that crash or fail the differential check and inputs that run
+ * longer than the timeout are saved for reproduction.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "fuzz.h"
+#include "log.h"
+
+#define FUZZ_MAX_SIZE	65535
+#define FUZZ_MAX_SEEDS	1024
+#define FUZZ_REPEAT		3
+
+struct seed {
+	char	*name;
+	BUF		*buf;
+};
+
+static struct seed seeds[FUZZ_MAX_SEEDS];
+static int nseeds;
+
+/* input that is running, saved by the signal handler */
+static const uint8_t *cur_data;
+static size_t cur_size;
+static char crash_path[PATH_MAX];
+static char hang_path[PATH_MAX];
+
+static const char *opt_dir = ".";
+static unsigned int opt_seed = 1;
+static long opt_runs = 10000;
+static long opt_timeout = 10;
+static double opt_ratio = 20;
+static double opt_min_ms = 5;
+static int opt_verbose;
+
+static double baseline[FUZZ_NOPS];		/* slowest seed in ns per byte */
+static double worst[FUZZ_NOPS];			/* slowest input in ns per byte */
+static long nflagged;
+
+static void
+save_signal(int sig)
+{
+	const char *path = sig == SIGALRM ? hang_path : crash_path;
+	int fd;
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1) {
+		if (write(fd, cur_data, cur_size) == -1)
+			;
+		close(fd);
+	}
+	write(STDERR_FILENO, "fuzz: input saved to ", 21);
+	write(STDERR_FILENO, path, strlen(path));
+	write(STDERR_FILENO, "\n", 1);
+	signal(sig == SIGALRM ? SIGABRT : sig, SIG_DFL);
+	raise(sig == SIGALRM ? SIGABRT : sig);
+}
+
+static void
+save(const char *kind, long n, const uint8_t *data, size_t size)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s-%ld.srd", opt_dir, kind, n);
+	if ((f = fopen(path, "w")) == NULL ||
+		fwrite(data, size, 1, f) != 1 || fclose(f) != 0)
+		fatal("%s", path);
+	printf("fuzz: %s input saved to %s\n", kind, path);
+}
+
+/* Run an input, keeping the fastest time of each operation. */
+static int
+run(const uint8_t *data, size_t size, struct fuzz_times *best, int repeat)
+{
+	struct fuzz_times t;
+	int ok = 0;
+	int i, j;
+
+	cur_data = data;
+	cur_size = size;
+	for (i = 0; i < repeat; i++) {
+		alarm(opt_timeout);
+		ok = fuzz_one(data, size, &t);
+		alarm(0);
+		for (j = 0; j < FUZZ_NOPS; j++)
+			if (i == 0 || t.ns[j] < best->ns[j])
+				best->ns[j] = t.ns[j];
+	}
+	return ok;
+}
+
+static void
+add_seed(const char *path)
+{
+	BUF *b;
+
+	if (nseeds == FUZZ_MAX_SEEDS)
+		fatalx("too many seeds");
+	if ((b = buf_load(path)) == NULL)
+		fatal("%s", path);
+	if (buf_len(b) > FUZZ_MAX_SIZE) {
+		buf_free(b);
+		return;
+	}
+	if ((seeds[nseeds].name = strdup(path)) == NULL)
+		fatal("strdup");
+	seeds[nseeds].buf = b;
+	nseeds++;
+}
+
+static void
+add_seeds(const char *path)
+{
+	char name[PATH_MAX];
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+
+	if (stat(path, &st) == -1)
+		fatal("%s", path);
+	if (!S_ISDIR(st.st_mode)) {
+		add_seed(path);
+		return;
+	}
+	if ((d = opendir(path)) == NULL)
+		fatal("%s", path);
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(name, sizeof(name), "%s/%s", path, de->d_name);
+		if (stat(name, &st) == 0 && S_ISREG(st.st_mode))
+			add_seed(name);
+	}
+	closedir(d);
+}
+
+static void
+print_times(const char *label, size_t size, struct fuzz_times *t)
+{
+	int i;
+
+	printf("%-32s %6zu", label, size);
+	for (i = 0; i < FUZZ_NOPS; i++)
+		printf(" %10.1f", t->ns[i] / 1000.0);
+	printf("\n");
+}
+
+/*
+ * Time the seeds. The slowest of them in ns per byte is the baseline
+ * that mutated inputs are compared with.
+ */
+static void
+run_seeds(void)
+{
+	struct fuzz_times t;
+	size_t size;
+	int i, j;
+
+	printf("%-32s %6s", "seed", "bytes");
+	for (j = 0; j < FUZZ_NOPS; j++)
+		printf(" %10.10s", fuzz_op_names[j] + 8);
+	printf("\n");
+
+	for (i = 0; i < nseeds; i++) {
+		size = buf_len(seeds[i].buf);
+		run(buf_get(seeds[i].buf), size, &t, FUZZ_REPEAT);
+		print_times(seeds[i].name, size, &t);
+		for (j = 0; j < FUZZ_NOPS; j++)
+			if ((double)t.ns[j] / size > baseline[j])
+				baseline[j] = (double)t.ns[j] / size;
+	}
+}
+
+/* Returns the first operation that is too slow for the input size. */
+static int
+too_slow(size_t size, struct fuzz_times *t)
+{
+	double limit;
+	int i;
+
+	for (i = 0; i < FUZZ_NOPS; i++) {
+		limit = opt_ratio * baseline[i] * size;
+		if (limit < opt_min_ms * 1e6)
+			limit = opt_min_ms * 1e6;
+		if (t->ns[i] > limit)
+			return i;
+	}
+	return -1;
+}
+
+static const uint8_t interesting[] = { 0x00, 0x01, 0x30, 0x7f, 0x80, 0x99, 0xfb, 0xff };
+
+/* Change a few bytes of <b>, most of them in the header. */
+static void
+mutate(BUF *b, unsigned int *rs)
+{
+	uint8_t *p;
+	size_t len, pos, n;
+	BUF *other;
+	int i, count;
+
+	count = 1 + rand_r(rs) % 4;
+	for (i = 0; i < count; i++) {
+		len = buf_len(b);
+		p = buf_get(b);
+		if (len < 2)
+			return;
+		pos = rand_r(rs) % 2 ? rand_r(rs) % (len < 140 ? len : 140) :
+			rand_r(rs) % len;
+		switch (rand_r(rs) % 6) {
+		case 0:
+			p[pos] ^= 1 << (rand_r(rs) % 8);
+			break;
+		case 1:
+			p[pos] = interesting[rand_r(rs) % sizeof(interesting)];
+			break;
+		case 2:
+			p[pos] = rand_r(rs);
+			break;
+		case 3:
+			/* truncate */
+			buf_set_len(b, pos > 2 ? pos : 2);
+			break;
+		case 4:
+			/* repeat the tail */
+			n = len - pos;
+			if (len + n <= FUZZ_MAX_SIZE)
+				buf_append(b, buf_get(b) + pos, n);
+			break;
+		case 5:
+			/* splice with another seed */
+			other = seeds[rand_r(rs) % nseeds].buf;
+			n = rand_r(rs) % buf_len(other);
+			if (pos + buf_len(other) - n <= FUZZ_MAX_SIZE) {
+				buf_set_len(b, pos);
+				buf_append(b, buf_get(other) + n, buf_len(other) - n);
+			}
+			break;
+		}
+	}
+}
+
+static void
+run_mutations(void)
+{
+	struct fuzz_times t;
+	unsigned int rs = opt_seed;
+	long parsed = 0;
+	long n;
+	BUF *b, *s;
+	size_t size;
+	int op;
+	int i;
+
+	b = buf_alloc(FUZZ_MAX_SIZE);
+	for (n = 0; n < opt_runs; n++) {
+		s = seeds[rand_r(&rs) % nseeds].buf;
+		buf_empty(b);
+		buf_append(b, buf_get(s), buf_len(s));
+		mutate(b, &rs);
+		size = buf_len(b);
+
+		parsed += run(buf_get(b), size, &t, 1);
+		if ((op = too_slow(size, &t)) != -1) {
+			/* measure again, it may just have been preempted */
+			run(buf_get(b), size, &t, FUZZ_REPEAT);
+			if ((op = too_slow(size, &t)) != -1) {
+				printf("fuzz: run %ld: %s takes %.1f us for %zu bytes\n",
+					   n, fuzz_op_names[op], t.ns[op] / 1000.0, size);
+				save("slow", n, buf_get(b), size);
+				nflagged++;
+			}
+		}
+		for (i = 0; i < FUZZ_NOPS; i++)
+			if ((double)t.ns[i] / size > worst[i])
+				worst[i] = (double)t.ns[i] / size;
+		if (opt_verbose)
+			printf("run %ld: %zu bytes, %s\n", n, size,
+				   t.ns[FUZZ_PRINT_TXT] ? "parsed" : "rejected");
+	}
+	buf_free(b);
+
+	printf("%ld runs, %ld parsed, %ld too slow\n", opt_runs, parsed, nflagged);
+	printf("%-22s %14s %14s\n", "op", "seed ns/byte", "worst ns/byte");
+	for (i = 0; i < FUZZ_NOPS; i++)
+		printf("%-22s %14.1f %14.1f\n", fuzz_op_names[i], baseline[i], worst[i]);
+}
+
+static void
+usage(void)
+{
+	printf("usage: fuzz [-hv] [-d dir] [-m ms] [-n runs] [-r ratio] [-s seed]\n");
+	printf("            [-t timeout] corpus ...\n");
+	printf("        -d dir         directory for saved inputs (default: .)\n");
+	printf("        -m ms          never flag operations faster than this (default: 5)\n");
+	printf("        -n runs        number of mutated inputs (default: 10000)\n");
+	printf("        -r ratio       flag inputs this much slower per byte than\n");
+	printf("                       the slowest seed (default: 20)\n");
+	printf("        -s seed        random seed (default: 1)\n");
+	printf("        -t timeout     seconds until an input counts as a hang (default: 10)\n");
+	printf("        -v             print every run\n");
+}
+
+static double
+number(const char *s)
+{
+	char *end;
+	double v;
+
+	errno = 0;
+	v = strtod(s, &end);
+	if (errno || *s == '\0' || *end != '\0' || v < 0) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+int
+main(int argc, char **argv)
+{
+	int ch;
+	int i;
+
+	while ((ch = getopt(argc, argv, "d:hm:n:r:s:t:v")) != -1) {
+		switch (ch) {
+		case 'd':
+			opt_dir = optarg;
+			break;
+		case 'm':
+			opt_min_ms = number(optarg);
+			break;
+		case 'n':
+			opt_runs = number(optarg);
+			break;
+		case 'r':
+			opt_ratio = number(optarg);
+			break;
+		case 's':
+			opt_seed = number(optarg);
+			break;
+		case 't':
+			opt_timeout = number(optarg);
+			break;
+		case 'v':
+			opt_verbose = 1;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0) {
+		usage();
+		return 1;
+	}
+
+	for (i = 0; i < argc; i++)
+		add_seeds(argv[i]);
+	if (nseeds == 0)
+		fatalx("no seeds");
+
+	snprintf(crash_path, sizeof(crash_path), "%s/crash-%ld.srd", opt_dir,
+			 (long)getpid());
+	snprintf(hang_path, sizeof(hang_path), "%s/hang-%ld.srd", opt_dir,
+			 (long)getpid());
+	signal(SIGSEGV, save_signal);
+	signal(SIGBUS, save_signal);
+	signal(SIGFPE, save_signal);
+	signal(SIGABRT, save_signal);
+	signal(SIGALRM, save_signal);
+
+	fuzz_init();
+	run_seeds();
+	run_mutations();
+
+	return nflagged != 0;
+}
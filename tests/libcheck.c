@@ -0,0 +1,305 @@
+/* libcheck.c - check libs725 against the expected output */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Parses each file given on the command line from memory with
+ * libs725, writes it in every format to memory and compares that
+ * with the file of the same name and the format as extension, like
+ * runtests does with hrmtool. Memory is counted with allocator hooks,
+ * so anything the library leaks is reported as well. The hooks also
+ * fail each allocation in turn, which must make the library return an
+ * error without leaking, or the same output as without failures. A
+ * workout with a broken lap count must not be written either.
+ * Messages are collected instead of printed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "s725.h"
+
+struct mem {
+	char	*data;
+	size_t	 len;
+	size_t	 size;
+};
+
+static long live;
+static long fail_after = -1;	/* allocations until one fails, -1 for never */
+static long messages;
+
+/* Returns 1 if this allocation is to fail. */
+static int
+count_fail(void)
+{
+	if (fail_after == 0)
+		return 1;
+	if (fail_after > 0)
+		fail_after--;
+	return 0;
+}
+
+static void *
+count_malloc(size_t size, void *ctx)
+{
+	void *p;
+
+	if (count_fail())
+		return NULL;
+	if ((p = malloc(size)) != NULL)
+		live++;
+	return p;
+}
+
+static void *
+count_realloc(void *ptr, size_t size, void *ctx)
+{
+	if (count_fail())
+		return NULL;
+	return realloc(ptr, size);
+}
+
+static void
+count_free(void *ptr, void *ctx)
+{
+	live--;
+	free(ptr);
+}
+
+static void
+count_message(void *ctx, const char *msg)
+{
+	messages++;
+}
+
+static int
+mem_write(void *ctx, const void *data, size_t len)
+{
+	struct mem *m = ctx;
+
+	if (m->len + len > m->size) {
+		m->size = 2 * (m->len + len);
+		if ((m->data = realloc(m->data, m->size)) == NULL)
+			return -1;
+	}
+	memcpy(m->data + m->len, data, len);
+	m->len += len;
+	return 0;
+}
+
+static int
+load(const char *path, struct mem *m)
+{
+	FILE *f;
+	long len;
+
+	memset(m, 0, sizeof(*m));
+	if ((f = fopen(path, "r")) == NULL)
+		return 0;
+	if (fseek(f, 0, SEEK_END) == -1 || (len = ftell(f)) == -1 ||
+		fseek(f, 0, SEEK_SET) == -1) {
+		fclose(f);
+		return 0;
+	}
+	m->size = len + 1;
+	m->data = malloc(m->size);
+	if (m->data == NULL || fread(m->data, 1, len, f) != len) {
+		fclose(f);
+		free(m->data);
+		return 0;
+	}
+	m->len = len;
+	fclose(f);
+	return 1;
+}
+
+static int
+check(const char *path, const struct mem *in, int format, const char *ext)
+{
+	char expected[1024];
+	struct mem want, got;
+	s725_workout *w;
+	size_t len;
+	int ok;
+
+	len = strlen(path);
+	if (len < 4 || len - 4 + strlen(ext) + 2 > sizeof(expected))
+		return 1;
+	snprintf(expected, sizeof(expected), "%.*s.%s", (int)(len - 4), path, ext);
+	if (!load(expected, &want))
+		return 1;
+
+	/* parse the header only, the writers load the rest */
+	memset(&got, 0, sizeof(got));
+	if ((w = s725_parse(in->data, in->len, S725_MODEL_AUTO,
+						S725_WORKOUT_HEADER)) == NULL) {
+		printf("%s -> %s FAIL: invalid file\n", path, expected);
+		free(want.data);
+		return 0;
+	}
+	ok = s725_write(w, format, mem_write, &got) == 0 &&
+		got.len == want.len && memcmp(got.data, want.data, got.len) == 0;
+	printf("%s -> %s %s\n", path, expected, ok ? "OK" : "FAIL");
+	s725_free(w);
+	free(got.data);
+	free(want.data);
+	return ok;
+}
+
+/* Parse the header of <in> and write it as text to <out>. */
+static int
+parse_write(const struct mem *in, struct mem *out)
+{
+	s725_workout *w;
+	int ret = -1;
+
+	memset(out, 0, sizeof(*out));
+	if ((w = s725_parse(in->data, in->len, S725_MODEL_AUTO,
+						S725_WORKOUT_HEADER)) != NULL) {
+		ret = s725_write(w, S725_FORMAT_TXT, mem_write, out);
+		s725_free(w);
+	}
+	return ret;
+}
+
+/*
+ * Fail every allocation of a parse and write in turn. A write that
+ * still succeeds must give the same output as one without failures.
+ */
+static int
+check_oom(const char *path, const struct mem *in)
+{
+	struct mem want, got;
+	int ret, done, ok = 1;
+	long n;
+
+	if (parse_write(in, &want) != 0) {
+		printf("%s FAIL: cannot write\n", path);
+		free(want.data);
+		return 0;
+	}
+	for (n = 0; ok; n++) {
+		fail_after = n;
+		ret = parse_write(in, &got);
+		/* no allocation failed, so everything must have worked */
+		done = fail_after > 0;
+		fail_after = -1;
+		if (ret == 0 && (got.len != want.len ||
+						 memcmp(got.data, want.data, got.len) != 0)) {
+			printf("%s FAIL: wrong output when allocation %ld fails\n",
+				   path, n);
+			ok = 0;
+		}
+		free(got.data);
+		if (live != 0) {
+			printf("%s FAIL: %ld allocations not freed when allocation "
+				   "%ld fails\n", path, live, n);
+			ok = 0;
+		}
+		if (done) {
+			if (ret != 0) {
+				printf("%s FAIL: allocation failures\n", path);
+				ok = 0;
+			}
+			break;
+		}
+	}
+	free(want.data);
+	if (ok)
+		printf("%s allocation failures OK\n", path);
+	return ok;
+}
+
+/*
+ * A zero lap count makes a file invalid. The header parse rejects it,
+ * and if it did not, writing the workout would have to fail without
+ * any output.
+ */
+static int
+check_bad_laps(const char *path, const struct mem *in)
+{
+	struct mem bad, got;
+	int ret;
+
+	if (in->len <= 21)
+		return 1;
+	bad = *in;
+	if ((bad.data = malloc(in->len)) == NULL)
+		return 0;
+	memcpy(bad.data, in->data, in->len);
+	bad.data[21] = 0;
+
+	ret = parse_write(&bad, &got);
+	free(bad.data);
+	free(got.data);
+	if (ret == 0 || got.len != 0) {
+		printf("%s FAIL: workout without laps written\n", path);
+		return 0;
+	}
+	printf("%s without laps OK\n", path);
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct s725_allocator a = { count_malloc, count_realloc, count_free, NULL };
+	struct mem in;
+	int i, ok = 1;
+
+	if (s725_api_version() != S725_API_VERSION) {
+		printf("libs725: API version %d, expected %d\n",
+			   s725_api_version(), S725_API_VERSION);
+		return 1;
+	}
+	s725_set_allocator(&a);
+	s725_set_log(count_message, NULL);
+
+	/* too short to be a workout */
+	if (s725_parse("\x02\x00", 2, S725_MODEL_AUTO, S725_WORKOUT_FULL) != NULL ||
+		messages == 0) {
+		printf("libs725: invalid workout not reported\n");
+		ok = 0;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (!load(argv[i], &in)) {
+			printf("%s FAIL: cannot read\n", argv[i]);
+			ok = 0;
+			continue;
+		}
+		ok &= check(argv[i], &in, S725_FORMAT_TXT, "txt");
+		ok &= check(argv[i], &in, S725_FORMAT_HRM, "hrm");
+		ok &= check(argv[i], &in, S725_FORMAT_TCX, "tcx");
+		ok &= check_oom(argv[i], &in);
+		ok &= check_bad_laps(argv[i], &in);
+		free(in.data);
+	}
+
+	if (live != 0) {
+		printf("libs725: %ld allocations not freed\n", live);
+		ok = 0;
+	}
+	return ok ? 0 : 1;
+}
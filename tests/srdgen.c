@@ -0,0 +1,467 @@
+/* srdgen.c - generate synthetic workout files */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Builds .srd buffers in the layout that workout_read_buf() expects,
+ * with a random walk for heart rate, altitude, speed, power and
+ * cadence. The whole file size is stored in 16 bits and the lap
+ * count in one BCD byte, so a file holds at most 65535 bytes and 99
+ * laps; srdgen_max_duration() gives the longest workout that fits.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "buf.h"
+#include "srdgen.h"
+#include "workout.h"
+#include "workout_int.h"
+
+#define SRDGEN_MAX_SIZE		65535
+
+static int
+bcd(int v)
+{
+	return ((v / 10) % 10) << 4 | (v % 10);
+}
+
+static int
+interval_code(int interval)
+{
+	switch (interval) {
+	case 15:
+		return 1;
+	case 60:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static int
+header_size(S725_HRM_Type type)
+{
+	switch (type) {
+	case S725_HRM_S610:
+		return S725_HEADER_SIZE_S610;
+	case S725_HRM_S625:
+		return S725_HEADER_SIZE_S625X;
+	default:
+		return S725_HEADER_SIZE_S725;
+	}
+}
+
+static int
+mode_of(const struct srdgen *g)
+{
+	return g->type == S725_HRM_S610 ? 0 : g->mode;
+}
+
+static int
+samples_of(const struct srdgen *g)
+{
+	return g->duration / g->interval + 1;
+}
+
+static size_t
+file_size(const struct srdgen *g)
+{
+	return header_size(g->type) +
+		g->laps * workout_bytes_per_lap(g->type, mode_of(g), g->interval_mode) +
+		samples_of(g) * workout_bytes_per_sample(mode_of(g));
+}
+
+/* a value that moves by at most <step> and stays within [lo, hi] */
+static int
+walk(unsigned int *seed, int v, int step, int lo, int hi)
+{
+	v += rand_r(seed) % (2 * step + 1) - step;
+	if (v < lo)
+		v = lo;
+	if (v > hi)
+		v = hi;
+	return v;
+}
+
+static void
+put_time(u_char *p, int seconds)
+{
+	p[0] = 0;
+	p[1] = bcd(seconds % 60);
+	p[2] = bcd(seconds / 60 % 60);
+	p[3] = bcd(seconds / 3600);
+}
+
+/* exercise summary */
+struct ride_info {
+	int dist;			/* in 1/16 km/h * s */
+	int avg_speed;
+	int max_speed;
+	int avg_cad;
+	int max_cad;
+	int min_alt;
+	int avg_alt;
+	int max_alt;
+	int ascent;
+	int avg_power;
+	int max_power;
+};
+
+/* values at the end of a lap */
+struct lap_state {
+	int t;
+	int hr;
+	int lap_hr_avg;
+	int lap_hr_max;
+	int alt;
+	int ascent;
+	int speed;
+	int power;
+	int cad;
+	int dist;			/* in 1/16 km/h * s */
+};
+
+static void
+put_lap(const struct srdgen *g, u_char *lp, struct lap_state *st)
+{
+	int mode = mode_of(g);
+	int d;
+	int s;
+
+	lp[0] = st->t % 60;
+	lp[1] = st->t / 60 % 60;
+	lp[2] = st->t / 3600;
+	lp[3] = st->hr;
+	lp[4] = st->lap_hr_avg;
+	lp[5] = st->lap_hr_max;
+	s = 6;
+	if (S725_HAS_ALTITUDE(mode)) {
+		lp[s]     = (st->alt + 512) & 0xff;
+		lp[s + 1] = (st->alt + 512) >> 8;
+		lp[s + 2] = st->ascent & 0xff;
+		lp[s + 3] = (st->ascent >> 8) & 0xff;
+		lp[s + 4] = g->english ? 60 : 30;
+		s += 5;
+	}
+	if (S725_HAS_SPEED(mode)) {
+		if (S725_HAS_CADENCE(mode))
+			lp[s++] = st->cad;
+		if (S725_HAS_POWER(mode)) {
+			lp[s]     = st->power & 0xff;
+			lp[s + 1] = st->power >> 8;
+			lp[s + 2] = 40;
+			lp[s + 3] = 50;
+			s += 4;
+		}
+		/* cumulative distance in 1/10 km */
+		d = st->dist / 5760;
+		lp[s]     = d & 0xff;
+		lp[s + 1] = (d >> 8) & 0xff;
+		lp[s + 2] = st->speed & 0xff;
+		lp[s + 3] = (st->speed >> 4) & 0xf0;
+	}
+}
+
+/* signed value with the sign in bit 7 of the high byte, set if positive */
+static void
+put_signed(u_char *p, int v)
+{
+	int a = v < 0 ? -v : v;
+
+	p[0] = a & 0xff;
+	p[1] = ((a >> 8) & 0x7f) | (v >= 0 ? 0x80 : 0);
+}
+
+/* ride summary of the S625X and S725 */
+static void
+put_ride_info(const struct srdgen *g, u_char *p, struct ride_info *ri)
+{
+	int mode = mode_of(g);
+	int d;
+
+	if (S725_HAS_SPEED(mode)) {
+		d = ri->dist / 5760;
+		p[6] = d & 0xff;
+		p[7] = (d >> 8) & 0xff;
+		p[8] = ri->avg_speed & 0xff;
+		p[9] = ((ri->avg_speed >> 8) & 0x0f) | ((ri->max_speed & 0x0f) << 4);
+		p[10] = (ri->max_speed >> 4) & 0xff;
+	}
+	if (S725_HAS_CADENCE(mode)) {
+		p[11] = ri->avg_cad;
+		p[12] = ri->max_cad;
+	}
+	if (S725_HAS_ALTITUDE(mode)) {
+		put_signed(&p[13], ri->min_alt);
+		put_signed(&p[15], ri->avg_alt);
+		put_signed(&p[17], ri->max_alt);
+		p[19] = p[20] = p[21] = g->english ? 68 : 0x80 | 20;
+		p[22] = ri->ascent & 0xff;
+		p[23] = (ri->ascent >> 8) & 0xff;
+	}
+	if (S725_HAS_POWER(mode)) {
+		p[24] = ri->avg_power & 0xff;
+		p[25] = ((ri->avg_power >> 8) & 0x0f) | ((ri->max_power & 0x0f) << 4);
+		p[26] = (ri->max_power >> 4) & 0xff;
+		p[27] = 40;
+		p[28] = 60;
+		p[29] = 50;
+	}
+}
+
+void
+srdgen_init(struct srdgen *g, S725_HRM_Type type)
+{
+	memset(g, 0, sizeof(*g));
+	g->type = type;
+	g->laps = 1;
+	g->duration = 3600;
+	g->interval = 5;
+	g->seed = 1;
+	if (type != S725_HRM_S610)
+		g->mode = S725_MODE_ALTITUDE | S725_MODE_SPEED1;
+}
+
+/* Longest duration in seconds that still fits into a file. */
+int
+srdgen_max_duration(const struct srdgen *g)
+{
+	struct srdgen t = *g;
+	size_t fixed;
+	int bps;
+
+	t.duration = 0;
+	fixed = file_size(&t) - workout_bytes_per_sample(mode_of(g));
+	bps = workout_bytes_per_sample(mode_of(g));
+	if (fixed >= SRDGEN_MAX_SIZE)
+		return -1;
+
+	/* samples = duration / interval + 1, and hours are one BCD byte */
+	t.duration = ((SRDGEN_MAX_SIZE - fixed) / bps - 1) * g->interval;
+	if (t.duration > 99 * 3600 + 59 * 60 + 59)
+		t.duration = 99 * 3600 + 59 * 60 + 59;
+	return t.duration;
+}
+
+/* Returns NULL if the workout does not fit into a file. */
+BUF *
+srdgen(const struct srdgen *g)
+{
+	unsigned int seed = g->seed;
+	S725_HRM_Type type = g->type;
+	int mode = mode_of(g);
+	int samples, hdr, bpl, bps, lap;
+	int hr = 120, alt = 300, speed = 400, power = 200, cad = 85;
+	int sum_hr = 0, max_hr = 0;
+	int i, t, lap_end, s;
+	int lap_hr_sum, lap_hr_max, lap_n;
+	int ascent = 0, dist = 0;
+	struct lap_state st;
+	struct ride_info ri;
+	long sum_speed = 0, sum_cad = 0, sum_alt = 0, sum_power = 0;
+	struct tm tm;
+	time_t start;
+	size_t size;
+	u_char *p, *sp, *lp;
+	BUF *b;
+
+	if (g->laps < 1 || g->laps > SRDGEN_MAX_LAPS || g->duration < 0 ||
+		(g->interval != 5 && g->interval != 15 && g->interval != 60) ||
+		(type != S725_HRM_S610 && type != S725_HRM_S625 &&
+		 type != S725_HRM_S725) ||
+		(size = file_size(g)) > SRDGEN_MAX_SIZE ||
+		g->duration > 99 * 3600 + 59 * 60 + 59)
+		return NULL;
+
+	samples = samples_of(g);
+	hdr = header_size(type);
+	bpl = workout_bytes_per_lap(type, mode, g->interval_mode);
+	bps = workout_bytes_per_sample(mode);
+
+	b = buf_alloc(size);
+	buf_set_len(b, size);
+	p = buf_get(b);
+	memset(p, 0, size);
+
+	/* preamble */
+	p[0] = size & 0xff;
+	p[1] = size >> 8;
+	p[2] = 0;								/* no exercise label */
+
+	/* date */
+	start = g->start ? g->start : 1466524800;	/* 2016-06-21 16:00 UTC */
+	gmtime_r(&start, &tm);
+	p[10] = bcd(tm.tm_sec);
+	p[11] = bcd(tm.tm_min);
+	p[12] = bcd(tm.tm_hour);
+	p[13] = bcd(tm.tm_mday);
+	p[14] = bcd(tm.tm_year % 100);
+
+	/* duration, the tenths share byte 15 with the month */
+	put_time(&p[15], g->duration);
+	p[15] = (tm.tm_mon + 1) & 0x0f;
+
+	p[21] = bcd(g->laps);
+	p[22] = bcd(g->laps - 1);
+	p[23] = type != S725_HRM_S610 ? g->interval_mode : 0;
+	p[24] = bcd(1);							/* user id */
+	p[25] = g->english ? 0x02 : 0;
+
+	/* recording mode, interval and the marker bytes detection looks for */
+	if (type == S725_HRM_S610) {
+		p[26] = interval_code(g->interval);
+		p[34] = 0;
+		p[36] = 251;
+	} else {
+		p[26] = mode;
+		p[27] = interval_code(g->interval);
+		p[35] = 0;
+		p[37] = 251;
+	}
+
+	/* heart rate limits, all time spent within the first zone */
+	lp = &p[type == S725_HRM_S610 ? 28 : 29];
+	lp[0] = 120; lp[1] = 160;
+	lp[2] = 80;  lp[3] = 180;
+	lp[4] = 60;  lp[5] = 200;
+	put_time(&lp[11], g->duration);
+	put_time(&lp[20], g->duration);
+	put_time(&lp[29], g->duration);
+
+	/*
+	 * Samples are stored in reverse order after the laps, laps are
+	 * written as the samples of each lap have been generated.
+	 */
+	memset(&ri, 0, sizeof(ri));
+	ri.min_alt = 4000;
+	lap = 0;
+	lap_hr_sum = lap_hr_max = lap_n = 0;
+	lap_end = (g->duration / g->laps) * (lap + 1);
+	for (i = 0; i < samples; i++) {
+		t = i * g->interval;
+		hr = walk(&seed, hr, 3, 60, 195);
+		sum_hr += hr;
+		if (hr > max_hr)
+			max_hr = hr;
+		lap_hr_sum += hr;
+		if (hr > lap_hr_max)
+			lap_hr_max = hr;
+		lap_n++;
+
+		sp = p + size - (i + 1) * bps;
+		s = 0;
+		sp[s++] = hr;
+		if (S725_HAS_ALTITUDE(mode)) {
+			int a = walk(&seed, alt, 2, 0, 4000);
+			if (a > alt)
+				ascent += a - alt;
+			alt = a;
+			sum_alt += alt;
+			if (alt < ri.min_alt)
+				ri.min_alt = alt;
+			if (alt > ri.max_alt)
+				ri.max_alt = alt;
+			sp[s] = (alt + 512) & 0xff;
+			sp[s + 1] = ((alt + 512) >> 8) & 0x1f;
+			s += 2;
+		}
+		if (S725_HAS_SPEED(mode)) {
+			if (S725_HAS_ALTITUDE(mode))
+				s -= 1;
+			speed = walk(&seed, speed, 16, 0, 1000);
+			dist += speed * g->interval;
+			sum_speed += speed;
+			if (speed > ri.max_speed)
+				ri.max_speed = speed;
+			sp[s] |= (speed >> 3) & 0xe0;
+			sp[s + 1] = speed & 0xff;
+			s += 2;
+			if (S725_HAS_POWER(mode)) {
+				power = walk(&seed, power, 10, 0, 1500);
+				sum_power += power;
+				if (power > ri.max_power)
+					ri.max_power = power;
+				sp[s] = power & 0xff;
+				sp[s + 1] = power >> 8;
+				sp[s + 2] = 50;
+				sp[s + 3] = 40;
+				s += 4;
+			}
+			if (S725_HAS_CADENCE(mode)) {
+				cad = walk(&seed, cad, 2, 0, 150);
+				sum_cad += cad;
+				if (cad > ri.max_cad)
+					ri.max_cad = cad;
+				sp[s] = cad;
+			}
+		}
+
+		if (t >= lap_end && lap < g->laps) {
+			st.t = t;
+			st.hr = hr;
+			st.lap_hr_avg = lap_hr_sum / lap_n;
+			st.lap_hr_max = lap_hr_max;
+			st.alt = alt;
+			st.ascent = ascent;
+			st.speed = speed;
+			st.power = power;
+			st.cad = cad;
+			st.dist = dist;
+			put_lap(g, p + hdr + lap * bpl, &st);
+			lap++;
+			lap_end = (g->duration / g->laps) * (lap + 1);
+			lap_hr_sum = lap_hr_max = lap_n = 0;
+		}
+	}
+
+	/* laps that did not end before the last sample end with it */
+	while (lap < g->laps) {
+		st.t = (samples - 1) * g->interval;
+		st.hr = hr;
+		st.lap_hr_avg = lap_n ? lap_hr_sum / lap_n : hr;
+		st.lap_hr_max = lap_n ? lap_hr_max : hr;
+		st.alt = alt;
+		st.ascent = ascent;
+		st.speed = speed;
+		st.power = power;
+		st.cad = cad;
+		st.dist = dist;
+		put_lap(g, p + hdr + lap * bpl, &st);
+		lap++;
+		lap_hr_sum = lap_hr_max = lap_n = 0;
+	}
+
+	p[19] = sum_hr / samples;
+	p[20] = max_hr;
+
+	if (type != S725_HRM_S610) {
+		ri.dist = dist;
+		ri.avg_speed = sum_speed / samples;
+		ri.avg_cad = sum_cad / samples;
+		ri.avg_alt = sum_alt / samples;
+		ri.ascent = ascent;
+		ri.avg_power = sum_power / samples;
+		put_ride_info(g, &p[79], &ri);
+	}
+
+	return b;
+}
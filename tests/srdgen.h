@@ -0,0 +1,47 @@
+/* srdgen.h - generate synthetic workout files */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SRDGEN_H
+#define SRDGEN_H
+
+#include <time.h>
+
+#include "buf.h"
+#include "workout.h"
+
+struct srdgen {
+	S725_HRM_Type	 type;			/* S610, S625 or S725 */
+	int				 mode;			/* S725_MODE_* bits, 0 for S610 */
+	int				 laps;			/* 1 - 99 */
+	int				 duration;		/* seconds */
+	int				 interval;		/* recording interval: 5, 15 or 60 */
+	int				 interval_mode;
+	int				 english;		/* english units */
+	time_t			 start;			/* 0 for a fixed date */
+	unsigned int	 seed;
+};
+
+#define SRDGEN_MAX_LAPS	99
+
+void	 srdgen_init(struct srdgen *g, S725_HRM_Type type);
+int		 srdgen_max_duration(const struct srdgen *g);
+BUF		*srdgen(const struct srdgen *g);
+
+#endif	/* SRDGEN_H */
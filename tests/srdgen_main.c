@@ -0,0 +1,154 @@
+/* srdgen_main.c - write synthetic workout files */
+
+/*
+ * Copyright (C) 2016  Ralf Horstmann
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "log.h"
+#include "srdgen.h"
+#include "workout.h"
+
+static void
+usage(void)
+{
+	printf("usage: srdgen [-eh] [-m model] [-M mode] [-l laps] [-d duration] [-i interval]\n");
+	printf("              [-I intervalmode] [-s seed] -o outfile\n");
+	printf("        -m model       S610, S625 or S725 (default: S725)\n");
+	printf("        -M mode        recording mode bits (default: 18)\n");
+	printf("        -l laps        number of laps, 1 - 99 (default: 1)\n");
+	printf("        -d duration    duration in seconds or max (default: 3600)\n");
+	printf("        -i interval    recording interval: 5, 15, 60 (default: 5)\n");
+	printf("        -I mode        interval mode byte (default: 0)\n");
+	printf("        -e             english units\n");
+	printf("        -s seed        random seed (default: 1)\n");
+	printf("        -o outfile     output file name\n");
+}
+
+static int
+number(const char *s, int min, int max)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(s, &end, 0);
+	if (errno || *s == '\0' || *end != '\0' || v < min || v > max) {
+		usage();
+		exit(1);
+	}
+	return v;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct srdgen g;
+	char *opt_output_file = NULL;
+	char *opt_duration = NULL;
+	char *opt_mode = NULL;
+	S725_HRM_Type type = S725_HRM_S725;
+	FILE *f;
+	BUF *b;
+	int ch;
+
+	srdgen_init(&g, type);
+
+	while ((ch = getopt(argc, argv, "d:ehi:I:l:m:M:o:s:")) != -1) {
+		switch (ch) {
+		case 'd':
+			opt_duration = optarg;
+			break;
+		case 'e':
+			g.english = 1;
+			break;
+		case 'i':
+			g.interval = number(optarg, 5, 60);
+			break;
+		case 'I':
+			g.interval_mode = number(optarg, 0, 255);
+			break;
+		case 'l':
+			g.laps = number(optarg, 1, SRDGEN_MAX_LAPS);
+			break;
+		case 'm':
+			if (!strcmp(optarg, "S610")) {
+				type = S725_HRM_S610;
+			} else if (!strcmp(optarg, "S625")) {
+				type = S725_HRM_S625;
+			} else if (!strcmp(optarg, "S725")) {
+				type = S725_HRM_S725;
+			} else {
+				usage();
+				return 1;
+			}
+			break;
+		case 'M':
+			opt_mode = optarg;
+			break;
+		case 'o':
+			opt_output_file = optarg;
+			break;
+		case 's':
+			g.seed = number(optarg, 0, INT_MAX);
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (opt_output_file == NULL) {
+		usage();
+		return 1;
+	}
+
+	g.type = type;
+	if (type == S725_HRM_S610)
+		g.mode = 0;
+	if (opt_mode != NULL)
+		g.mode = number(opt_mode, 0, 0xff);
+	if (opt_duration != NULL) {
+		if (!strcmp(opt_duration, "max"))
+			g.duration = srdgen_max_duration(&g);
+		else
+			g.duration = number(opt_duration, 0, INT_MAX);
+	}
+
+	if ((b = srdgen(&g)) == NULL)
+		fatalx("workout does not fit into a file");
+
+	if ((f = fopen(opt_output_file, "w")) == NULL)
+		fatal("%s", opt_output_file);
+	if (fwrite(buf_get(b), buf_len(b), 1, f) != 1 || fclose(f) != 0)
+		fatal("%s", opt_output_file);
+	buf_free(b);
+
+	return 0;
+}
@@ -28,17 +28,26 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "cache.h"
 #include "log.h"
+#include "stats.h"
 #include "workout.h"
 #include "workout_int.h"
 #include "workout_time.h"
+#include "xmalloc.h"
+
+#define WORKOUT_ALIGN(x)	(((x) + 7) & ~(size_t)7)
 
 static S725_HRM_Type workout_detect_hrm_type(BUF *buf);
-static workout_t * workout_extract(BUF *buf, S725_HRM_Type type);
-static int workout_bytes_per_sample(unsigned char bt);
-static int workout_bytes_per_lap(S725_HRM_Type type, unsigned char bt, unsigned char bi);
-static int workout_header_size(workout_t *w);
-static int workout_allocate_sample_space(workout_t *w);
+static S725_HRM_Type workout_buf_type(BUF *buf, S725_HRM_Type type);
+static workout_t * workout_extract(BUF *buf, S725_HRM_Type type, int what, workout_arena_t *arena);
+static int workout_read_header(workout_t *w, BUF *buf, S725_HRM_Type type);
+static int workout_read_body(workout_t *w, BUF *buf, int what);
+static int workout_keep_raw(workout_t *w, BUF *buf, int what);
+static void workout_clear(workout_t *w, u_char *base);
+static workout_t * workout_alloc(workout_t *h, workout_arena_t *arena);
+static size_t workout_layout(workout_t *w, u_char *base);
+static int workout_count_samples(workout_t *w);
 static int workout_get_recording_interval(unsigned char b);
 static void workout_read_preamble(workout_t *w, BUF *buf);
 static void workout_read_date(workout_t *w, BUF *buf);
@@ -50,46 +59,83 @@ static void workout_read_bestlap_split(workout_t *w, BUF *buf, size_t offset);
 static void workout_read_energy(workout_t *w, BUF *buf, size_t offset);
 static void workout_read_cumulative_exercise(workout_t *w, BUF *buf, size_t offset);
 static void workout_read_ride_info(workout_t *w, BUF *buf, size_t offset);
-static int workout_read_laps(workout_t *w, BUF *buf);
 static void workout_compute_speed_info(workout_t *w);
-static int workout_read_samples(workout_t *w, BUF *buf);
 static void workout_label_extract(BUF *buf, size_t offset, S725_Label *label, int bytes);
 static char alpha_map(unsigned char c);
 
+static CACHE *workout_cache;
+
 /**********************************************************************/
 
+/*
+ * Parse the parts of <buf> given by <what>, a mask of S725_WORKOUT_*
+ * flags. The header is always parsed. Laps and samples that are left
+ * out are decoded by workout_load() when they are first needed.
+ */
 workout_t *
-workout_read_buf(BUF *buf, S725_HRM_Type type)
+workout_read_buf(BUF *buf, S725_HRM_Type type, int what)
 {
-	workout_t *w = NULL;
-	off_t size;
+	return workout_read_buf_arena(buf, type, what, NULL);
+}
 
-	if (buf_len(buf) < 2) {
-		log_info("workout_read_buf: buffer size too small");
-		return NULL;
-	}
+/*
+ * Parse into the memory of <arena>, which only grows when the
+ * workout does not fit. The workout stays valid until the next parse
+ * into the same arena.
+ */
+workout_t *
+workout_read_buf_arena(BUF *buf, S725_HRM_Type type, int what,
+					   workout_arena_t *arena)
+{
+	workout_t *w = NULL;
+	uint64_t t;
 
-	size = buf_getshort(buf, 0);
+	t = stats_begin();
 
-	if (size != buf_len(buf)) {
-		log_info("workout_read_buf: len does not match buffer len");
+	if ((type = workout_buf_type(buf, type)) == S725_HRM_UNKNOWN)
 		return NULL;
-	}
-
-	if (type == S725_HRM_AUTO) {
-		type = workout_detect_hrm_type(buf);
-	}
 
-	if (type == S725_HRM_UNKNOWN || buf_get_readerr(buf)) {
-		log_info("workout_read_buf: unable to auto-detect HRM type");
-		return NULL;
+	/* a header is parsed faster than a full copy is taken from the cache */
+	if (workout_cache != NULL && (what & S725_WORKOUT_FULL) == S725_WORKOUT_FULL &&
+		(w = cache_get(workout_cache, buf, type, arena)) != NULL) {
+		stats_end(STATS_WORKOUT_READ, t);
+		return w;
 	}
 
-	w = workout_extract(buf, type);
+	w = workout_extract(buf, type, what, arena);
+	if (w != NULL && workout_cache != NULL && w->parsed == S725_WORKOUT_FULL)
+		cache_put(workout_cache, buf, type, w);
+	stats_end(STATS_WORKOUT_READ, t);
 
 	return w;
 }
 
+/*
+ * Look up workouts in <c> before parsing them in full, and add the
+ * ones that are not found. NULL turns the cache off again. Set it
+ * before any threads parse workouts.
+ */
+void
+workout_set_cache(CACHE *c)
+{
+	workout_cache = c;
+}
+
+/*
+ * Decode the parts in <what> that have not been decoded yet. Returns
+ * 0 if they cannot be decoded.
+ */
+int
+workout_load(workout_t *w, int what)
+{
+	what &= S725_WORKOUT_FULL & ~w->parsed;
+	if (what == 0)
+		return 1;
+	if (w->raw == NULL || (w->parsed & S725_WORKOUT_HEADER) == 0)
+		return 0;
+	return workout_read_body(w, w->raw, what);
+}
+
 workout_t *
 workout_read(char *filename, S725_HRM_Type type)
 {
@@ -98,7 +144,7 @@ workout_read(char *filename, S725_HRM_Type type)
 
 	buf = buf_load(filename);
 	if (buf) {
-		w = workout_read_buf(buf, type);
+		w = workout_read_buf(buf, type, S725_WORKOUT_FULL);
 		buf_free(buf);
 	} else {
 		log_info("workout_read: load error");
@@ -107,23 +153,172 @@ workout_read(char *filename, S725_HRM_Type type)
 	return w;
 }
 
+/*
+ * The workout and its arrays are a single allocation. Workouts in an
+ * arena belong to the arena and are left alone.
+ */
 void
 workout_free (workout_t *w)
 {
-	if (w != NULL) {
-		if (w->lap_data)   free(w->lap_data);
-		if (w->alt_data)   free(w->alt_data);
-		if (w->speed_data) free(w->speed_data);
-		if (w->dist_data)  free(w->dist_data);
-		if (w->cad_data)   free(w->cad_data);
-		if (w->power_data) free(w->power_data);
-		if (w->hr_data)    free(w->hr_data);
-		free(w);
+	if (w != NULL && w->arena == NULL) {
+		if (w->raw != NULL)
+			buf_free(w->raw);
+		hfree(w);
+	}
+}
+
+/*
+ * Copy the fully parsed workout <w> into <image> as a workout_t
+ * without pointers, followed by its laps and samples. Returns the
+ * size of the image, nothing is copied if <image> is NULL.
+ */
+size_t
+workout_image(workout_t *w, u_char *image)
+{
+	size_t hsize = WORKOUT_ALIGN(sizeof(workout_t));
+	size_t size = workout_layout(w, NULL);
+	workout_t t;
+
+	if (image == NULL)
+		return hsize + size;
+
+	memcpy(&t, w, sizeof(t));
+	t.lap_data = NULL;
+	t.hr_data = NULL;
+	t.alt_data = NULL;
+	t.speed_data = NULL;
+	t.dist_data = NULL;
+	t.cad_data = NULL;
+	t.power_data = NULL;
+	t.lr_balance_data = NULL;
+	t.pedal_index_data = NULL;
+	t.arena = NULL;
+	t.raw = NULL;
+	memset(&t.units, 0, sizeof(t.units));
+	memset(&t.date, 0, sizeof(t.date));
+	t.units.system = w->units.system;
+	t.unixtime = 0;
+
+	/* the arrays are copied with the padding between them cleared */
+	memset(image, 0, hsize + size);
+	memcpy(image, &t, sizeof(t));
+	workout_layout(&t, image + hsize);
+
+#define COPY(a, n)													\
+	do {															\
+		if (t.a != NULL)											\
+			memcpy(t.a, w->a, (size_t)(n) * sizeof(*w->a));		\
+	} while (0)
+
+	COPY(lap_data, w->laps);
+	COPY(hr_data, w->samples);
+	COPY(alt_data, w->samples);
+	COPY(speed_data, w->samples);
+	COPY(dist_data, w->samples);
+	COPY(power_data, w->samples);
+	COPY(lr_balance_data, w->samples);
+	COPY(pedal_index_data, w->samples);
+	COPY(cad_data, w->samples);
+
+#undef COPY
+
+	return hsize + size;
+}
+
+/*
+ * Rebuild a workout from an image of the same <buf> made by
+ * workout_image(). The header of <buf> is parsed again to check the
+ * image and for the fields that depend on the time zone. Returns
+ * NULL if the image does not match.
+ */
+workout_t *
+workout_from_image(const u_char *image, size_t size, BUF *buf,
+				   workout_arena_t *arena)
+{
+	size_t hsize = WORKOUT_ALIGN(sizeof(workout_t));
+	workout_t h;
+	workout_t t;
+	workout_t *w;
+
+	if (size < hsize)
+		return NULL;
+	memcpy(&t, image, sizeof(t));
+	if (t.parsed != S725_WORKOUT_FULL || !workout_read_header(&h, buf, t.type))
+		return NULL;
+	if (t.mode != h.mode || t.laps != h.laps || t.samples != h.samples ||
+		t.bytes != h.bytes || t.interval_mode != h.interval_mode ||
+		hsize + workout_layout(&h, NULL) != size) {
+		log_info("workout_from_image: image does not match");
+		return NULL;
+	}
+
+	t.date = h.date;
+	t.unixtime = h.unixtime;
+	t.units = h.units;
+
+	if ((w = workout_alloc(&t, arena)) == NULL)
+		return NULL;
+	memcpy(w->lap_data, image + hsize, size - hsize);
+
+	return w;
+}
+
+workout_arena_t *
+workout_arena_new(void)
+{
+	workout_arena_t *a;
+
+	if ((a = hcalloc(1, sizeof(workout_arena_t))) == NULL)
+		log_error("workout_arena_new: calloc: %s", strerror(errno));
+	return a;
+}
+
+void
+workout_arena_free(workout_arena_t *a)
+{
+	if (a != NULL) {
+		if (a->raw != NULL)
+			buf_free(a->raw);
+		hfree(a->base);
+		hfree(a);
 	}
 }
 
 /**********************************************************************/
 
+/*
+ * Check the size field of <buf> and detect the type if it is
+ * S725_HRM_AUTO. Returns S725_HRM_UNKNOWN if the buffer is unusable.
+ */
+static S725_HRM_Type
+workout_buf_type(BUF *buf, S725_HRM_Type type)
+{
+	off_t size;
+
+	if (buf_len(buf) < 2) {
+		log_info("workout_read_buf: buffer size too small");
+		return S725_HRM_UNKNOWN;
+	}
+
+	size = buf_getshort(buf, 0);
+
+	if (size != buf_len(buf)) {
+		log_info("workout_read_buf: len does not match buffer len");
+		return S725_HRM_UNKNOWN;
+	}
+
+	if (type == S725_HRM_AUTO) {
+		type = workout_detect_hrm_type(buf);
+	}
+
+	if (type == S725_HRM_UNKNOWN || buf_get_readerr(buf)) {
+		log_info("workout_read_buf: unable to auto-detect HRM type");
+		return S725_HRM_UNKNOWN;
+	}
+
+	return type;
+}
+
 /*
  * Attempt to auto-detect the HRM type based on some information in the file.
  * This may not always succeed, but it seems to work relatively well.
@@ -188,15 +383,62 @@ workout_detect_hrm_type(BUF *buf)
 }
 
 static workout_t *
-workout_extract(BUF *buf, S725_HRM_Type type)
+workout_extract(BUF *buf, S725_HRM_Type type, int what, workout_arena_t *arena)
 {
-	workout_t *w = NULL;
-	int ok = 1;
+	workout_t h;
+	workout_t *w;
 
-	if ((w = calloc(1, sizeof(workout_t))) == NULL) {
-		log_info("workout_extract: calloc: %s", strerror(errno));
+	/* the header is read on the stack until the array sizes are known */
+	if (!workout_read_header(&h, buf, type))
 		return NULL;
+
+	if ((w = workout_alloc(&h, arena)) == NULL)
+		return NULL;
+
+	if (!workout_read_body(w, buf, what) || !workout_keep_raw(w, buf, what)) {
+		workout_free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+/*
+ * Keep a copy of <buf> for the parts that have not been decoded. The
+ * copy belongs to the arena or to the workout and is reused. It is
+ * allocated at its full size, so the append never has to grow it.
+ * Returns 0 if there is not enough memory.
+ */
+static int
+workout_keep_raw(workout_t *w, BUF *buf, int what)
+{
+	BUF **raw = w->arena != NULL ? &w->arena->raw : &w->raw;
+
+	if ((what & S725_WORKOUT_FULL) == S725_WORKOUT_FULL)
+		return 1;
+
+	if (*raw != NULL && buf_capacity(*raw) < buf_len(buf)) {
+		buf_free(*raw);
+		*raw = NULL;
 	}
+	if (*raw == NULL) {
+		if ((*raw = buf_create(buf_len(buf))) == NULL) {
+			log_error("workout_keep_raw: out of memory");
+			return 0;
+		}
+	} else {
+		buf_empty(*raw);
+	}
+	buf_append(*raw, buf_get(buf), buf_len(buf));
+	w->raw = *raw;
+	return 1;
+}
+
+/* Read everything up to the laps, and count the samples. */
+static int
+workout_read_header(workout_t *w, BUF *buf, S725_HRM_Type type)
+{
+	memset(w, 0, sizeof(*w));
 
 	/* Define the type of the HRM */
 	w->type = type;
@@ -209,8 +451,7 @@ workout_extract(BUF *buf, S725_HRM_Type type)
 	if (buf_get_readerr(buf)) {
 		log_info("workout_extract: readerr after header (%d > %d)",
 				 buf_get_readerr_offset(buf), buf_len(buf));
-		workout_free(w);
-		return NULL;
+		return 0;
 	}
 
 	w->avg_hr        = buf_getc(buf, 19);
@@ -225,8 +466,13 @@ workout_extract(BUF *buf, S725_HRM_Type type)
 	if (buf_get_readerr(buf)) {
 		log_info("workout_extract: readerr after units (%d > %d)",
 				 buf_get_readerr_offset(buf), buf_len(buf));
-		workout_free(w);
-		return NULL;
+		return 0;
+	}
+
+	/* checked here so that every mask accepts the same files */
+	if (w->laps <= 0 || w->laps > 1024) {
+		log_info("workout_extract: invalid number of laps (%d)", w->laps);
+		return 0;
 	}
 
 	/* recording mode and interval */
@@ -250,37 +496,53 @@ workout_extract(BUF *buf, S725_HRM_Type type)
 	if (buf_get_readerr(buf)) {
 		log_info("workout_extract: readerr after mode (%d > %d)",
 				 buf_get_readerr_offset(buf), buf_len(buf));
-		workout_free(w);
-		return NULL;
+		return 0;
 	}
 
-	ok = workout_read_laps(w, buf);
-	if (buf_get_readerr(buf)) {
-		log_info("workout_extract: readerr after read laps (%d > %d)",
-				 buf_get_readerr_offset(buf), buf_len(buf));
-		workout_free(w);
-		return NULL;
-	}
-	if (!ok) {
-		workout_free(w);
-		return NULL;
-	}
+	if (!workout_count_samples(w))
+		return 0;
 
-	ok = workout_read_samples(w, buf);
-	if (buf_get_readerr(buf)) {
-		log_info("workout_extract: readerr after read samples (%d > %d)",
-				 buf_get_readerr_offset(buf), buf_len(buf));
-		workout_free(w);
-		return NULL;
-	}
-	if (!ok) {
-		workout_free(w);
-		return NULL;
+	w->parsed = S725_WORKOUT_HEADER;
+	return 1;
+}
+
+/*
+ * Read laps and samples as given by <what> into the arrays set up by
+ * workout_layout().
+ */
+static int
+workout_read_body(workout_t *w, BUF *buf, int what)
+{
+	int ok;
+
+	if (what & S725_WORKOUT_LAPS) {
+		ok = workout_read_laps(w, buf);
+		if (buf_get_readerr(buf)) {
+			log_info("workout_extract: readerr after read laps (%d > %d)",
+					 buf_get_readerr_offset(buf), buf_len(buf));
+			return 0;
+		}
+		if (!ok) {
+			return 0;
+		}
+		w->parsed |= S725_WORKOUT_LAPS;
 	}
 
-	workout_compute_speed_info(w);
+	if (what & S725_WORKOUT_SAMPLES) {
+		ok = workout_read_samples(w, buf);
+		if (buf_get_readerr(buf)) {
+			log_info("workout_extract: readerr after read samples (%d > %d)",
+					 buf_get_readerr_offset(buf), buf_len(buf));
+			return 0;
+		}
+		if (!ok) {
+			return 0;
+		}
+		workout_compute_speed_info(w);
+		w->parsed |= S725_WORKOUT_SAMPLES;
+	}
 
-	return w;
+	return 1;
 }
 
 static void
@@ -529,7 +791,7 @@ workout_read_ride_info(workout_t *w, BUF *buf, size_t offset)
 /*
  * Extract the lap data.
  */
-static int
+int
 workout_read_laps(workout_t *w, BUF *buf)
 {
 	S725_Distance prev_lap_dist;
@@ -545,18 +807,6 @@ workout_read_laps(workout_t *w, BUF *buf)
 	lap_size = workout_bytes_per_lap(w->type, w->mode, w->interval_mode);
 	hdr_size = workout_header_size(w);
 
-	if (w->laps <=0 || w->laps > 1024) {
-		log_info("workout_read_laps: invalid number of laps (%d)", w->laps);
-		return 0;
-	}
-
-	w->lap_data = calloc(w->laps, sizeof(lap_data_t));
-
-	if (w->lap_data == NULL) {
-		log_info("workout_read_laps: calloc (%s)", strerror(errno));
-		return 0;
-	}
-
 	for (i = 0; i < w->laps; i++) {
 		/* position to the start of the lap */
 		offset = hdr_size + i * lap_size;
@@ -636,7 +886,7 @@ workout_read_laps(workout_t *w, BUF *buf)
 	return 1;
 }
 
-static int
+int
 workout_read_samples(workout_t *w, BUF *buf)
 {
 	int offset;
@@ -657,13 +907,8 @@ workout_read_samples(workout_t *w, BUF *buf)
 		/* now add the offset due to laps */
 		offset += w->laps * lap_size;
 
-		/* number of samples */
-		w->samples = (w->bytes - offset)/sample_size;
-
-		/* allocate memory */
-		ok = workout_allocate_sample_space(w);
-
-		/* if we succeeded in allocating the buffers, ok will not be 0 here. */
+		/* if the arrays have been set up, ok will not be 0 here. */
+		ok = w->hr_data != NULL;
 		if (ok) {
 			/* At last, we can extract the samples.  They are in reverse order. */
 			for (i = 0; i < w->samples; i++) {
@@ -685,9 +930,9 @@ workout_read_samples(workout_t *w, BUF *buf)
 					w->speed_data[x] = ((buf_getc(buf, s) & 0xe0) << 3) + buf_getc(buf, s + 1);
 					s += 2;
 					if (S725_HAS_POWER(w->mode)) {
-						w->power_data[x].power = buf_getc(buf, s) + (buf_getc(buf, s + 1) << 8);
-						w->power_data[x].lr_balance = buf_getc(buf, s + 2);
-						w->power_data[x].pedal_index = buf_getc(buf, s + 3);
+						w->power_data[x] = buf_getc(buf, s) + (buf_getc(buf, s + 1) << 8);
+						w->lr_balance_data[x] = buf_getc(buf, s + 2);
+						w->pedal_index_data[x] = buf_getc(buf, s + 3);
 						s += 4;
 					}
 					if (S725_HAS_CADENCE(w->mode)) w->cad_data[x] = buf_getc(buf, s);
@@ -735,7 +980,7 @@ workout_compute_speed_info(workout_t *w)
 	}
 }
 
-static int
+int
 workout_header_size(workout_t *w)
 {
 	int size = 0;
@@ -757,7 +1002,7 @@ workout_header_size(workout_t *w)
 	return size;
 }
 
-static int
+int
 workout_bytes_per_lap(S725_HRM_Type type, unsigned char bt, unsigned char bi)
 {
 	int lap_size = 6;
@@ -784,7 +1029,7 @@ workout_bytes_per_lap(S725_HRM_Type type, unsigned char bt, unsigned char bi)
 	return lap_size;
 }
 
-static int
+int
 workout_bytes_per_sample(unsigned char bt)
 {
 	int recsiz = 1;
@@ -806,37 +1051,111 @@ workout_bytes_per_sample(unsigned char bt)
 }
 
 static int
-workout_allocate_sample_space (workout_t *w)
+workout_count_samples(workout_t *w)
 {
-	int ok = 1;
+	int offset;
+
+	if ((offset = workout_header_size(w)) == 0)
+		return 0;
+
+	offset += w->laps * workout_bytes_per_lap(w->type, w->mode, w->interval_mode);
+	w->samples = (w->bytes - offset) / workout_bytes_per_sample(w->mode);
 
 	if (w->samples <= 0 || w->samples > 1048576) {
-		log_error("workout_allocate_sample_space: invalid number of samples (%d)", w->samples);
+		log_error("workout_count_samples: invalid number of samples (%d)", w->samples);
 		return 0;
 	}
 
-#define  MAKEBUF(a, b)											\
-	if ((w->a = calloc(w->samples, sizeof(b))) == NULL) {		\
-		log_error("%s: calloc(%d,%ld): %s",					    \
-				 #a,w->samples,(long)sizeof(b),strerror(errno));\
-		ok = 0;													\
-	}
+	return 1;
+}
 
-	MAKEBUF(hr_data, S725_Heart_Rate);
+/*
+ * Returns the size of the arrays for the laps and samples of <w>. If
+ * <base> is not NULL, the array pointers of <w> are set up to point
+ * into it.
+ */
+static size_t
+workout_layout(workout_t *w, u_char *base)
+{
+	size_t off = 0;
+
+#define  CARVE(a, n)												\
+	do {															\
+		if (base != NULL)											\
+			w->a = (void *)(base + off);							\
+		off = WORKOUT_ALIGN(off + (size_t)(n) * sizeof(*w->a));	\
+	} while (0)
+
+	CARVE(lap_data, w->laps);
+	CARVE(hr_data, w->samples);
 	if (S725_HAS_ALTITUDE(w->mode))
-		MAKEBUF(alt_data, S725_Altitude);
+		CARVE(alt_data, w->samples);
 	if (S725_HAS_SPEED(w->mode)) {
-		MAKEBUF(speed_data, S725_Speed);
-		MAKEBUF(dist_data, S725_Distance);
-		if (S725_HAS_POWER(w->mode))
-			MAKEBUF(power_data, S725_Power);
+		CARVE(speed_data, w->samples);
+		CARVE(dist_data, w->samples);
+		if (S725_HAS_POWER(w->mode)) {
+			CARVE(power_data, w->samples);
+			CARVE(lr_balance_data, w->samples);
+			CARVE(pedal_index_data, w->samples);
+		}
 		if (S725_HAS_CADENCE(w->mode))
-			MAKEBUF(cad_data, S725_Cadence);
+			CARVE(cad_data, w->samples);
 	}
 
-#undef MAKEBUF
+#undef CARVE
 
-	return ok;
+	return off;
+}
+
+/*
+ * Zero the laps at <base>. The sample arrays need no clearing, every
+ * element is written when they are read.
+ */
+static void
+workout_clear(workout_t *w, u_char *base)
+{
+	memset(base, 0, (size_t)w->laps * sizeof(lap_data_t));
+}
+
+/*
+ * Move the header <h> into memory sized for all its laps and samples,
+ * taken from <arena> if given.
+ */
+static workout_t *
+workout_alloc(workout_t *h, workout_arena_t *arena)
+{
+	size_t hsize = WORKOUT_ALIGN(sizeof(workout_t));
+	size_t size = hsize + workout_layout(h, NULL);
+	workout_t *w;
+	void *p;
+
+	if (arena != NULL) {
+		if (arena->size < size) {
+			hfree(arena->base);
+			arena->size = 0;
+			if ((arena->base = hmalloc(size)) == NULL) {
+				log_error("workout_alloc: malloc(%zu): %s", size, strerror(errno));
+				return NULL;
+			}
+			stats_add(STATS_ALLOCS, 1);
+			arena->size = size;
+		}
+		p = arena->base;
+	} else {
+		if ((p = hmalloc(size)) == NULL) {
+			log_error("workout_alloc: malloc(%zu): %s", size, strerror(errno));
+			return NULL;
+		}
+		stats_add(STATS_ALLOCS, 1);
+	}
+
+	w = p;
+	*w = *h;
+	w->arena = arena;
+	workout_clear(w, (u_char *)p + hsize);
+	workout_layout(w, (u_char *)p + hsize);
+
+	return w;
 }
 
 static void
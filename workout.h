@@ -41,9 +41,20 @@ typedef enum {
 } S725_HRM_Type;
 
 typedef struct workout_t workout_t;
+typedef struct workout_arena_t workout_arena_t;
 
-workout_t*  workout_read_buf(BUF *buf, S725_HRM_Type type);
+struct cache;
+
+workout_t*  workout_read_buf(BUF *buf, S725_HRM_Type type, int what);
+workout_t*  workout_read_buf_arena(BUF *buf, S725_HRM_Type type, int what,
+								   workout_arena_t *arena);
 workout_t*	workout_read(char* filename, S725_HRM_Type type);
+int			workout_load(workout_t *w, int what);
 void 		workout_free(workout_t * w);
 
+void		workout_set_cache(struct cache *c);
+
+workout_arena_t*	workout_arena_new(void);
+void				workout_arena_free(workout_arena_t *arena);
+
 #endif	/* WORKOUT_H */
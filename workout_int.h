@@ -26,6 +26,13 @@
 
 #include "workout.h"
 
+/*
+ * Raise this with every change to the parser that can give another
+ * result for the same input, so that results saved by an older
+ * parser, like those in the cache, are not used any more.
+ */
+#define WORKOUT_PARSER_VERSION	2
+
 #define S725_HAS_FIELD(x,y)   (((x) & S725_MODE_##y) != 0)
 #define S725_HAS_CADENCE(x)   S725_HAS_FIELD(x,CADENCE)
 #define S725_HAS_POWER(x)     S725_HAS_FIELD(x,POWER)
@@ -101,10 +108,14 @@ typedef short          S725_Altitude;
 typedef unsigned short S725_Speed;     /* 1/16ths of a km/hr */
 typedef float          S725_Distance;
 
+typedef unsigned short S725_Power_Value;  /* watts */
+typedef unsigned char  S725_LR_Balance;
+typedef unsigned char  S725_Pedal_Index;
+
 typedef struct S725_Power {
-	unsigned short power;
-	unsigned char  lr_balance;
-	unsigned char  pedal_index;
+	S725_Power_Value power;
+	S725_LR_Balance  lr_balance;
+	S725_Pedal_Index pedal_index;
 } S725_Power;
 
 typedef char S725_Temperature;
@@ -202,7 +213,36 @@ struct workout_t {
 	S725_Speed             *speed_data;
 	S725_Distance          *dist_data;       /* computed from speed_data */
 	S725_Cadence           *cad_data;
-	S725_Power             *power_data;
+	S725_Power_Value       *power_data;      /* power samples are stored */
+	S725_LR_Balance        *lr_balance_data; /* one array per field */
+	S725_Pedal_Index       *pedal_index_data;
+	workout_arena_t        *arena;           /* owner of the memory, or NULL */
+	int                     parsed;          /* S725_WORKOUT_* parts decoded */
+	BUF                    *raw;             /* input for the other parts */
 };
 
+/* memory for one workout and its arrays, reused by the next parse */
+struct workout_arena_t {
+	void                   *base;
+	size_t                  size;
+	BUF                    *raw;             /* input of partly parsed workouts */
+};
+
+/* power sample accessors */
+#define workout_power(w, i)         ((w)->power_data[i])
+#define workout_lr_balance(w, i)    ((w)->lr_balance_data[i])
+#define workout_pedal_index(w, i)   ((w)->pedal_index_data[i])
+
+/* parser stages and layout, used by workout_read_buf() and the benchmark */
+int workout_read_laps(workout_t *w, BUF *buf);
+int workout_read_samples(workout_t *w, BUF *buf);
+int workout_header_size(workout_t *w);
+int workout_bytes_per_lap(S725_HRM_Type type, unsigned char bt, unsigned char bi);
+int workout_bytes_per_sample(unsigned char bt);
+
+/* flat copies of parsed workouts, used by the cache */
+size_t workout_image(workout_t *w, u_char *image);
+workout_t *workout_from_image(const u_char *image, size_t size, BUF *buf,
+							  workout_arena_t *arena);
+
 #endif
@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "log.h"
+#include "stats.h"
 #include "workout_print.h"
 #include "workout_int.h"
 #include "workout_time.h"
@@ -37,21 +38,28 @@
  * or it can just be S725_WORKOUT_FULL (everything)
  */
 void
-workout_print_txt(workout_t *w, FILE *fp, int what)
+workout_print_txt(workout_t *w, SINK *out, int what)
 {
 	const char* hrm_type = "Unknown";
 	int i;
 	int j;
 	float vam;
 	char buf[BUFSIZ];
+	struct tm tm;
 	lap_data_t *l;
 	S725_Time s;
+	uint64_t t = stats_begin();
+
+	if (!workout_load(w, what)) {
+		log_error("workout_print_txt: unable to decode workout");
+		return;
+	}
 
 	if (what & S725_WORKOUT_HEADER) {
 		/* exercise date */
 		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S (%a, %d %b %Y)",
-				 localtime(&w->unixtime));
-		fprintf(fp, "# Workout date:          %s\n", buf);
+				 localtime_r(&w->unixtime, &tm));
+		sink_printf(out, "# Workout date:          %s\n", buf);
 
 		/* HRM type */
 		switch (w->type) {
@@ -67,232 +75,232 @@ workout_print_txt(workout_t *w, FILE *fp, int what)
 		default:
 			break;
 		}
-		fprintf(fp, "# HRM Type:              %s\n", hrm_type);
+		sink_printf(out, "# HRM Type:              %s\n", hrm_type);
 
 		/* user id */
-		fprintf(fp, "# User ID:               %d\n", w->user_id);
+		sink_printf(out, "# User ID:               %d\n", w->user_id);
 
 		/* exercise number and label */
 		if (w->exercise_number > 0 && w->exercise_number <= 5) {
-			fprintf(fp, "# Exercise:              %d (%s)\n",
+			sink_printf(out, "# Exercise:              %d (%s)\n",
 					w->exercise_number,
 					w->exercise_label);
 		}
 
 		/* workout mode */
-		fprintf(fp, "# Mode:                  HR");
-		if (S725_HAS_ALTITUDE(w->mode)) fprintf(fp, ", Altitude");
+		sink_puts(out, "# Mode:                  HR");
+		if (S725_HAS_ALTITUDE(w->mode)) sink_puts(out, ", Altitude");
 		if (S725_HAS_SPEED(w->mode)) {
-			fprintf(fp, ", Speed ");
+			sink_puts(out, ", Speed ");
 			if (S725_HAS_SPEED1(w->mode) && S725_HAS_SPEED2(w->mode))
-				fprintf(fp, "(Bike 2)");
+				sink_puts(out, "(Bike 2)");
 			else if (S725_HAS_SPEED1(w->mode))
-				fprintf(fp, "(Run)");
+				sink_puts(out, "(Run)");
 			else
-				fprintf(fp, "(Bike 1)");
-			fprintf(fp, "%s%s",
+				sink_puts(out, "(Bike 1)");
+			sink_printf(out, "%s%s",
 					S725_HAS_POWER(w->mode) ? ", Power" : "",
 					S725_HAS_CADENCE(w->mode) ? ", Cadence" : "");
 		}
-		fprintf(fp, "\n");
+		sink_puts(out, "\n");
 
 		/* exercise duration */
-		fprintf(fp, "# Exercise duration:     ");
-		workout_time_print(&w->duration, "hmst", fp);
-		fprintf(fp, "\n");
+		sink_puts(out, "# Exercise duration:     ");
+		workout_time_print(&w->duration, "hmst", out);
+		sink_puts(out, "\n");
 
 		if (S725_HAS_SPEED(w->mode))
-			fprintf(fp, "# Exercise distance:     %.1f %s\n",
+			sink_printf(out, "# Exercise distance:     %.1f %s\n",
 					w->exercise_distance/10.0, w->units.distance);
 
 		/* recording interval */
-		fprintf(fp, "# Recording interval:    %d seconds\n",
+		sink_printf(out, "# Recording interval:    %d seconds\n",
 				w->recording_interval);
 
 		/* average, maximum heart rate */
-		fprintf(fp, "# Average heart rate:    %d bpm\n", w->avg_hr);
-		fprintf(fp, "# Maximum heart rate:    %d bpm\n", w->max_hr);
+		sink_printf(out, "# Average heart rate:    %d bpm\n", w->avg_hr);
+		sink_printf(out, "# Maximum heart rate:    %d bpm\n", w->max_hr);
 
 		/* average, maximum cadence */
 		if (S725_HAS_CADENCE(w->mode)) {
-			fprintf(fp, "# Average cadence:       %d rpm\n", w->avg_cad);
-			fprintf(fp, "# Maximum cadence:       %d rpm\n", w->max_cad);
+			sink_printf(out, "# Average cadence:       %d rpm\n", w->avg_cad);
+			sink_printf(out, "# Maximum cadence:       %d rpm\n", w->max_cad);
 		}
 
 		/* average, maximum speed */
 		if (S725_HAS_SPEED(w->mode)) {
-			fprintf(fp, "# Average speed:         %.1f %s\n",
+			sink_printf(out, "# Average speed:         %.1f %s\n",
 					w->avg_speed/16.0, w->units.speed);
-			fprintf(fp, "# Maximum speed:         %.1f %s\n",
+			sink_printf(out, "# Maximum speed:         %.1f %s\n",
 					w->max_speed/16.0, w->units.speed);
 		}
 
 		if (w->type != S725_HRM_S610) {
 			/* min, avg, max temperature */
-			fprintf(fp, "# Minimum temperature:   %d %s\n",
+			sink_printf(out, "# Minimum temperature:   %d %s\n",
 					w->min_temp, w->units.temperature);
-			fprintf(fp, "# Average temperature:   %d %s\n",
+			sink_printf(out, "# Average temperature:   %d %s\n",
 					w->avg_temp, w->units.temperature);
-			fprintf(fp, "# Maximum temperature:   %d %s\n",
+			sink_printf(out, "# Maximum temperature:   %d %s\n",
 					w->max_temp, w->units.temperature);
 		}
 
 		/* altitude, ascent */
 		if (S725_HAS_ALTITUDE(w->mode)) {
-			fprintf(fp, "# Minimum altitude:      %d %s\n",
+			sink_printf(out, "# Minimum altitude:      %d %s\n",
 					w->min_alt, w->units.altitude);
-			fprintf(fp, "# Average altitude:      %d %s\n",
+			sink_printf(out, "# Average altitude:      %d %s\n",
 					w->avg_alt, w->units.altitude);
-			fprintf(fp, "# Maximum altitude:      %d %s\n",
+			sink_printf(out, "# Maximum altitude:      %d %s\n",
 					w->max_alt, w->units.altitude);
-			fprintf(fp, "# Ascent:                %d %s\n",
+			sink_printf(out, "# Ascent:                %d %s\n",
 					w->ascent, w->units.altitude);
 		}
 
 		/* power data */
 		if (S725_HAS_POWER(w->mode)) {
-			fprintf(fp, "# Average power:         %d W\n",
+			sink_printf(out, "# Average power:         %d W\n",
 					w->avg_power.power);
-			fprintf(fp, "# Average LR balance:    %d-%d\n",
+			sink_printf(out, "# Average LR balance:    %d-%d\n",
 					w->avg_power.lr_balance >> 1,
 					100 - (w->avg_power.lr_balance >> 1));
-			fprintf(fp, "# Average pedal index:   %d %%\n",
+			sink_printf(out, "# Average pedal index:   %d %%\n",
 					w->avg_power.pedal_index >> 1);
-			fprintf(fp, "# Maximum power:         %d W\n",
+			sink_printf(out, "# Maximum power:         %d W\n",
 					w->max_power.power);
-			fprintf(fp, "# Maximum pedal index:   %d %%\n",
+			sink_printf(out, "# Maximum pedal index:   %d %%\n",
 					w->max_power.pedal_index >> 1);
 		}
 
 		/* energy, total energy (units??) */
-		fprintf(fp, "# Energy:                %d\n", w->energy);
-		fprintf(fp, "# Total energy:          %d\n", w->total_energy);
+		sink_printf(out, "# Energy:                %d\n", w->energy);
+		sink_printf(out, "# Total energy:          %d\n", w->total_energy);
 
 		/* cumulative counters */
-		fprintf(fp, "# Cumulative exercise:   ");
-		workout_time_print(&w->cumulative_exercise, "hm", fp);
-		fprintf(fp, "\n");
+		sink_puts(out, "# Cumulative exercise:   ");
+		workout_time_print(&w->cumulative_exercise, "hm", out);
+		sink_puts(out, "\n");
 
 		if (S725_HAS_SPEED(w->mode)) {
-			fprintf(fp, "# Cumulative ride time:  ");
-			workout_time_print(&w->cumulative_ride,"hm", fp);
-			fprintf(fp, "\n");
-			fprintf(fp, "# Odometer:              %d %s\n",
+			sink_puts(out, "# Cumulative ride time:  ");
+			workout_time_print(&w->cumulative_ride,"hm", out);
+			sink_puts(out, "\n");
+			sink_printf(out, "# Odometer:              %d %s\n",
 					w->odometer, w->units.distance);
 		}
 		/* laps */
-		fprintf(fp, "# Laps:                  %d\n", w->laps);
+		sink_printf(out, "# Laps:                  %d\n", w->laps);
 
-		fprintf(fp, "#\n");
+		sink_puts(out, "#\n");
 
 		/* HR limits */
 		for (i = 0; i < 3; i++) {
-			fprintf(fp, "#\n");
-			fprintf(fp, "# HR Limit %d:            %d to %3d\n",
+			sink_puts(out, "#\n");
+			sink_printf(out, "# HR Limit %d:            %d to %3d\n",
 					i+1,w->hr_limit[i].lower,w->hr_limit[i].upper);
-			fprintf(fp, "#   Time below:          ");
-			workout_time_print(&w->hr_zone[i][0],"hms", fp);
-			fprintf(fp, "\n");
-			fprintf(fp, "#   Time within:         ");
-			workout_time_print(&w->hr_zone[i][1],"hms", fp);
-			fprintf(fp, "\n");
-			fprintf(fp, "#   Time above:          ");
-			workout_time_print(&w->hr_zone[i][2],"hms", fp);
-			fprintf(fp, "\n");
+			sink_puts(out, "#   Time below:          ");
+			workout_time_print(&w->hr_zone[i][0],"hms", out);
+			sink_puts(out, "\n");
+			sink_puts(out, "#   Time within:         ");
+			workout_time_print(&w->hr_zone[i][1],"hms", out);
+			sink_puts(out, "\n");
+			sink_puts(out, "#   Time above:          ");
+			workout_time_print(&w->hr_zone[i][2],"hms", out);
+			sink_puts(out, "\n");
 		}
 
 	}
-	fprintf(fp, "#\n#\n");
+	sink_puts(out, "#\n#\n");
 
 	if (what & S725_WORKOUT_LAPS) {
 		/* lap data */
 		for (i = 0; i < w->laps; i++) {
 			l = &w->lap_data[i];
-			fprintf(fp, "# Lap %d:\n", i+1);
-			fprintf(fp, "#   Lap split:           ");
-			workout_time_print(&l->split, "hmst", fp);
-			fprintf(fp, "\n");
-			fprintf(fp, "#   Lap cumulative:      ");
-			workout_time_print(&l->cumulative, "hmst", fp);
-			fprintf(fp, "\n");
-			fprintf(fp, "#   Lap HR:              %d bpm\n", l->lap_hr);
-			fprintf(fp, "#   Average HR:          %d bpm\n", l->avg_hr);
-			fprintf(fp, "#   Maximum HR:          %d bpm\n", l->max_hr);
+			sink_printf(out, "# Lap %d:\n", i+1);
+			sink_puts(out, "#   Lap split:           ");
+			workout_time_print(&l->split, "hmst", out);
+			sink_puts(out, "\n");
+			sink_puts(out, "#   Lap cumulative:      ");
+			workout_time_print(&l->cumulative, "hmst", out);
+			sink_puts(out, "\n");
+			sink_printf(out, "#   Lap HR:              %d bpm\n", l->lap_hr);
+			sink_printf(out, "#   Average HR:          %d bpm\n", l->avg_hr);
+			sink_printf(out, "#   Maximum HR:          %d bpm\n", l->max_hr);
 
 			if (S725_HAS_ALTITUDE(w->mode)) {
-				fprintf(fp, "#   Lap altitude:        %d %s\n",
+				sink_printf(out, "#   Lap altitude:        %d %s\n",
 						l->alt, w->units.altitude);
-				fprintf(fp, "#   Lap ascent:          %d %s\n",
+				sink_printf(out, "#   Lap ascent:          %d %s\n",
 						l->ascent, w->units.altitude);
-				fprintf(fp, "#   Lap cumulat. asc:    %d %s\n",
+				sink_printf(out, "#   Lap cumulat. asc:    %d %s\n",
 						l->cumul_ascent, w->units.altitude);
-				fprintf(fp, "#   Lap temperature:     %d %s\n",
+				sink_printf(out, "#   Lap temperature:     %d %s\n",
 						l->temp, w->units.temperature);
 			}
 
 			if (S725_HAS_CADENCE(w->mode))
-				fprintf(fp, "#   Lap cadence:         %d rpm\n", l->cad);
+				sink_printf(out, "#   Lap cadence:         %d rpm\n", l->cad);
 
 			if (S725_HAS_SPEED(w->mode)) {
 				float  lap_speed = 0;
 				time_t tenths;
 
-				fprintf(fp, "#   Lap distance:        %.1f %s\n",
+				sink_printf(out, "#   Lap distance:        %.1f %s\n",
 						l->distance/10.0, w->units.distance);
-				fprintf(fp, "#   Lap cumulat. dist:   %.1f %s\n",
+				sink_printf(out, "#   Lap cumulat. dist:   %.1f %s\n",
 						l->cumul_distance/10.0, w->units.distance);
-				fprintf(fp, "#   Lap speed at end:    %.1f %s\n",
+				sink_printf(out, "#   Lap speed at end:    %.1f %s\n",
 						l->speed/16.0, w->units.speed);
 				tenths = workout_time_to_tenths(&l->split);
 				if (tenths > 0) {
 					/* note the cancelling factors of 10 */
 					lap_speed = l->distance / ((float)tenths/3600.0);
 				}
-				fprintf(fp, "#   Lap speed ave:       %.1f %s\n",
+				sink_printf(out, "#   Lap speed ave:       %.1f %s\n",
 						lap_speed, w->units.speed);
 			}
 
 			if (S725_HAS_POWER(w->mode)) {
-				fprintf(fp, "#   Lap power:           %d W\n",
+				sink_printf(out, "#   Lap power:           %d W\n",
 						l->power.power);
-				fprintf(fp, "#   Lap LR balance:      %d-%d\n",
+				sink_printf(out, "#   Lap LR balance:      %d-%d\n",
 						l->power.lr_balance >> 1,
 						100 - (l->power.lr_balance >> 1));
-				fprintf(fp, "#   Lap pedal index:     %d%%\n",
+				sink_printf(out, "#   Lap pedal index:     %d%%\n",
 						l->power.pedal_index >> 1);
 			}
 
-			fprintf(fp, "#\n");
+			sink_puts(out, "#\n");
 		}
 	}
 
 	if (what & S725_WORKOUT_SAMPLES) {
 		/* sample data */
-		fprintf(fp, "#\n# Recorded data:\n#\n");
-		fprintf(fp, "#   Time\t HR");
+		sink_puts(out, "#\n# Recorded data:\n#\n");
+		sink_puts(out, "#   Time\t HR");
 
 		if (S725_HAS_ALTITUDE(w->mode)) {
-			fprintf(fp, "\t Alt\t    VAM");
+			sink_puts(out, "\t Alt\t    VAM");
 		}
 
 		if (S725_HAS_SPEED(w->mode)) {
-			fprintf(fp, "\t  Spd");
-			fprintf(fp, "\t  Dist");
+			sink_puts(out, "\t  Spd");
+			sink_puts(out, "\t  Dist");
 			if (S725_HAS_POWER(w->mode)) {
-				fprintf(fp, "\tPower");
-				fprintf(fp, "\t   LR");
-				fprintf(fp, "\tPI");
+				sink_puts(out, "\tPower");
+				sink_puts(out, "\t   LR");
+				sink_puts(out, "\tPI");
 			}
 			if (S725_HAS_CADENCE(w->mode)) {
-				fprintf(fp, "\tCad");
+				sink_puts(out, "\tCad");
 			}
 		}
-		fprintf(fp, "\n");
+		sink_puts(out, "\n");
 
 		memset(&s, 0, sizeof(s));
 		for (i = 0; i < w->samples; i++) {
-			workout_time_print(&s, "hms", fp);
-			fprintf(fp, "\t%3d", w->hr_data[i]);
+			workout_time_print(&s, "hms", out);
+			sink_printf(out, "\t%3d", w->hr_data[i]);
 
 			if (S725_HAS_ALTITUDE(w->mode)) {
 				/* compute VAM as the average of the past 60 seconds... */
@@ -304,33 +312,35 @@ workout_print_txt(workout_t *w, FILE *fp, int what)
 							((i-j) * w->recording_interval);
 					}
 				}
-				fprintf(fp, "\t%4d\t%7.1f", w->alt_data[i], vam);
+				sink_printf(out, "\t%4d\t%7.1f", w->alt_data[i], vam);
 			}
 
 			if (S725_HAS_SPEED(w->mode)) {
-				fprintf(fp, "\t%5.1f", w->speed_data[i]/16.0);
-				fprintf(fp, "\t%6.2f", w->dist_data[i]);
+				sink_printf(out, "\t%5.1f", w->speed_data[i]/16.0);
+				sink_printf(out, "\t%6.2f", w->dist_data[i]);
 				if (S725_HAS_POWER(w->mode)) {
-					fprintf(fp, "\t%5d\t%2d-%2d\t%2d",
-							w->power_data[i].power,
-							w->power_data[i].lr_balance >> 1,
-							100 - (w->power_data[i].lr_balance >> 1),
-							w->power_data[i].pedal_index >> 1);
+					sink_printf(out, "\t%5d\t%2d-%2d\t%2d",
+							workout_power(w, i),
+							workout_lr_balance(w, i) >> 1,
+							100 - (workout_lr_balance(w, i) >> 1),
+							workout_pedal_index(w, i) >> 1);
 				}
 
 				if (S725_HAS_CADENCE(w->mode)) {
-					fprintf(fp, "\t%3d", w->cad_data[i]);
+					sink_printf(out, "\t%3d", w->cad_data[i]);
 				}
 			}
-			fprintf(fp, "\n");
+			sink_puts(out, "\n");
 
 			workout_time_increment(&s, w->recording_interval);
 		}
 	}
+
+	stats_end(STATS_PRINT_TXT, t);
 }
 
 /*
- * This function takes a workout_t *w and dumps it to FILE *fp in HRM
+ * This function takes a workout_t *w and dumps it to SINK *out in HRM
  * format.
  *
  * For a description of the HRM file format, see:
@@ -342,7 +352,7 @@ workout_print_txt(workout_t *w, FILE *fp, int what)
  * around in there, in case you were wondering.
  */
 void
-workout_print_hrm(workout_t *w, FILE *fp)
+workout_print_hrm(workout_t *w, SINK *out)
 {
 	int i, j;
 	unsigned long sum_altitude;
@@ -359,10 +369,11 @@ workout_print_hrm(workout_t *w, FILE *fp)
 	int lap_end_sample;
 	int lap_min_hr;
 	int mode;
+	uint64_t t = stats_begin();
 
 	/* sanity checks. */
-	if (w == NULL || fp == NULL) {
-		log_error("workout_print_tcx: improper usage(%p,%p)", w, fp);
+	if (w == NULL || out == NULL) {
+		log_error("workout_print_tcx: improper usage(%p,%p)", w, out);
 		return;
 	}
 
@@ -371,6 +382,11 @@ workout_print_hrm(workout_t *w, FILE *fp)
 		return;
 	}
 
+	if (!workout_load(w, S725_WORKOUT_FULL)) {
+		log_error("workout_print_hrm: unable to decode workout");
+		return;
+	}
+
 	/*
 	 * Sometimes users leave the watch in cycling mode when they don't
 	 * mean to.  Either they forget to change modes, or they just don't
@@ -394,7 +410,7 @@ workout_print_hrm(workout_t *w, FILE *fp)
 	if ( w->speed_data != NULL )
 		for ( i = 0; i < w->samples; i++ ) sum_speed    += w->speed_data[i];
 	if ( w->power_data != NULL )
-		for ( i = 0; i < w->samples; i++ ) sum_power    += w->power_data[i].power;
+		for ( i = 0; i < w->samples; i++ ) sum_power    += w->power_data[i];
 
 	if ( sum_altitude == 0 )  mode &= ~S725_MODE_ALTITUDE;
 	if ( sum_cadence  == 0 )  mode &= ~S725_MODE_CADENCE;
@@ -405,11 +421,11 @@ workout_print_hrm(workout_t *w, FILE *fp)
 
 	/* Print version and monitor numbers */
 
-	fprintf(fp,"[Params]\r\nVersion=106\r\nMonitor=%d\r\n",w->type);
+	sink_printf(out,"[Params]\r\nVersion=106\r\nMonitor=%d\r\n",w->type);
 
 	/* Print the SMode flags (to our knowledge) */
 
-	fprintf(fp,"SMode=%d%d%d%d%d%d%d%d0\r\n",
+	sink_printf(out,"SMode=%d%d%d%d%d%d%d%d0\r\n",
 			( S725_HAS_SPEED(mode) )    ? 1 : 0,
 			( S725_HAS_CADENCE(mode) )  ? 1 : 0,
 			( S725_HAS_ALTITUDE(mode) ) ? 1 : 0,
@@ -421,27 +437,27 @@ workout_print_hrm(workout_t *w, FILE *fp)
 
 	/* Date, StartTime, Length, Interval */
 
-	fprintf(fp,"Date=%4d%02d%02d\r\n",
+	sink_printf(out,"Date=%4d%02d%02d\r\n",
 			w->date.tm_year + 1900,
 			w->date.tm_mon + 1,
 			w->date.tm_mday);
 
-	fprintf(fp,"StartTime=%02d:%02d:%02d.0\r\n",
+	sink_printf(out,"StartTime=%02d:%02d:%02d.0\r\n",
 			w->date.tm_hour,
 			w->date.tm_min,
 			w->date.tm_sec);
 
-	fprintf(fp,"Length=%02d:%02d:%02d.%d\r\n",
+	sink_printf(out,"Length=%02d:%02d:%02d.%d\r\n",
 			w->duration.hours,
 			w->duration.minutes,
 			w->duration.seconds,
 			w->duration.tenths);
 
-	fprintf(fp,"Interval=%d\r\n",w->recording_interval);
+	sink_printf(out,"Interval=%d\r\n",w->recording_interval);
 
 	/* Limits 1, 2 and 3 */
 
-	fprintf(fp,
+	sink_printf(out,
 			"Upper1=%d\r\nLower1=%d\r\n"
 			"Upper2=%d\r\nLower2=%d\r\n"
 			"Upper3=%d\r\nLower3=%d\r\n",
@@ -454,14 +470,14 @@ workout_print_hrm(workout_t *w, FILE *fp)
 
 	/* Exercise timers 1, 2 and 3 */
 
-	fprintf(fp,
+	sink_printf(out,
 			"Timer1=00:00:00.0\r\n"
 			"Timer2=00:00:00.0\r\n"
 			"Timer3=00:00:00.0\r\n");
 
 	/* ActiveLimit - I think this is set using the Polar software */
 
-	fprintf(fp,"ActiveLimit=0\r\n");
+	sink_puts(out, "ActiveLimit=0\r\n");
 
 	/*
 	   MaxHR, RestHR are not recorded in the file.  They're recorded in
@@ -472,23 +488,23 @@ workout_print_hrm(workout_t *w, FILE *fp)
 	   from the user's config file.
 	*/
 
-	fprintf(fp,"MaxHR=%d\r\n",S725_HRM_MAX_HR);
-	fprintf(fp,"RestHR=%d\r\n",S725_HRM_REST_HR);
-	fprintf(fp,"StartDelay=0\r\n");
+	sink_printf(out,"MaxHR=%d\r\n",S725_HRM_MAX_HR);
+	sink_printf(out,"RestHR=%d\r\n",S725_HRM_REST_HR);
+	sink_puts(out, "StartDelay=0\r\n");
 
 	/* VO2Max, Weight - see above. */
 
-	fprintf(fp,"VO2max=50\r\n");
-	fprintf(fp,"Weight=%d\r\n",
+	sink_puts(out, "VO2max=50\r\n");
+	sink_printf(out,"Weight=%d\r\n",
 			(w->units.system == S725_UNITS_ENGLISH) ? 150 : 70);
 
 	/* Note */
 
-	fprintf(fp,"\r\n[Note]\r\n");
+	sink_puts(out, "\r\n[Note]\r\n");
 
 	/* IntTimes */
 
-	fprintf(fp,"\r\n[IntTimes]\r\n");
+	sink_puts(out, "\r\n[IntTimes]\r\n");
 
 	for ( i = 0; i < w->laps; i++ ) {
 
@@ -525,7 +541,7 @@ workout_print_hrm(workout_t *w, FILE *fp)
 			}
 		}
 
-		fprintf(fp,"%02d:%02d:%02d.%d\t%d\t%d\t%d\t%d\r\n",
+		sink_printf(out,"%02d:%02d:%02d.%d\t%d\t%d\t%d\t%d\r\n",
 				w->lap_data[i].cumulative.hours,
 				w->lap_data[i].cumulative.minutes,
 				w->lap_data[i].cumulative.seconds,
@@ -534,30 +550,30 @@ workout_print_hrm(workout_t *w, FILE *fp)
 				lap_min_hr,
 				w->lap_data[i].avg_hr,
 				w->lap_data[i].max_hr);
-		fprintf(fp,"2\t0\t0\t%d\t%d\t%d\r\n",
+		sink_printf(out,"2\t0\t0\t%d\t%d\t%d\r\n",
 				(int)(w->lap_data[i].speed * 10.0/16.0 + 0.5),
 				w->lap_data[i].cad,
 				w->lap_data[i].alt);
-		fprintf(fp,"0\t0\t0\t%d\t%d\r\n",
+		sink_printf(out,"0\t0\t0\t%d\t%d\r\n",
 				w->lap_data[i].ascent,
 				w->lap_data[i].distance);
-		fprintf(fp,"0\t0\t%d\t%d\t0\t0\r\n",
+		sink_printf(out,"0\t0\t%d\t%d\t0\t0\r\n",
 				w->lap_data[i].power.power,
 				w->lap_data[i].temp);
-		fprintf(fp,"0\t0\t0\t0\t0\t0\r\n");
+		sink_puts(out, "0\t0\t0\t0\t0\t0\r\n");
 	}
 
 	/* IntNotes */
 
-	fprintf(fp,"\r\n[IntNotes]\r\n");
+	sink_puts(out, "\r\n[IntNotes]\r\n");
 
 	/* ExtraData */
 
-	fprintf(fp,"\r\n[ExtraData]\r\n");
+	sink_puts(out, "\r\n[ExtraData]\r\n");
 
 	/* Summary-123 */
 
-	fprintf(fp,"\r\n[Summary-123]\r\n");
+	sink_puts(out, "\r\n[Summary-123]\r\n");
 
 	/* We'll need this a few times. */
 
@@ -593,40 +609,40 @@ workout_print_hrm(workout_t *w, FILE *fp)
 
 		/* Now we have the number of samples in each of the five ranges. */
 
-		fprintf(fp,"%d\t%d\t%d\t%d\t%d\t%d\r\n",
+		sink_printf(out,"%d\t%d\t%d\t%d\t%d\t%d\r\n",
 				sampled_seconds,
 				above_max * w->recording_interval,
 				upper_to_max * w->recording_interval,
 				lower_to_upper * w->recording_interval,
 				rest_to_lower * w->recording_interval,
 				below_rest * w->recording_interval);
-		fprintf(fp,"%d\t%d\t%d\t%d\r\n",
+		sink_printf(out,"%d\t%d\t%d\t%d\r\n",
 				S725_HRM_MAX_HR,
 				w->hr_limit[i].upper,
 				w->hr_limit[i].lower,
 				S725_HRM_REST_HR);
 	}
-	fprintf(fp,"0\t%d\r\n",w->samples-1);
+	sink_printf(out,"0\t%d\r\n",w->samples-1);
 
 	/* Summary-TH - see comments below. */
 
-	fprintf(fp,"\r\n[Summary-TH]\r\n");
-	fprintf(fp,"%d\t0\t%d\t0\t0\t0\r\n",sampled_seconds,sampled_seconds);
-	fprintf(fp,"%d\t0\t0\t%d\r\n",S725_HRM_MAX_HR,S725_HRM_REST_HR);
-	fprintf(fp,"0\t%d\r\n",w->samples-1);
+	sink_puts(out, "\r\n[Summary-TH]\r\n");
+	sink_printf(out,"%d\t0\t%d\t0\t0\t0\r\n",sampled_seconds,sampled_seconds);
+	sink_printf(out,"%d\t0\t0\t%d\r\n",S725_HRM_MAX_HR,S725_HRM_REST_HR);
+	sink_printf(out,"0\t%d\r\n",w->samples-1);
 
 	/*
 	   HRZones - these quantities are set by the user in the Polar software.
 	   Fill in with an "empty" set of values.
 	*/
 
-	fprintf(fp,"\r\n[HRZones]\r\n");
-	fprintf(fp,"0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n");
+	sink_puts(out, "\r\n[HRZones]\r\n");
+	sink_puts(out, "0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n0\r\n");
 
 	/* Trip */
 
-	fprintf(fp,"\r\n[Trip]\r\n");
-	fprintf(fp,"%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n",
+	sink_puts(out, "\r\n[Trip]\r\n");
+	sink_printf(out,"%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n%d\r\n",
 			w->exercise_distance,
 			w->ascent,
 			w->duration.seconds +
@@ -639,72 +655,73 @@ workout_print_hrm(workout_t *w, FILE *fp)
 
 	/* HRData */
 
-	fprintf(fp,"\r\n[HRData]\r\n");
+	sink_puts(out, "\r\n[HRData]\r\n");
 
 	for ( i = 0; i < w->samples; i++ ) {
-		fprintf(fp,"%d",w->hr_data[i]);
+		sink_printf(out,"%d",w->hr_data[i]);
 		if ( S725_HAS_SPEED(mode) ) {
-			fprintf(fp,"\t%d",(int)(w->speed_data[i] * 10.0 / 16.0 + 0.5));
+			sink_printf(out,"\t%d",(int)(w->speed_data[i] * 10.0 / 16.0 + 0.5));
 		}
 		if ( S725_HAS_CADENCE(mode) ) {
-			fprintf(fp,"\t%d",w->cad_data[i]);
+			sink_printf(out,"\t%d",w->cad_data[i]);
 		}
 		if ( S725_HAS_ALTITUDE(mode) ) {
-			fprintf(fp,"\t%d",w->alt_data[i]);
+			sink_printf(out,"\t%d",w->alt_data[i]);
 		}
 		if ( S725_HAS_POWER(mode) ) {
-			fprintf(fp,"\t%d\t%d",
-					w->power_data[i].power,
-					(w->power_data[i].pedal_index << 7) +
-					(w->power_data[i].lr_balance >> 1));
+			sink_printf(out,"\t%d\t%d",
+					workout_power(w, i),
+					(workout_pedal_index(w, i) << 7) +
+					(workout_lr_balance(w, i) >> 1));
 		}
-		fprintf(fp,"\r\n");
+		sink_puts(out, "\r\n");
 	}
 
 	/* That's all, folks. */
 
-	fflush(fp);
+	sink_flush(out);
+	stats_end(STATS_PRINT_HRM, t);
 }
 
-/*
- * Print workout in TCX format
- *
- * For a specification, see:
- * https://www8.garmin.com/xmlschemas/TrainingCenterDatabasev2.xsd
- *
- */
-void
-workout_print_tcx(workout_t *w, FILE *fp)
+/* Check that <w> can be written as TCX, and decode all of it. */
+static int
+workout_print_tcx_check(workout_t *w, SINK *out)
 {
-	char buf[BUFSIZ];
-	int i, j, count;
-	int count_after_end;
-
 	/* sanity checks. */
-	if (w == NULL || fp == NULL) {
-		log_error("workout_print_hrm: improper usage(%p,%p)", w, fp);
-		return;
+	if (w == NULL || out == NULL) {
+		log_error("workout_print_hrm: improper usage(%p,%p)", w, out);
+		return 0;
 	}
 
 	if (w->type == S725_HRM_UNKNOWN) {
 		log_error("workout_print_hrm: unknown HRM model");
-		return;
+		return 0;
 	}
 
+	if (!workout_load(w, S725_WORKOUT_FULL)) {
+		log_error("workout_print_tcx: unable to decode workout");
+		return 0;
+	}
+	return 1;
+}
 
-	fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n");
-	fprintf(fp, "<TrainingCenterDatabase\n"
-			"    xmlns=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\"\n"
-			"    xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
-			"    xsi:schemaLocation=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\n"
-			"    http://www.garmin.com/xmlschemas/TrainingCenterDatabasev2.xsd\">\n");
+/*
+ * Write the Activity element of <w>. Returns the number of samples
+ * written, and the number after the end of the last lap in <after_end>.
+ */
+static int
+workout_print_tcx_laps(workout_t *w, SINK *out, int *after_end)
+{
+	char buf[BUFSIZ];
+	struct tm tm;
+	int i, j, count;
+	int count_after_end;
 
-	fprintf(fp, "<Activities>\n");
-	fprintf(fp, "  <Activity Sport=\"Running\">\n");
+	sink_puts(out, "  <Activity Sport=\"Running\">\n");
 
 	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ",
-			 localtime(&w->unixtime));
-	fprintf(fp, "    <Id>%s</Id>\n", buf);
+			 localtime_r(&w->unixtime, &tm));
+	sink_printf(out, "    <Id>%s</Id>\n", buf);
 
 	if (w->units.distance[0] == 'm') {
 		log_error("TODO: implement conversion from miles to metres");
@@ -713,21 +730,21 @@ workout_print_tcx(workout_t *w, FILE *fp)
 	count = 0;
 	count_after_end = 0;
 	for (i = 0; i < w->laps; i++) {
-		fprintf(fp, "    <Lap StartTime=\"%s\">\n", buf);
-		fprintf(fp, "      <TotalTimeSeconds>%.5lf</TotalTimeSeconds>\n",
+		sink_printf(out, "    <Lap StartTime=\"%s\">\n", buf);
+		sink_printf(out, "      <TotalTimeSeconds>%.5lf</TotalTimeSeconds>\n",
 				w->lap_data[i].split.hours * 3600.0 + w->lap_data[i].split.minutes * 60.0 + w->lap_data[i].split.seconds);
-		fprintf(fp, "      <DistanceMeters>%.5lf</DistanceMeters>\n",
+		sink_printf(out, "      <DistanceMeters>%.5lf</DistanceMeters>\n",
 				w->lap_data[i].distance * 100.0);
 
 		/* TODO: maximum speed and calories should be calculated per lap */
-		fprintf(fp, "      <MaximumSpeed>%.5lf</MaximumSpeed>\n", w->max_speed / 16.0);
-		fprintf(fp, "      <Calories>%d</Calories>\n", w->total_energy / w->laps);
+		sink_printf(out, "      <MaximumSpeed>%.5lf</MaximumSpeed>\n", w->max_speed / 16.0);
+		sink_printf(out, "      <Calories>%d</Calories>\n", w->total_energy / w->laps);
 
-		fprintf(fp, "      <AverageHeartRateBpm><Value>%d</Value></AverageHeartRateBpm>\n", w->lap_data[i].avg_hr);
-		fprintf(fp, "      <MaximumHeartRateBpm><Value>%d</Value></MaximumHeartRateBpm>\n", w->lap_data[i].max_hr);
-		fprintf(fp, "      <Intensity>Active</Intensity>\n");
-		fprintf(fp, "      <TriggerMethod>Manual</TriggerMethod>\n");
-		fprintf(fp, "      <Track>\n");
+		sink_printf(out, "      <AverageHeartRateBpm><Value>%d</Value></AverageHeartRateBpm>\n", w->lap_data[i].avg_hr);
+		sink_printf(out, "      <MaximumHeartRateBpm><Value>%d</Value></MaximumHeartRateBpm>\n", w->lap_data[i].max_hr);
+		sink_puts(out, "      <Intensity>Active</Intensity>\n");
+		sink_puts(out, "      <TriggerMethod>Manual</TriggerMethod>\n");
+		sink_puts(out, "      <Track>\n");
 
 		int cumulative_seconds = w->lap_data[i].cumulative.hours * 3600
 			+ w->lap_data[i].cumulative.minutes * 60
@@ -754,41 +771,110 @@ workout_print_tcx(workout_t *w, FILE *fp)
 				continue;
 
 			count++;
-			fprintf(fp, "        <Trackpoint>\n");
-			fprintf(fp, "        <!-- sample #%d -->\n", j);
+			sink_puts(out, "        <Trackpoint>\n");
+			sink_printf(out, "        <!-- sample #%d -->\n", j);
 			time_t stamp = w->unixtime + j * w->recording_interval;
 			strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ",
-					 localtime(&stamp));
-			fprintf(fp, "          <Time>%s</Time>\n", buf);
+					 localtime_r(&stamp, &tm));
+			sink_printf(out, "          <Time>%s</Time>\n", buf);
 
 			if ( w->alt_data != NULL )
-				fprintf(fp, "          <AltitudeMeters>%f</AltitudeMeters>\n", w->alt_data[j] * 1.0);
+				sink_printf(out, "          <AltitudeMeters>%f</AltitudeMeters>\n", w->alt_data[j] * 1.0);
 
 			if ( w->dist_data != NULL )
-				fprintf(fp, "          <DistanceMeters>%f</DistanceMeters>\n", w->dist_data[j] * 1000.0);
+				sink_printf(out, "          <DistanceMeters>%f</DistanceMeters>\n", w->dist_data[j] * 1000.0);
 
 			if ( w->hr_data != NULL )
-				fprintf(fp, "          <HeartRateBpm><Value>%hhu</Value></HeartRateBpm>\n", w->hr_data[j]);
+				sink_printf(out, "          <HeartRateBpm><Value>%hhu</Value></HeartRateBpm>\n", w->hr_data[j]);
 
 			if ( w->cad_data != NULL )
-				fprintf(fp, "          <Cadence>%f</Cadence>\n", w->cad_data[j] * 1.0);
+				sink_printf(out, "          <Cadence>%f</Cadence>\n", w->cad_data[j] * 1.0);
 
-			fprintf(fp, "        </Trackpoint>\n");
+			sink_puts(out, "        </Trackpoint>\n");
 		}
 
-		fprintf(fp, "      </Track>\n");
-		fprintf(fp, "    </Lap>\n");
+		sink_puts(out, "      </Track>\n");
+		sink_puts(out, "    </Lap>\n");
 	}
-	fprintf(fp, "  </Activity>\n");
-	fprintf(fp, "</Activities>\n");
-	fprintf(fp, "</TrainingCenterDatabase>\n");
+	sink_puts(out, "  </Activity>\n");
 
+	*after_end = count_after_end;
+	return count;
+}
+
+static void
+workout_print_tcx_counts(workout_t *w, SINK *out, int count, int count_after_end)
+{
 	if (count != w->samples)
-		fprintf(fp, "<!-- #samples does not match: %d != %d -->\n", count, w->samples);
+		sink_printf(out, "<!-- #samples does not match: %d != %d -->\n", count, w->samples);
+
+	sink_printf(out, "<!-- output count: %3d -->\n", count);
+	sink_printf(out, "<!-- data samples: %3d -->\n", w->samples);
+	sink_printf(out, "<!-- after end:    %3d -->\n", count_after_end);
+}
+
+/* Write the start of a TCX document, for workout_print_tcx_activity(). */
+void
+workout_print_tcx_begin(SINK *out)
+{
+	sink_puts(out, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n");
+	sink_puts(out, "<TrainingCenterDatabase\n"
+			"    xmlns=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\"\n"
+			"    xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
+			"    xsi:schemaLocation=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\n"
+			"    http://www.garmin.com/xmlschemas/TrainingCenterDatabasev2.xsd\">\n");
+
+	sink_puts(out, "<Activities>\n");
+}
+
+/*
+ * Write <w> as one Activity of the document started with
+ * workout_print_tcx_begin(), so a TCX file can hold many workouts.
+ */
+void
+workout_print_tcx_activity(workout_t *w, SINK *out)
+{
+	int count, count_after_end;
+	uint64_t t = stats_begin();
+
+	if (!workout_print_tcx_check(w, out))
+		return;
+
+	count = workout_print_tcx_laps(w, out, &count_after_end);
+	workout_print_tcx_counts(w, out, count, count_after_end);
+
+	stats_end(STATS_PRINT_TCX, t);
+}
+
+/* Write the end of a document started with workout_print_tcx_begin(). */
+void
+workout_print_tcx_end(SINK *out)
+{
+	sink_puts(out, "</Activities>\n");
+	sink_puts(out, "</TrainingCenterDatabase>\n");
+}
+
+/*
+ * Print workout in TCX format
+ *
+ * For a specification, see:
+ * https://www8.garmin.com/xmlschemas/TrainingCenterDatabasev2.xsd
+ *
+ */
+void
+workout_print_tcx(workout_t *w, SINK *out)
+{
+	int count, count_after_end;
+	uint64_t t = stats_begin();
+
+	if (!workout_print_tcx_check(w, out))
+		return;
 
-	fprintf(fp, "<!-- output count: %3d -->\n", count);
-	fprintf(fp, "<!-- data samples: %3d -->\n", w->samples);
-	fprintf(fp, "<!-- after end:    %3d -->\n", count_after_end);
+	workout_print_tcx_begin(out);
+	count = workout_print_tcx_laps(w, out, &count_after_end);
+	workout_print_tcx_end(out);
+	workout_print_tcx_counts(w, out, count, count_after_end);
 
-	fflush(fp);
+	sink_flush(out);
+	stats_end(STATS_PRINT_TCX, t);
 }
@@ -22,8 +22,7 @@
 #ifndef WORKOUT_PRINT_H
 #define WORKOUT_PRINT_H
 
-#include <stdio.h>
-
+#include "sink.h"
 #include "workout.h"
 
 #define S725_WORKOUT_HEADER   1
@@ -31,8 +30,11 @@
 #define S725_WORKOUT_SAMPLES  4
 #define S725_WORKOUT_FULL     7
 
-void		workout_print_txt(workout_t * w, FILE *fp, int what);
-void		workout_print_hrm(workout_t *w, FILE *fp);
-void		workout_print_tcx(workout_t *w, FILE *fp);
+void		workout_print_txt(workout_t * w, SINK *out, int what);
+void		workout_print_hrm(workout_t *w, SINK *out);
+void		workout_print_tcx(workout_t *w, SINK *out);
+void		workout_print_tcx_begin(SINK *out);
+void		workout_print_tcx_activity(workout_t *w, SINK *out);
+void		workout_print_tcx_end(SINK *out);
 
 #endif	/* WORKOUT_PRINT_H */
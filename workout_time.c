@@ -105,7 +105,7 @@ workout_time_diff(S725_Time *t1, S725_Time *t2, S725_Time *diff)
 }
 
 /*
- * write time to given fp
+ * write time to given sink
  *
  * the "format" argument can be one of:
  *
@@ -117,7 +117,7 @@ workout_time_diff(S725_Time *t1, S725_Time *t2, S725_Time *diff)
  * "st"   => 56.7
  */
 void
-workout_time_print(S725_Time *t, const char *format, FILE *fp)
+workout_time_print(S725_Time *t, const char *format, SINK *out)
 {
 	const char *p;
 	int   r = 0;
@@ -125,23 +125,23 @@ workout_time_print(S725_Time *t, const char *format, FILE *fp)
 	for (p = format; *p != 0; p++) {
 		switch (*p) {
 		case 'h': case 'H':
-			if (r) fprintf(fp, ":");
-			fprintf(fp, "%02d", t->hours);
+			if (r) sink_putc(out, ':');
+			sink_printf(out, "%02d", t->hours);
 			r = 1;
 			break;
 		case 'm': case 'M':
-			if (r) fprintf(fp, ":");
-			fprintf(fp, "%02d", t->minutes);
+			if (r) sink_putc(out, ':');
+			sink_printf(out, "%02d", t->minutes);
 			r = 1;
 			break;
 		case 's': case 'S':
-			if (r) fprintf(fp, ":");
-			fprintf(fp, "%02d", t->seconds);
+			if (r) sink_putc(out, ':');
+			sink_printf(out, "%02d", t->seconds);
 			r = 1;
 			break;
 		case 't': case 'T':
-			if (r) fprintf(fp, ".");
-			fprintf(fp, "%d", t->tenths);
+			if (r) sink_putc(out, '.');
+			sink_printf(out, "%d", t->tenths);
 			r = 1;
 			break;
 		default:
@@ -24,8 +24,77 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "stats.h"
 #include "xmalloc.h"
 
+static void *
+std_malloc(size_t size, void *ctx)
+{
+	return malloc(size);
+}
+
+static void *
+std_realloc(void *ptr, size_t size, void *ctx)
+{
+	return realloc(ptr, size);
+}
+
+static void
+std_free(void *ptr, void *ctx)
+{
+	free(ptr);
+}
+
+static const struct xmalloc_hooks std_hooks = {
+	std_malloc, std_realloc, std_free, NULL
+};
+static struct xmalloc_hooks hooks = { std_malloc, std_realloc, std_free, NULL };
+
+/*
+ * Send all allocations through <h>, or back to malloc if <h> is NULL.
+ * Memory must be freed with the hooks it was allocated with, so this
+ * is only safe before anything is allocated.
+ */
+void
+xmalloc_set_hooks(const struct xmalloc_hooks *h)
+{
+	hooks = h != NULL ? *h : std_hooks;
+}
+
+/* Like malloc, realloc and free, but through the hooks. */
+void *
+hmalloc(size_t size)
+{
+	return hooks.malloc(size, hooks.ctx);
+}
+
+void *
+hcalloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (nmemb != 0 && SIZE_MAX / nmemb < size)
+		return NULL;
+	if ((ptr = hooks.malloc(nmemb * size, hooks.ctx)) != NULL)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+void *
+hrealloc(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return hooks.malloc(size, hooks.ctx);
+	return hooks.realloc(ptr, size, hooks.ctx);
+}
+
+void
+hfree(void *ptr)
+{
+	if (ptr != NULL)
+		hooks.free(ptr, hooks.ctx);
+}
+
 void *
 xmalloc(size_t size)
 {
@@ -33,11 +102,12 @@ xmalloc(size_t size)
 
 	if (size == 0)
 		errx(1, "xmalloc: zero size");
-	ptr = malloc(size);
+	ptr = hmalloc(size);
 	if (ptr == NULL)
 		errx(1,
 		    "xmalloc: out of memory (allocating %lu bytes)",
 		    (u_long) size);
+	stats_add(STATS_ALLOCS, 1);
 	return ptr;
 }
 
@@ -50,10 +120,11 @@ xcalloc(size_t nmemb, size_t size)
 		errx(1, "xcalloc: zero size");
 	if (SIZE_MAX / nmemb < size)
 		errx(1, "xcalloc: nmemb * size > SIZE_MAX");
-	ptr = calloc(nmemb, size);
+	ptr = hcalloc(nmemb, size);
 	if (ptr == NULL)
 		errx(1, "xcalloc: out of memory (allocating %lu bytes)",
 		    (u_long)(size * nmemb));
+	stats_add(STATS_ALLOCS, 1);
 	return ptr;
 }
 
@@ -67,13 +138,11 @@ xrealloc(void *ptr, size_t nmemb, size_t size)
 		errx(1, "xrealloc: zero size");
 	if (SIZE_MAX / nmemb < size)
 		errx(1, "xrealloc: nmemb * size > SIZE_MAX");
-	if (ptr == NULL)
-		new_ptr = malloc(new_size);
-	else
-		new_ptr = realloc(ptr, new_size);
+	new_ptr = hrealloc(ptr, new_size);
 	if (new_ptr == NULL)
 		errx(1, "xrealloc: out of memory (new_size %lu bytes)",
 		    (u_long) new_size);
+	stats_add(STATS_ALLOCS, 1);
 	return new_ptr;
 }
 
@@ -82,7 +151,19 @@ xfree(void *ptr)
 {
 	if (ptr == NULL)
 		errx(1, "xfree: NULL pointer given as argument");
-	free(ptr);
+	hfree(ptr);
+}
+
+char *
+xstrdup(const char *str)
+{
+	size_t len;
+	char *cp;
+
+	len = strlen(str) + 1;
+	cp = xmalloc(len);
+	memcpy(cp, str, len);
+	return cp;
 }
 
 int
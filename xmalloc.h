@@ -19,10 +19,25 @@
 #ifndef XMALLOC_H
 #define XMALLOC_H
 
+/* called instead of malloc, realloc and free, with <ctx> as last argument */
+struct xmalloc_hooks {
+	void	*(*malloc)(size_t, void *);
+	void	*(*realloc)(void *, size_t, void *);
+	void	 (*free)(void *, void *);
+	void	*ctx;
+};
+
+void	 xmalloc_set_hooks(const struct xmalloc_hooks *);
+void	*hmalloc(size_t);
+void	*hcalloc(size_t, size_t);
+void	*hrealloc(void *, size_t);
+void	 hfree(void *);
+
 void	*xmalloc(size_t);
 void	*xcalloc(size_t, size_t);
 void	*xrealloc(void *, size_t, size_t);
 void	 xfree(void *);
+char	*xstrdup(const char *);
 int		 xasprintf(char **, const char *, ...)
                 __attribute__((__format__ (printf, 2, 3)))
                 __attribute__((__nonnull__ (2)));